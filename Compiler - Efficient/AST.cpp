@@ -1,8 +1,33 @@
 #include "AST.h"
 #include <iostream>
 #include <cassert>
+#include <unordered_map>
 using namespace std;
 
+unordered_map<string, int> symbolIds;
+vector<const string*> symbolNames;
+
+int internSymbol(const string& name)
+{
+	auto res = symbolIds.emplace(name, (int)symbolNames.size());
+
+	if (res.second)
+		symbolNames.push_back(&res.first->first);
+
+	return res.first->second;
+}
+
+int findSymbol(const string& name)
+{
+	auto res = symbolIds.find(name);
+	return res == symbolIds.end() ? -1 : res->second;
+}
+
+const string& symbolName(int symbol)
+{
+	return *symbolNames[symbol];
+}
+
 Token* copy_token(const Token* old_token)
 {
 	Token* token = new Token;
@@ -22,12 +47,14 @@ FuncNode::FuncNode(const string& token) : ASTNode(NonTerminalType::FUNCTION)
 ParameterNode::ParameterNode(const string& var, ASTNode* type) : ASTNode(NonTerminalType::PARAMETER)
 {
 	this->varName = var;
+	this->symbol = internSymbol(var);
 	this->varType = type;
 }
 
 IDNode::IDNode(const string& var) : ASTNode(NonTerminalType::ID)
 {
 	this->varName = var;
+	this->symbol = internSymbol(var);
 }
 
 TypeDefinitionNode::TypeDefinitionNode(bool isRecord, const string& name) : ASTNode(NonTerminalType::TYPE_DEFINITION)
@@ -39,6 +66,7 @@ TypeDefinitionNode::TypeDefinitionNode(bool isRecord, const string& name) : ASTN
 FieldDefinitionNode::FieldDefinitionNode(const string& var, ASTNode* type) : ASTNode(NonTerminalType::FIELD_DEFINITION)
 {
 	this->varName = var;
+	this->symbol = internSymbol(var);
 	this->varType = type;
 }
 
@@ -46,6 +74,7 @@ VariableDefinitionNode::VariableDefinitionNode(bool isGlobal, const string& var,
 {
 	this->isGlobal = isGlobal;
 	this->varName = var;
+	this->symbol = internSymbol(var);
 	this->varType = type;
 }
 
@@ -54,16 +83,84 @@ AssignmentNode::AssignmentNode(ASTNode* target) : ASTNode(NonTerminalType::ASSIG
 	this->target = target;
 }
 
+ASTNode* createLeaf(const Token* token)
+{
+	assert(token != nullptr);
+
+	ASTNode* node = nullptr;
+
+	switch (token->type)
+	{
+	case TokenType::TK_NUM:
+	case TokenType::TK_RNUM:
+		node = new NumNode
+		{
+			token->type == TokenType::TK_RNUM,
+			token->lexeme
+		};
+		break;
+
+	case TokenType::TK_PLUS:
+	case TokenType::TK_MINUS:
+	case TokenType::TK_MUL:
+	case TokenType::TK_DIV:
+	case TokenType::TK_AND:
+	case TokenType::TK_OR:
+	case TokenType::TK_NOT:
+	case TokenType::TK_LT:
+	case TokenType::TK_LE:
+	case TokenType::TK_EQ:
+	case TokenType::TK_GT:
+	case TokenType::TK_GE:
+	case TokenType::TK_NE:
+	case TokenType::TK_DOT:
+		node = new OperatorNode
+		{
+			token->type
+		};
+		break;
+
+	default:
+		// TK_ID, TK_FIELDID, TK_RUID and the type keywords are all carried by name
+		node = new IDNode
+		{
+			token->lexeme
+		};
+		break;
+	}
+
+	node->line_number = token->line_number;
+	return node;
+}
+
+int firstLineNumber(const ParseTreeNode* input)
+{
+	if (input->token)
+		return input->token->line_number;
+
+	if (input->expression)
+		return input->expression->line_number;
+
+	for (auto child : input->children)
+		if (int line_number = firstLineNumber(child))
+			return line_number;
+
+	return 0;
+}
+
 ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTNode* inherited)
 {
 	assert(input != nullptr);
 
+	// expressions are built by the precedence climbing subparser while parsing
+	if (input->expression)
+		return input->expression;
+
 	if (input->isLeaf)
 	{
-		assert(input != nullptr && input->isLeaf);
+		assert(input->token != nullptr);
 
-		cout << "Not implemented yet!!" << endl;
-		return nullptr;
+		return createLeaf(input->token);
 	}
 
 	ASTNode* node = nullptr;
@@ -167,11 +264,6 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 	{
 		// <primitiveDatatype> ===> TK_INT
 
-		node = new ASTNode
-		{
-			NonTerminalType::GENERAL
-		};
-
 		return createAST(input->children[0], input);
 	}
 	else if (input->productionNumber == 12)
@@ -440,7 +532,7 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 		assert(oneExp->children.size() == 2);
 		ASTNode* dot = oneExp->children[0];
 		ASTNode* id = oneExp->children[1];
-		delete oneExp;
+		delete static_cast<OperatorNode*>(oneExp);
 
 		dot->children.resize(2);
 		dot->children[0] = inherited;
@@ -476,7 +568,7 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 		assert(oneExp->children.size() == 2);
 		ASTNode* dot = oneExp->children[0];
 		ASTNode* id = oneExp->children[1];
-		delete oneExp;
+		delete static_cast<OperatorNode*>(oneExp);
 
 		dot->children.resize(2);
 		dot->children[0] = inherited;
@@ -576,133 +668,12 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 			createAST(input->children[2], input)
 		};
 	}
-	else if (input->productionNumber == 60)
-	{
-		// <arithmeticExpression> ===> <term> <expPrime>
-		// <arithmeticExpression>.treenode = <expPrime>.syn
-		// <expPrime>.inh = <term>.treenode
-
-		ASTNode* termNode = createAST(input->children[0], input);
-		ASTNode* expPrime = createAST(input->children[1], input, termNode);
-		return expPrime;
-	}
-	else if (input->productionNumber == 61)
-	{
-		// <expPrime> ===> <lowPrecedenceOperators> <term> <expPrime[1]>
-		// <expPrime[1]>.inh = createTreeNode(<lowPrecedenceOperators>.data, <expPrime>.inh, <term>.treenode)
-		// <expPrime>.syn = <expPrime[1]>.syn
-
-		ASTNode* op = createAST(input->children[0], input);
-		ASTNode* term = createAST(input->children[1], input);
-
-		op->children.resize(2);
-		op->children[0] = inherited;
-		op->children[1] = term;
-
-		return createAST(input->children[2], input, op);
-	}
-	else if (input->productionNumber == 62)
-	{
-		// <expPrime> ===> eps
-		// <expPrime>.syn = <expPrime>.inh
-
-		return inherited;
-	}
-	else if (input->productionNumber == 63)
-	{
-		// <term> ===> <factor> <termPrime>
-		// <term>.treenode = <termPrime>.syn
-		// <termPrime>.inh = <factor>.treenode
-
-		ASTNode* factorNode = createAST(input->children[0], input);
-		ASTNode* termPrime = createAST(input->children[1], input, factorNode);
-		return termPrime;
-	}
-	else if (input->productionNumber == 64)
-	{
-		// <termPrime> ===> <highPrecedenceOperators> <factor> <termPrime[1]>
-		// <termPrime[1]>.treenode = createTreeNode(<highPrecedenceOperators>.data, <termPrime>.inh, <factor>.treenode)
-		// <termPrime>.syn = <termPrime[1]>.syn
-
-		ASTNode* op = createAST(input->children[0], input);
-		ASTNode* term = createAST(input->children[1], input);
-
-		op->children.resize(2);
-		op->children[0] = inherited;
-		op->children[1] = term;
-
-		return createAST(input->children[2], input, op);
-	}
-	else if (input->productionNumber == 65)
+	else if (input->productionNumber >= 60 && input->productionNumber <= 74)
 	{
-		// <termPrime> ===> eps
+		// <arithmeticExpression> and <booleanExpression> are never expanded through the parse table,
+		// parseExpression() builds their OperatorNode trees directly (see the check at the top)
 
-		return inherited;
-	}
-	else if (input->productionNumber == 66)
-	{
-		// <factor> ===> TK_OP <arithmeticExpression> TK_CL
-
-		return createAST(input->children[1], input);
-	}
-	else if (input->productionNumber == 67)
-	{
-		// <factor> ===> <var>
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 68)
-	{
-		// <highPrecedenceOperators> ===> TK_MUL
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 69)
-	{
-		// <highPrecedenceOperators> ===> TK_DIV
-		
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 70)
-	{
-		// <lowPrecedenceOperators> ===> TK_PLUS
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 71)
-	{
-		// <lowPrecedenceOperators> ===> TK_MINUS
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 72)
-	{
-		// <booleanExpression> ===> TK_OP <booleanExpression>1 TK_CL <logicalOp> TK_OP <booleanExpression>2 TK_CL
-
-		ASTNode* op = createAST(input->children[3], input);
-		op->children.resize(2);
-		op->children[0] = createAST(input->children[1], input);
-		op->children[1] = createAST(input->children[5], input);
-		return op;
-	}
-	else if (input->productionNumber == 73)
-	{
-		// <booleanExpression> ===> <var>1 <relationalOp> <var>2
-
-		ASTNode* op = createAST(input->children[1], input);
-		op->children.resize(2);
-		op->children[0] = createAST(input->children[0], input);
-		op->children[1] = createAST(input->children[2], input);
-		return op;
-	}
-	else if (input->productionNumber == 74)
-	{
-		// <booleanExpression> ===> TK_NOT TK_OP <booleanExpression> TK_CL
-
-		ASTNode* op = createAST(input->children[0], input);
-		op->children.resize(1);
-		op->children[0] = createAST(input->children[2], input);
-		return op;
+		assert(false);
 	}
 	else if (input->productionNumber == 75)
 	{
@@ -722,53 +693,11 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 
 		return createAST(input->children[0], input);
 	}
-	else if (input->productionNumber == 78)
-	{
-		// <logicalOp> ===> TK_AND
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 79)
-	{
-		//  <logicalOp> ===> TK_OR
-
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 80)
+	else if (input->productionNumber >= 78 && input->productionNumber <= 85)
 	{
-		// <relationalOp> ===> TK_LT
+		// <logicalOp> and <relationalOp> only occur inside <booleanExpression>
 
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 81)
-	{
-		// <relationalOp> ===> TK_LE
-		
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 82)
-	{
-		// <relationalOp> ===> TK_EQ
-		
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 83)
-	{
-		// <relationalOp> ===> TK_GT
-		
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 84)
-	{
-		// <relationalOp> ===> TK_GE
-		
-		return createAST(input->children[0], input);
-	}
-	else if (input->productionNumber == 85)
-	{
-		// <relationalOp> ===> TK_NE
-		
-		return createAST(input->children[0], input);
+		assert(false);
 	}
 	else if (input->productionNumber == 86)
 	{
@@ -835,5 +764,8 @@ ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* parent, ASTN
 		return nullptr;
 	}
 
+	if (node && node->line_number == 0)
+		node->line_number = firstLineNumber(input);
+
 	return node;
 }
\ No newline at end of file
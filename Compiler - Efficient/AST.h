@@ -2,6 +2,27 @@
 #include "Parser.h"
 #include <vector>
 
+struct TypeLog;
+class FuncEntry;
+
+// where a variable lives; inputs, outputs and locals all sit in the frame of their function
+enum class Storage
+{
+	NONE,
+	GLOBAL,
+	PARAM,
+	RETURN,
+	LOCAL
+};
+
+// resolved storage of an identifier use, filled in by the binding pass
+struct Location
+{
+	Storage storage = Storage::NONE;
+	int slot = -1;		// variable number within its storage class
+	int offset = 0;		// bytes from the start of the frame or of the global area, fields included
+};
+
 enum class NonTerminalType
 {
 	PROGRAM,
@@ -20,6 +41,7 @@ enum class NonTerminalType
 	WRITE,
 	OPERATOR,
 	DEFINETYPE,
+	NUM,
 
 	GENERAL
 };
@@ -29,6 +51,8 @@ struct ASTNode
 	const NonTerminalType type;
 	std::vector<ASTNode*> children;
 	ASTNode* sibling;
+	int line_number = 0;
+	TypeLog* derived_type = nullptr;
 
 	ASTNode(NonTerminalType type, ASTNode* sibling = nullptr) : type{ type }, sibling {sibling}
 	{
@@ -39,6 +63,7 @@ struct ASTNode
 struct FuncNode : public ASTNode
 {
 	std::string Name;
+	FuncEntry* entry = nullptr;
 
 	FuncNode(const std::string& token);
 };
@@ -46,14 +71,22 @@ struct FuncNode : public ASTNode
 struct ParameterNode : public ASTNode
 {
 	std::string varName;
+	int symbol;
 	ASTNode* varType;
 
 	ParameterNode(const std::string&, ASTNode*);
 };
 
+// Identifiers are interned once while the AST is built; the semantic phases key their tables by the id
+int internSymbol(const std::string&);
+int findSymbol(const std::string&);
+const std::string& symbolName(int);
+
 struct IDNode : public ASTNode
 {
 	std::string varName;
+	int symbol;
+	Location location;	// variables only, field names and type names stay unbound
 
 	IDNode(const std::string&);
 };
@@ -83,6 +116,7 @@ struct DefineTypeNode : public ASTNode
 struct FieldDefinitionNode : public ASTNode
 {
 	std::string varName;
+	int symbol;
 	ASTNode* varType;
 
 	FieldDefinitionNode(const std::string&, ASTNode*);
@@ -92,6 +126,7 @@ struct VariableDefinitionNode : public ASTNode
 {
 	bool isGlobal;
 	std::string varName;
+	int symbol;
 	ASTNode* varType;
 
 	VariableDefinitionNode(bool, const std::string&, ASTNode*);
@@ -107,6 +142,7 @@ struct AssignmentNode : public ASTNode
 struct FunctionCallNode : public ASTNode
 {
 	std::string name;
+	FuncEntry* callee = nullptr;
 
 	FunctionCallNode(const std::string &name) : ASTNode(NonTerminalType::FUNCTIONCALL)
 	{
@@ -138,10 +174,27 @@ struct OperatorNode : ASTNode
 {
 	TokenType op;
 
+	// TK_DOT only: byte offset of the accessed field from the start of the variable at the root of the chain
+	int offset = 0;
+	Location location;
+
 	OperatorNode(TokenType op) : ASTNode(NonTerminalType::OPERATOR)
 	{
 		this->op = op;
 	}
 };
 
+struct NumNode : public ASTNode
+{
+	bool isReal;
+	std::string lexeme;
+
+	NumNode(bool isReal, const std::string& lexeme) : ASTNode(NonTerminalType::NUM)
+	{
+		this->isReal = isReal;
+		this->lexeme = lexeme;
+	}
+};
+
+ASTNode* createLeaf(const Token*);
 ASTNode* createAST(const ParseTreeNode* input, const ParseTreeNode* = nullptr, ASTNode* = nullptr);
\ No newline at end of file
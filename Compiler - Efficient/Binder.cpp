@@ -0,0 +1,118 @@
+#include "Binder.h"
+#include <cassert>
+using namespace std;
+
+int globalDataSize = 0;
+
+// Slots and aligned offsets, in declaration order, for the variables of one storage class.
+// Returns the end of the area they take.
+int layoutVariables(const vector<VariableEntry*>& variables, Storage storage, int offset)
+{
+    int slot = 0;
+
+    for (auto var : variables)
+    {
+        if (var->storage != storage)
+            continue;
+
+        var->slot = slot++;
+        var->offset = roundUp(offset, var->type->align);
+        offset = var->offset + var->type->width;
+    }
+
+    return offset;
+}
+
+void layoutFrame(FuncEntry* func)
+{
+    // each area starts on the widest alignment, so its offsets hold for any frame address that does
+    func->outputOffset = roundUp(layoutVariables(func->variables, Storage::PARAM, 0), 4);
+    func->localOffset = roundUp(layoutVariables(func->variables, Storage::RETURN, func->outputOffset), 4);
+    func->frameSize = roundUp(layoutVariables(func->variables, Storage::LOCAL, func->localOffset), 4);
+}
+
+Location locate(const SymbolTable& scope, int symbol)
+{
+    TypeLog* log = scope.lookup(symbol);
+    assert(log && log->entryType == TypeTag::VARIABLE);
+
+    VariableEntry* var = log->variable();
+    return { var->storage, var->slot, var->offset };
+}
+
+void bind(ASTNode* node, const SymbolTable& scope)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::ID)
+        {
+            IDNode* id = static_cast<IDNode*>(node);
+            id->location = locate(scope, id->symbol);
+            continue;
+        }
+
+        if (node->type == NonTerminalType::OPERATOR && static_cast<OperatorNode*>(node)->op == TokenType::TK_DOT)
+        {
+            // <dot> ===> <left> TK_DOT <field>, the field name itself is no variable
+            OperatorNode* dot = static_cast<OperatorNode*>(node);
+            const ASTNode* root = dot;
+
+            while (root->type == NonTerminalType::OPERATOR)
+                root = root->children[0];
+
+            dot->location = locate(scope, static_cast<const IDNode*>(root)->symbol);
+            dot->location.offset += dot->offset;
+
+            bind(dot->children[0], scope);
+            continue;
+        }
+
+        if (node->type == NonTerminalType::STMTS)
+        {
+            // stmts -> .. .. stmt return
+            bind(node->children[2], scope);
+            bind(node->children[3], scope);
+            continue;
+        }
+
+        if (node->type == NonTerminalType::ASSIGNMENT)
+            bind(static_cast<AssignmentNode*>(node)->target, scope);
+        else if (node->type == NonTerminalType::READ)
+            bind(static_cast<ReadNode*>(node)->target, scope);
+        else if (node->type == NonTerminalType::WRITE)
+            bind(static_cast<WriteNode*>(node)->target, scope);
+        else if (node->type == NonTerminalType::FUNCTIONCALL)
+        {
+            FunctionCallNode* call = static_cast<FunctionCallNode*>(node);
+            call->callee = globalSymbolTable.lookup(call->name)->function();
+        }
+
+        for (auto child : node->children)
+            bind(child, scope);
+    }
+}
+
+void bindNames(ASTNode* program)
+{
+    // program -> functions, main
+
+    globalDataSize = roundUp(layoutVariables(globalVariables, Storage::GLOBAL, 0), 4);
+
+    vector<ASTNode*> functions;
+
+    for (auto func = program->children[0]; func; func = func->sibling)
+        functions.push_back(func);
+
+    functions.push_back(program->children[1]);
+
+    for (size_t i = 0; i < functions.size(); ++i)
+    {
+        ASTNode* node = functions[i];
+        FuncNode* func = static_cast<FuncNode*>(node);
+        func->entry = globalSymbolTable.lookup(func->Name)->function();
+        func->entry->order = (int)i;
+
+        layoutFrame(func->entry);
+        bind(node->children[2], func->entry->symbolTable);
+    }
+}
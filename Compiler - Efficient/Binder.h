@@ -0,0 +1,9 @@
+#pragma once
+#include "SymbolTable.h"
+
+extern int globalDataSize;
+
+// Lays out the global area and the frame of every function, then resolves each variable
+// use in the function bodies to a Location and each call to its FuncEntry. Needs a program
+// that passed checkFunctions; later phases read locations and never look names up again.
+void bindNames(ASTNode* program);
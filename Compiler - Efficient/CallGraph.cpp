@@ -0,0 +1,108 @@
+#include "CallGraph.h"
+#include "SymbolTable.h"
+#include <algorithm>
+using namespace std;
+
+void collectCalls(const ASTNode* node, vector<int>& callees)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::FUNCTIONCALL)
+            callees.push_back(static_cast<const FunctionCallNode*>(node)->callee->order);
+
+        for (auto child : node->children)
+            collectCalls(child, callees);
+    }
+}
+
+// Tarjan's algorithm: a component is complete when the search leaves its first function
+struct Components
+{
+    CallGraph& graph;
+    vector<int> index, low, stack;
+    vector<bool> onStack;
+    int visited = 0;
+
+    explicit Components(CallGraph& graph)
+        : graph(graph), index(graph.callees.size(), -1), low(graph.callees.size()), onStack(graph.callees.size())
+    {
+    }
+
+    void visit(int fn)
+    {
+        index[fn] = low[fn] = visited++;
+        stack.push_back(fn);
+        onStack[fn] = true;
+
+        for (int callee : graph.callees[fn])
+        {
+            if (index[callee] < 0)
+            {
+                visit(callee);
+                low[fn] = min(low[fn], low[callee]);
+            }
+            else if (onStack[callee])
+                low[fn] = min(low[fn], index[callee]);
+        }
+
+        if (low[fn] != index[fn])
+            return;
+
+        vector<int> members;
+        int member;
+
+        do
+        {
+            member = stack.back();
+            stack.pop_back();
+            onStack[member] = false;
+            graph.component[member] = (int)graph.components.size();
+            members.push_back(member);
+        } while (member != fn);
+
+        graph.components.push_back(members);
+    }
+};
+
+CallGraph buildCallGraph(const ASTNode* program)
+{
+    // program -> functions, main
+
+    vector<const ASTNode*> functions;
+
+    for (auto func = program->children[0]; func; func = func->sibling)
+        functions.push_back(func);
+
+    functions.push_back(program->children[1]);
+
+    CallGraph graph;
+    int count = (int)functions.size();
+    graph.callees.resize(count);
+    graph.callSites.resize(count);
+    graph.component.resize(count);
+    graph.recursive.resize(count);
+
+    for (auto node : functions)
+    {
+        int fn = static_cast<const FuncNode*>(node)->entry->order;
+        collectCalls(node->children[2], graph.callees[fn]);
+
+        for (int callee : graph.callees[fn])
+            ++graph.callSites[callee];
+    }
+
+    Components tarjan(graph);
+
+    for (int fn = 0; fn < count; ++fn)
+        if (tarjan.index[fn] < 0)
+            tarjan.visit(fn);
+
+    for (int fn = 0; fn < count; ++fn)
+    {
+        auto& callees = graph.callees[fn];
+        graph.recursive[fn] = graph.components[graph.component[fn]].size() > 1
+            || find(callees.begin(), callees.end(), fn) != callees.end();
+    }
+
+    return graph;
+}
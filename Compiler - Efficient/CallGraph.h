@@ -0,0 +1,16 @@
+#pragma once
+#include "AST.h"
+#include <vector>
+
+// Who calls whom, read off the FunctionCallNodes of a bound program. Functions are numbered
+// by FuncEntry::order, the same numbering as IRModule::functions.
+struct CallGraph
+{
+    std::vector<std::vector<int>> callees;      // one entry per call site, a callee may repeat
+    std::vector<int> callSites;                 // how many calls name each function
+    std::vector<int> component;                 // strongly connected component of each function
+    std::vector<std::vector<int>> components;   // Tarjan's order: a callee's before its callers'
+    std::vector<bool> recursive;                // calls itself, directly or around a cycle
+};
+
+CallGraph buildCallGraph(const ASTNode* program);
@@ -0,0 +1,792 @@
+#include "CodeGenerator.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+using namespace std;
+
+// a scalar piece of a value: where it sits relative to the start of the value, and its type
+struct Leaf
+{
+    int offset;
+    IRType type;
+};
+
+// Records flatten to their scalar fields in declaration order. A union is moved as the
+// raw 2 byte chunks covering its width, which keeps whichever member was stored intact.
+void leaves(const TypeLog* type, int offset, vector<Leaf>& out)
+{
+    if (type->entryType == TypeTag::INT)
+        out.push_back({ offset, IRType::INT });
+    else if (type->entryType == TypeTag::REAL)
+        out.push_back({ offset, IRType::REAL });
+    else if (type->entryType == TypeTag::DERIVED)
+    {
+        const DerivedEntry* record = type->derived();
+
+        if (record->isUnion)
+        {
+            for (int at = 0; at < type->width; at += 2)
+                out.push_back({ offset + at, IRType::INT });
+        }
+        else
+        {
+            for (auto& field : record->fields)
+                leaves(field.type, offset + field.offset, out);
+        }
+    }
+}
+
+// a record or run of fields narrower than this is not worth a vector instruction, and one
+// at least this wide goes to and comes back from a call by reference; an operand needing
+// as many registers as the native backend hands out for ints has none to spare
+enum { VECTOR_BYTES = 16, REFERENCE_BYTES = 16, EXPRESSION_REGISTERS = 10 };
+
+bool byReference(const TypeLog* type)
+{
+    return type->entryType == TypeTag::DERIVED && type->width >= REFERENCE_BYTES;
+}
+
+// consecutive leaves of one type with no gap between them, which V instructions take at once
+struct Lanes
+{
+    int offset;
+    IRType type;
+    int count;
+};
+
+IRType scalarType(const TypeLog* type)
+{
+    return type->entryType == TypeTag::REAL ? IRType::REAL : type->entryType == TypeTag::BOOL ? IRType::BOOL : IRType::INT;
+}
+
+const Location& locationOf(const ASTNode* node)
+{
+    if (node->type == NonTerminalType::ID)
+        return static_cast<const IDNode*>(node)->location;
+
+    return static_cast<const OperatorNode*>(node)->location;
+}
+
+int areaOf(Storage storage)
+{
+    return storage == Storage::GLOBAL ? AREA_GLOBAL : AREA_FRAME;
+}
+
+bool isVariable(const ASTNode* node)
+{
+    return node->type == NonTerminalType::ID || (node->type == NonTerminalType::OPERATOR && static_cast<const OperatorNode*>(node)->op == TokenType::TK_DOT);
+}
+
+Opcode opcodeOf(TokenType op)
+{
+    switch (op)
+    {
+    case TokenType::TK_PLUS: return Opcode::ADD;
+    case TokenType::TK_MINUS: return Opcode::SUB;
+    case TokenType::TK_MUL: return Opcode::MUL;
+    case TokenType::TK_DIV: return Opcode::DIV;
+    case TokenType::TK_LT: return Opcode::LT;
+    case TokenType::TK_LE: return Opcode::LE;
+    case TokenType::TK_EQ: return Opcode::EQ;
+    case TokenType::TK_GT: return Opcode::GT;
+    case TokenType::TK_GE: return Opcode::GE;
+    case TokenType::TK_NE: return Opcode::NE;
+    default: return Opcode::NOT;
+    }
+}
+
+struct Lowering
+{
+    IRFunction& fn;
+    int block;
+    vector<pair<int, int>> scratch{};     // frame (offset, bytes) for partial record results, per nesting depth
+    vector<pair<int, int>> references{};  // per input: the REF register it came by and its offset, -1 if it is in the frame
+    unordered_map<const ASTNode*, int> needs{};
+
+    void emit(Opcode op, IRType type, int dst, int a, int b = -1, int c = -1)
+    {
+        fn.blocks[block].code.push_back({ op, type, dst, a, b, c });
+    }
+
+    int def(Opcode op, IRType type, IRType result, int a, int b = -1)
+    {
+        int dst = fn.newReg(result);
+        emit(op, type, dst, a, b);
+        return dst;
+    }
+
+    void jump(int target)
+    {
+        emit(Opcode::JUMP, IRType::VOID, -1, target);
+    }
+
+    // the input a variable belongs to when that was passed by reference, else null
+    const pair<int, int>* referenceOf(const ASTNode* var) const
+    {
+        const Location& location = locationOf(var);
+        if (location.storage != Storage::PARAM || references[location.slot].first < 0)
+            return nullptr;
+        return &references[location.slot];
+    }
+
+    // one leaf of a variable, from the frame, the globals or through its reference
+    int load(const ASTNode* var, const Leaf& part)
+    {
+        const Location& location = locationOf(var);
+
+        if (auto reference = referenceOf(var))
+            return def(Opcode::LOADREF, part.type, part.type, reference->first, location.offset - reference->second + part.offset);
+
+        return def(Opcode::LOAD, part.type, part.type, areaOf(location.storage), location.offset + part.offset);
+    }
+
+    int temporary(int bytes)
+    {
+        fn.frameSize = roundUp(fn.frameSize, 4);
+        int at = fn.frameSize;
+        fn.frameSize += bytes;
+        return at;
+    }
+
+    // A record argument's reference: an input that came by one passes it on, a variable in
+    // the frame its address, which passed notes, and a global a copy made for the call.
+    int referenceTo(const ASTNode* var, vector<pair<int, int>>& passed)
+    {
+        if (auto reference = referenceOf(var))
+            return reference->first;
+
+        const Location& location = locationOf(var);
+        int bytes = var->derived_type->width;
+        int at = location.offset;
+
+        if (location.storage == Storage::GLOBAL)
+        {
+            at = temporary(bytes);
+            emit(Opcode::VCOPY, IRType::INT, -1, address(AREA_FRAME, at), addressOf(var, 0), bytes / width(IRType::INT));
+        }
+        else
+            passed.push_back({ at, at + bytes });
+
+        return def(Opcode::ADDR, IRType::REF, IRType::REF, at, bytes);
+    }
+
+    int constant(const NumNode* num)
+    {
+        if (!num->isReal)
+            return def(Opcode::CONST, IRType::INT, IRType::INT, (int16_t)strtol(num->lexeme.c_str(), nullptr, 10));
+
+        float value = strtof(num->lexeme.c_str(), nullptr);
+        int bits;
+        memcpy(&bits, &value, sizeof bits);
+
+        return def(Opcode::CONST, IRType::REAL, IRType::REAL, bits);
+    }
+
+    // <var> or an arithmetic expression, one register per leaf
+    void value(const ASTNode* node, vector<int>& regs)
+    {
+        if (node->type == NonTerminalType::NUM)
+        {
+            regs.push_back(constant(static_cast<const NumNode*>(node)));
+            return;
+        }
+
+        if (isVariable(node))
+        {
+            vector<Leaf> parts;
+            leaves(node->derived_type, 0, parts);
+
+            for (auto& part : parts)
+                regs.push_back(load(node, part));
+            return;
+        }
+
+        TokenType op = static_cast<const OperatorNode*>(node)->op;
+
+        if (op == TokenType::TK_DIV)
+        {
+            // division is always real
+            auto both = operands(node, [this](const ASTNode* side) { return toReal(side); });
+            regs.push_back(def(Opcode::DIV, IRType::REAL, IRType::REAL, both.first, both.second));
+            return;
+        }
+
+        vector<Leaf> parts;
+        leaves(node->derived_type, 0, parts);
+
+        if (parts.size() == 1)
+        {
+            auto both = operands(node, [this](const ASTNode* side) { return scalar(side); });
+            regs.push_back(def(opcodeOf(op), parts[0].type, parts[0].type, both.first, both.second));
+            return;
+        }
+
+        // + and - also work field by field on records of the same type
+        vector<int> left, right;
+
+        if (need(node->children[1]) > need(node->children[0]))
+        {
+            value(node->children[1], right);
+            value(node->children[0], left);
+        }
+        else
+        {
+            value(node->children[0], left);
+            value(node->children[1], right);
+        }
+
+        for (size_t i = 0; i < parts.size(); ++i)
+            regs.push_back(def(opcodeOf(op), parts[i].type, parts[i].type, left[i], right[i]));
+    }
+
+    // Registers an expression takes to compute without spilling (Sethi & Ullman): one for a
+    // variable or number, a record counted as one of its fields, which all go the same way.
+    // Evaluating the operand that takes more first, the other is computed with one register
+    // fewer, so an operator takes one more than its operands only when they take the same.
+    int need(const ASTNode* node)
+    {
+        if (node->type == NonTerminalType::NUM || isVariable(node))
+            return 1;
+
+        auto found = needs.find(node);
+        if (found != needs.end())
+            return found->second;
+
+        int left = need(node->children[0]);
+        int right = need(node->children[1]);
+
+        return needs[node] = left == right ? left + 1 : max(left, right);
+    }
+
+    // The scalar operands of a binary operator, each through evaluate, the one that takes
+    // more registers first. When the second takes every register there is by itself, the
+    // first waits in the frame meanwhile instead of being spilled at some point in it.
+    template <typename Evaluate>
+    pair<int, int> operands(const ASTNode* node, Evaluate evaluate)
+    {
+        const ASTNode* first = node->children[0];
+        const ASTNode* second = node->children[1];
+        bool swapped = need(second) > need(first);
+
+        if (swapped)
+            swap(first, second);
+
+        int value = evaluate(first);
+        IRType type = fn.regs[value];
+        int parked = -1;
+
+        if (need(second) >= EXPRESSION_REGISTERS)
+        {
+            parked = temporary(width(type));
+            emit(Opcode::STORE, type, -1, AREA_FRAME, parked, value);
+        }
+
+        int other = evaluate(second);
+
+        if (parked >= 0)
+            value = def(Opcode::LOAD, type, type, AREA_FRAME, parked);
+
+        return swapped ? make_pair(other, value) : make_pair(value, other);
+    }
+
+    int scalar(const ASTNode* node)
+    {
+        vector<int> regs;
+        value(node, regs);
+        assert(regs.size() == 1);
+        return regs[0];
+    }
+
+    int toReal(const ASTNode* node)
+    {
+        int reg = scalar(node);
+        return fn.regs[reg] == IRType::REAL ? reg : def(Opcode::ITOF, IRType::REAL, IRType::REAL, reg);
+    }
+
+    // <booleanExpression> as control flow, ending the current block: only comparisons are
+    // values, each branched on at once. ~ swaps the targets, and the right operand of &&&
+    // and @@@ gets a block of its own that the left one skips when it decides the outcome.
+    void branchOn(const ASTNode* node, int onTrue, int onFalse)
+    {
+        TokenType op = static_cast<const OperatorNode*>(node)->op;
+
+        if (op == TokenType::TK_NOT)
+        {
+            branchOn(node->children[0], onFalse, onTrue);
+            return;
+        }
+
+        if (op == TokenType::TK_AND || op == TokenType::TK_OR)
+        {
+            int right = fn.newBlock();
+
+            if (op == TokenType::TK_AND)
+                branchOn(node->children[0], right, onFalse);
+            else
+                branchOn(node->children[0], onTrue, right);
+
+            block = right;
+            branchOn(node->children[1], onTrue, onFalse);
+            return;
+        }
+
+        auto both = operands(node, [this](const ASTNode* side) { return scalar(side); });
+        int holds = def(opcodeOf(op), scalarType(node->children[0]->derived_type), IRType::BOOL, both.first, both.second);
+
+        emit(Opcode::BRANCH, IRType::VOID, -1, holds, onTrue, onFalse);
+    }
+
+    // a variable's address, offset bytes into it, as V instructions take it
+    int addressOf(const ASTNode* var, int offset)
+    {
+        const Location& location = locationOf(var);
+        return address(areaOf(location.storage), location.offset + offset);
+    }
+
+    int scratchAt(int depth, int bytes)
+    {
+        if (depth == (int)scratch.size())
+            scratch.push_back({ 0, 0 });
+
+        if (scratch[depth].second < bytes)
+        {
+            fn.frameSize = roundUp(fn.frameSize, 4);
+            scratch[depth] = { fn.frameSize, bytes };
+            fn.frameSize += bytes;
+        }
+
+        return address(AREA_FRAME, scratch[depth].first);
+    }
+
+    // whether two variables share any bytes
+    bool overlaps(const ASTNode* var, const ASTNode* other) const
+    {
+        const Location& at = locationOf(var);
+        const Location& to = locationOf(other);
+
+        return areaOf(at.storage) == areaOf(to.storage)
+            && at.offset < to.offset + other->derived_type->width && to.offset < at.offset + var->derived_type->width;
+    }
+
+    // whether an operand other than the leftmost overlaps the bytes at target
+    bool readsLate(const ASTNode* node, const ASTNode* target, bool leftmost)
+    {
+        if (!isVariable(node))
+            return readsLate(node->children[0], target, leftmost) || readsLate(node->children[1], target, false);
+
+        return !leftmost && overlaps(node, target);
+    }
+
+    // one leaf of a record + / - tree, computed in registers
+    int leafValue(const ASTNode* node, const Leaf& part)
+    {
+        if (isVariable(node))
+            return load(node, part);
+
+        auto both = operands(node, [&](const ASTNode* side) { return leafValue(side, part); });
+        return def(opcodeOf(static_cast<const OperatorNode*>(node)->op), part.type, part.type, both.first, both.second);
+    }
+
+    // a record + / - tree into memory at to, the lanes of run only: the left operand is
+    // evaluated in place, every other one that is not a variable in scratch one level deeper
+    void lanes(const ASTNode* node, int to, const Lanes& run, int depth)
+    {
+        if (isVariable(node))
+        {
+            int from = addressOf(node, run.offset);
+            if (from != to)
+                emit(Opcode::VCOPY, run.type, -1, to, from, run.count);
+            return;
+        }
+
+        const ASTNode* right = node->children[1];
+        lanes(node->children[0], to, run, depth);
+
+        int from;
+        if (isVariable(right))
+            from = addressOf(right, run.offset);
+        else
+        {
+            from = scratchAt(depth, run.count * width(run.type));
+            lanes(right, from, run, depth + 1);
+        }
+
+        emit(static_cast<const OperatorNode*>(node)->op == TokenType::TK_PLUS ? Opcode::VADD : Opcode::VSUB, run.type, -1, to, from, run.count);
+    }
+
+    // A record assignment works on memory. A copy moves the whole width, padding included,
+    // as 2 byte lanes; + and - go over each run of same typed fields laid out back to back,
+    // which the backends do several lanes per vector instruction. Anything too short to
+    // fill one stays scalar.
+    void assignRecord(const ASTNode* target, const ASTNode* expr)
+    {
+        if (isVariable(expr) && target->derived_type->width >= VECTOR_BYTES)
+        {
+            int from = addressOf(expr, 0), to = addressOf(target, 0);
+            if (from != to)
+                emit(Opcode::VCOPY, IRType::INT, -1, to, from, target->derived_type->width / width(IRType::INT));
+            return;
+        }
+
+        const Location& location = locationOf(target);
+        vector<Leaf> parts;
+        leaves(target->derived_type, 0, parts);
+
+        bool aliased = readsLate(expr, target, true);
+
+        for (size_t i = 0, j; i < parts.size(); i = j)
+        {
+            for (j = i + 1; j < parts.size() && parts[j].type == parts[i].type && parts[j].offset == parts[j - 1].offset + width(parts[i].type); ++j)
+                ;
+
+            Lanes run{ parts[i].offset, parts[i].type, (int)(j - i) };
+
+            if (run.count * width(run.type) < VECTOR_BYTES)
+            {
+                for (size_t k = i; k < j; ++k)
+                    emit(Opcode::STORE, parts[k].type, -1, areaOf(location.storage), location.offset + parts[k].offset, leafValue(expr, parts[k]));
+            }
+            else if (aliased)
+            {
+                // the target is read after it has been written: build the result aside
+                int temp = scratchAt(0, run.count * width(run.type));
+                lanes(expr, temp, run, 1);
+                emit(Opcode::VCOPY, run.type, -1, addressOf(target, run.offset), temp, run.count);
+            }
+            else
+                lanes(expr, addressOf(target, run.offset), run, 0);
+        }
+    }
+
+    void store(const ASTNode* target, const vector<int>& regs, size_t first = 0)
+    {
+        const Location& location = locationOf(target);
+        vector<Leaf> parts;
+        leaves(target->derived_type, location.offset, parts);
+
+        for (size_t i = 0; i < parts.size(); ++i)
+            emit(Opcode::STORE, parts[i].type, -1, areaOf(location.storage), parts[i].offset, regs[first + i]);
+    }
+
+    void statements(const ASTNode* node)
+    {
+        for (; node; node = node->sibling)
+        {
+            if (node->type == NonTerminalType::ASSIGNMENT)
+            {
+                // <assignmentStmt> ===> <singleOrRecId> TK_ASSIGNOP <arithmeticExpression>
+                const ASTNode* target = static_cast<const AssignmentNode*>(node)->target;
+
+                if (target->derived_type->entryType == TypeTag::DERIVED)
+                {
+                    assignRecord(target, node->children[0]);
+                    continue;
+                }
+
+                vector<int> regs;
+                value(node->children[0], regs);
+                store(target, regs);
+            }
+            else if (node->type == NonTerminalType::READ)
+            {
+                const ASTNode* target = static_cast<const ReadNode*>(node)->target;
+                vector<Leaf> parts;
+                vector<int> regs;
+                leaves(target->derived_type, 0, parts);
+
+                for (auto& part : parts)
+                    regs.push_back(def(Opcode::READ, part.type, part.type, -1));
+
+                store(target, regs);
+            }
+            else if (node->type == NonTerminalType::WRITE)
+            {
+                const ASTNode* target = static_cast<const WriteNode*>(node)->target;
+                vector<Leaf> parts;
+                vector<int> regs;
+                leaves(target->derived_type, 0, parts);
+                value(target, regs);
+
+                for (size_t i = 0; i < parts.size(); ++i)
+                    emit(Opcode::WRITE, parts[i].type, -1, regs[i]);
+            }
+            else if (node->type == NonTerminalType::FUNCTIONCALL)
+            {
+                // <funCallStmt> ===> <outputParameters> TK_CALL TK_FUNID TK_WITH TK_PARAMETERS <inputParameters>
+                const FunctionCallNode* call = static_cast<const FunctionCallNode*>(node);
+                const FuncEntry* callee = call->callee;
+                vector<int> args, results;
+                vector<pair<int, int>> passed;
+                size_t i = 0;
+
+                for (auto in = node->children[1]; in; in = in->sibling, ++i)
+                {
+                    if (byReference(callee->argTypes[i].second))
+                        args.push_back(referenceTo(in, passed));
+                    else
+                        value(in, args);
+                }
+
+                // A wide output gets a reference after the inputs, which the callee writes
+                // through as it returns: to the target itself, unless that is global or the
+                // callee might still read it through another reference, else to a temporary
+                // copied over after the call.
+                vector<pair<const ASTNode*, int>> copies;
+                i = 0;
+
+                for (auto out = node->children[0]; out; out = out->sibling, ++i)
+                {
+                    vector<Leaf> parts;
+                    leaves(out->derived_type, 0, parts);
+
+                    if (!byReference(callee->retTypes[i].second))
+                    {
+                        for (auto& part : parts)
+                            results.push_back(fn.newReg(part.type));
+                        continue;
+                    }
+
+                    const Location& location = locationOf(out);
+                    int bytes = out->derived_type->width;
+                    bool direct = location.storage != Storage::GLOBAL;
+
+                    for (auto& range : passed)
+                        direct &= !(range.first < location.offset + bytes && location.offset < range.second);
+
+                    for (auto other = node->children[0]; other; other = other->sibling)
+                        direct &= other == out || !overlaps(other, out);
+
+                    int at = direct ? location.offset : temporary(bytes);
+                    if (!direct)
+                        copies.push_back({ out, at });
+
+                    args.push_back(def(Opcode::ADDR, IRType::REF, IRType::REF, at, bytes));
+                }
+
+                emit(Opcode::CALL, IRType::VOID, -1, callee->order, fn.newList(args), fn.newList(results));
+
+                size_t first = 0;
+                i = 0;
+                for (auto out = node->children[0]; out; out = out->sibling, ++i)
+                {
+                    if (byReference(callee->retTypes[i].second))
+                        continue;
+
+                    store(out, results, first);
+
+                    vector<Leaf> parts;
+                    leaves(out->derived_type, 0, parts);
+                    first += parts.size();
+                }
+
+                for (auto& copy : copies)
+                    emit(Opcode::VCOPY, IRType::INT, -1, addressOf(copy.first, 0), address(AREA_FRAME, copy.second), copy.first->derived_type->width / width(IRType::INT));
+            }
+            else if (node->type == NonTerminalType::ITERATIVE)
+            {
+                // while (cond) body endwhile: header tests, body jumps back
+                int header = fn.newBlock();
+                int body = fn.newBlock();
+                int exit = fn.newBlock();
+
+                jump(header);
+                block = header;
+                branchOn(node->children[0], body, exit);
+
+                block = body;
+                statements(node->children[1]);
+                jump(header);
+
+                block = exit;
+            }
+            else if (node->type == NonTerminalType::CONDITIONAL)
+            {
+                int then = fn.newBlock();
+                int otherwise = node->children[2] ? fn.newBlock() : -1;
+                int join = fn.newBlock();
+
+                branchOn(node->children[0], then, otherwise >= 0 ? otherwise : join);
+
+                block = then;
+                statements(node->children[1]);
+                jump(join);
+
+                if (otherwise >= 0)
+                {
+                    block = otherwise;
+                    statements(node->children[2]);
+                    jump(join);
+                }
+
+                block = join;
+            }
+        }
+    }
+};
+
+void markInput(const ASTNode* var, vector<bool>& copied)
+{
+    const Location& location = locationOf(var);
+    if (location.storage == Storage::PARAM)
+        copied[location.slot] = true;
+}
+
+void markInputs(const ASTNode* expr, vector<bool>& copied)
+{
+    if (isVariable(expr))
+        markInput(expr, copied);
+    else if (expr->type == NonTerminalType::OPERATOR)
+        for (auto child : expr->children)
+            if (child)
+                markInputs(child, copied);
+}
+
+// Inputs a function cannot use through a reference, by slot: those it writes, and those
+// a record assignment reads, which works on frame addresses.
+void copiedInputs(const ASTNode* node, vector<bool>& copied)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::ASSIGNMENT)
+        {
+            const ASTNode* target = static_cast<const AssignmentNode*>(node)->target;
+            markInput(target, copied);
+
+            if (target->derived_type->entryType == TypeTag::DERIVED)
+                markInputs(node->children[0], copied);
+        }
+        else if (node->type == NonTerminalType::READ)
+            markInput(static_cast<const ReadNode*>(node)->target, copied);
+        else if (node->type == NonTerminalType::FUNCTIONCALL)
+        {
+            for (auto out = node->children[0]; out; out = out->sibling)
+                markInput(out, copied);
+        }
+        else if (node->type == NonTerminalType::ITERATIVE || node->type == NonTerminalType::CONDITIONAL)
+        {
+            copiedInputs(node->children[1], copied);
+            if (node->type == NonTerminalType::CONDITIONAL)
+                copiedInputs(node->children[2], copied);
+        }
+    }
+}
+
+IRFunction lowerFunction(const FuncNode* func)
+{
+    IRFunction fn;
+    fn.name = func->Name;
+    fn.entry = func->entry;
+    fn.frameSize = func->entry->frameSize;
+
+    Lowering lowering{ fn, fn.newBlock() };
+
+    // stmts -> typedefs, declarations, stmt chain, return list
+    const ASTNode* stmts = func->children[2];
+    const FuncEntry* entry = func->entry;
+
+    vector<bool> copied(entry->argTypes.size());
+    copiedInputs(stmts->children[2], copied);
+
+    // inputs arrive as one scalar per leaf, in order, and are stored into the input area;
+    // a wide record as a reference, read through unless the function needs it in its frame
+    for (auto var : entry->variables)
+    {
+        if (var->storage != Storage::PARAM)
+            continue;
+
+        vector<Leaf> parts;
+        leaves(var->type, var->offset, parts);
+        lowering.references.push_back({ -1, var->offset });
+
+        if (byReference(var->type))
+        {
+            int reference = lowering.def(Opcode::ARG, IRType::REF, IRType::REF, (int)fn.argTypes.size());
+            fn.argTypes.push_back(IRType::REF);
+
+            if (!copied[var->slot])
+            {
+                lowering.references.back().first = reference;
+                continue;
+            }
+
+            for (auto& part : parts)
+            {
+                int reg = lowering.def(Opcode::LOADREF, part.type, part.type, reference, part.offset - var->offset);
+                lowering.emit(Opcode::STORE, part.type, -1, AREA_FRAME, part.offset, reg);
+            }
+            continue;
+        }
+
+        for (auto& part : parts)
+        {
+            int reg = lowering.def(Opcode::ARG, part.type, part.type, (int)fn.argTypes.size());
+            fn.argTypes.push_back(part.type);
+            lowering.emit(Opcode::STORE, part.type, -1, AREA_FRAME, part.offset, reg);
+        }
+    }
+
+    // then a reference for each wide output, where it is written on return
+    vector<int> outputs;
+    for (auto& output : entry->retTypes)
+    {
+        if (!byReference(output.second))
+            continue;
+
+        outputs.push_back(lowering.def(Opcode::ARG, IRType::REF, IRType::REF, (int)fn.argTypes.size()));
+        fn.argTypes.push_back(IRType::REF);
+    }
+
+    lowering.statements(stmts->children[2]);
+
+    vector<int> results;
+    vector<pair<const ASTNode*, vector<int>>> written;
+    size_t i = 0;
+
+    for (auto ret = stmts->children[3]; ret; ret = ret->sibling, ++i)
+    {
+        if (!byReference(entry->retTypes[i].second))
+        {
+            lowering.value(ret, results);
+            continue;
+        }
+
+        written.push_back({ ret, {} });
+        lowering.value(ret, written.back().second);
+    }
+
+    for (size_t k = 0; k < written.size(); ++k)
+    {
+        vector<Leaf> parts;
+        leaves(written[k].first->derived_type, 0, parts);
+
+        for (size_t j = 0; j < parts.size(); ++j)
+            lowering.emit(Opcode::STOREREF, parts[j].type, -1, outputs[k], parts[j].offset, written[k].second[j]);
+    }
+
+    for (int reg : results)
+        fn.resultTypes.push_back(fn.regs[reg]);
+    lowering.emit(Opcode::RET, IRType::VOID, -1, fn.newList(results));
+
+    // each builds the CFG
+    threadJumps(fn);
+    layoutBlocks(fn);
+    return fn;
+}
+
+IRModule generateIR(ASTNode* program)
+{
+    // program -> functions, main
+
+    IRModule module;
+    module.globalSize = globalDataSize;
+
+    for (auto func = program->children[0]; func; func = func->sibling)
+        module.functions.push_back(lowerFunction(static_cast<FuncNode*>(func)));
+
+    module.functions.push_back(lowerFunction(static_cast<FuncNode*>(program->children[1])));
+    module.mainIndex = (int)module.functions.size() - 1;
+
+    return module;
+}
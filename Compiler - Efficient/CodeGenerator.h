@@ -1 +1,11 @@
 #pragma once
+#include "Binder.h"
+#include "IR.h"
+
+// Lowers a bound program to three-address IR. Variables stay in memory: every use is a
+// LOAD or STORE at its frame or global offset, a record one per leaf field, so records
+// are passed and returned field by field. Records of 16 bytes or more go by reference
+// instead: an input is read through it, or copied in by a callee that writes it, and an
+// output is written through a reference the caller passes after the inputs. Record
+// assignments are VCOPY, VADD and VSUB from memory to memory over runs of fields.
+IRModule generateIR(ASTNode* program);
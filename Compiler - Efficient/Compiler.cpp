@@ -1,9 +1,40 @@
 #include <iostream>
 #include <iomanip>
-#include "AST.h"
+#include <sstream>
+#include <chrono>
+#include <iterator>
+#include <cstdlib>
+#include <cstring>
+#include "TypeChecker.h"
+#include "CodeGenerator.h"
+#include "Optimizer.h"
+#include "VM.h"
+#include "X86Backend.h"
+#include "X86Assembler.h"
+#include "Pruning.h"
 
 using namespace std;
 
+struct Options
+{
+	const char* source = "testcase5.txt";
+	int threads = 1;				// -j N: type check the function bodies on N threads
+	int maxErrors = 0;				// --max-errors N: 0 shows all errors
+	DiagFormat format = DiagFormat::TEXT;	// --format text|json
+	bool prune = false;				// --prune: drop the functions _main never calls, then the globals nothing left uses
+	bool optimize = false;			// -O: run the SSA pass pipeline over the IR
+	bool timePasses = false;		// --time-passes: report each pass's time and instruction count in the trace
+	bool dumpIR = false;			// --dump-ir: print the IR and bytecode into the trace
+	bool run = false;				// --run: execute the program on the VM
+	int benchRuns = 0;				// --bench N: then time N more runs on the same input
+	int jit = -1;					// --jit N: compile functions to machine code once they reach N calls and loop trips
+	const char* assembly = nullptr;	// --emit-asm FILE: write x86-64 assembly
+	const char* object = nullptr;	// --emit-obj FILE: write it assembled, as an ELF64 relocatable object
+	const char* native = nullptr;	// --native FILE: assemble and link an executable
+	bool staticLink = false;		// --static: link it statically, so it runs without any shared library
+	bool checkNative = false;		// --check-native: compare the executable's output with the VM's
+};
+
 void printParseTree(const ParseTreeNode& node)
 {
 	cout << node << endl;
@@ -22,23 +53,250 @@ void cleanParseTree(ParseTreeNode* node)
 	delete node;
 }
 
-int main()
+// Runs the front end over one source file; every error it finds ends up in diagnosticLog.
+// Returns true with the program lowered into module if there were none.
+bool compile(const Options& options, IRModule& module)
 {
-	std::ofstream out("outfile.txt");
-	std::cerr.rdbuf(out.rdbuf());
-
 	loadDFA();
 	loadParser();
 
 	bool b;
 
-	Buffer buffer("testcase5.txt");
+	Buffer buffer(options.source);
 	auto parseNode = parseInputSourceCode(buffer, b);
-	
+
+	if (b)
+	{
+		cleanParseTree(parseNode);
+		return false;
+	}
+
 	auto astNode = createAST(parseNode);
 
 	cleanParseTree(parseNode);
 
 	/*
 	printAST(astNode);*/
-}
\ No newline at end of file
+
+	loadSymbolTable(astNode);
+
+	if (isSymbolError)
+		return false;
+
+	typeChecker_init();
+	checkFunctions(astNode, options.threads);
+
+	if (isSymbolError)
+		return false;
+
+	if (isTypeError)
+	{
+		cerr << "Input source code is semantically incorrect" << endl;
+		return false;
+	}
+
+	cerr << "Input source code is semantically correct." << endl;
+
+	// after checking, so --prune never changes which programs are accepted
+	if (options.prune)
+	{
+		pruneFunctions(astNode);
+		pruneGlobals(astNode);
+	}
+
+	bindNames(astNode);
+
+	module = generateIR(astNode);
+
+	if (options.optimize)
+	{
+		CallGraph calls = buildCallGraph(astNode);
+		PassManager passes = standardPipeline(calls);
+		passes.run(module);
+
+		if (options.timePasses)
+			passes.report(cerr);
+	}
+
+	if (options.dumpIR)
+	{
+		printIR(cerr, module);
+		printBytecode(cerr, assemble(module));
+	}
+
+	return true;
+}
+
+// Input comes from stdin and output goes to stdout. A benchmark reads stdin once and feeds
+// the same input to every timed run, whose output is thrown away.
+bool runProgram(const IRModule& module, const Options& options)
+{
+	Bytecode program = assemble(module);
+
+	if (options.benchRuns <= 0)
+		return execute(program, cin, cout, cerr, options.jit);
+
+	string input((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+	istringstream first(input);
+
+	if (!execute(program, first, cout, cerr, options.jit))
+		return false;
+
+	ostream sink(nullptr);
+	auto start = chrono::steady_clock::now();
+
+	for (int i = 0; i < options.benchRuns; ++i)
+	{
+		istringstream in(input);
+		execute(program, in, sink, cerr, options.jit);
+	}
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cerr << "bench: " << options.benchRuns << " runs in " << fixed << setprecision(1) << elapsed.count() << " ms, "
+		<< setprecision(3) << elapsed.count() / options.benchRuns << " ms per run" << endl;
+
+	return true;
+}
+
+// Assembles the program itself into an ELF object; as never runs
+bool writeObject(const IRModule& module, const string& path)
+{
+	ostringstream assembly;
+	generateAssembly(assembly, module);
+
+	ObjectFile object;
+	if (!assembleObject(assembly.str(), object, cerr))
+		return false;
+
+	ofstream out(path, ios::binary);
+	writeELF(out, object);
+	return true;
+}
+
+// Writes the object next to the executable and links it with the system's C compiler
+bool buildNative(const IRModule& module, const string& executable, bool staticLink)
+{
+	string object = executable + ".o";
+	if (!writeObject(module, object))
+		return false;
+
+	string command = string("cc") + (staticLink ? " -static" : "") + " -o \"" + executable + "\" \"" + object + "\"";
+	if (system(command.c_str()) != 0)
+	{
+		cerr << "Could not link " << object << endl;
+		return false;
+	}
+
+	return true;
+}
+
+// Runs the program on the VM and natively on the same stdin, and reports whether both
+// printed the same thing. The executable and its output are left in outfile.native*.
+bool checkNative(const IRModule& module, bool staticLink)
+{
+	string input((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+	istringstream in(input);
+	ostringstream expected;
+
+	if (!execute(assemble(module), in, expected, cerr) || !buildNative(module, "outfile.native", staticLink))
+		return false;
+
+	ofstream("outfile.native.in") << input;
+
+	if (system("./outfile.native < outfile.native.in > outfile.native.out") != 0)
+	{
+		cerr << "The native program failed" << endl;
+		return false;
+	}
+
+	ifstream produced("outfile.native.out");
+	string actual((istreambuf_iterator<char>(produced)), istreambuf_iterator<char>());
+
+	if (actual != expected.str())
+	{
+		cerr << "Native output differs from the VM's" << endl << "VM:" << endl << expected.str() << "native:" << endl << actual;
+		return false;
+	}
+
+	cout << actual;
+	cerr << "Native output matches the VM" << endl;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	// [source] [-j N] [--format text|json] [--max-errors N] [--reorder-fields] [--prune] [--dump-ir] [--run] [--bench N]
+	//         [--jit N] [-O] [--time-passes] [--emit-asm FILE] [--emit-obj FILE] [--native FILE] [--static] [--check-native]
+	// --reorder-fields lets record layout pick the field order that wastes the least padding
+	Options options;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			options.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc)
+			options.maxErrors = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--reorder-fields") == 0)
+			reorderFields = true;
+		else if (strcmp(argv[i], "--prune") == 0)
+			options.prune = true;
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+			options.format = strcmp(argv[++i], "json") == 0 ? DiagFormat::JSON : DiagFormat::TEXT;
+		else if (strcmp(argv[i], "-O") == 0)
+			options.optimize = true;
+		else if (strcmp(argv[i], "--time-passes") == 0)
+			options.timePasses = true;
+		else if (strcmp(argv[i], "--dump-ir") == 0)
+			options.dumpIR = true;
+		else if (strcmp(argv[i], "--run") == 0)
+			options.run = true;
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+			options.benchRuns = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--jit") == 0 && i + 1 < argc)
+			options.jit = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--emit-asm") == 0 && i + 1 < argc)
+			options.assembly = argv[++i];
+		else if (strcmp(argv[i], "--emit-obj") == 0 && i + 1 < argc)
+			options.object = argv[++i];
+		else if (strcmp(argv[i], "--native") == 0 && i + 1 < argc)
+			options.native = argv[++i];
+		else if (strcmp(argv[i], "--static") == 0)
+			options.staticLink = true;
+		else if (strcmp(argv[i], "--check-native") == 0)
+			options.checkNative = true;
+		else
+			options.source = argv[i];
+	}
+
+	// outfile.txt keeps the parser trace, the diagnostics are rendered once to stdout
+	std::ofstream out("outfile.txt");
+	auto trace = std::cerr.rdbuf(out.rdbuf());
+
+	IRModule module;
+	bool compiled = compile(options, module);
+
+	std::cerr.rdbuf(trace);
+
+	if (diagnosticLog.render(cout, options.format, options.maxErrors, options.source) || !compiled)
+		return 1;
+
+	if (options.assembly)
+	{
+		ofstream out(options.assembly);
+		generateAssembly(out, module);
+	}
+
+	if (options.object && !writeObject(module, options.object))
+		return 1;
+
+	if (options.native && !buildNative(module, options.native, options.staticLink))
+		return 1;
+
+	if (options.checkNative)
+		return checkNative(module, options.staticLink) ? 0 : 1;
+
+	if (options.run || options.benchRuns > 0)
+		return runProgram(module, options) ? 0 : 1;
+
+	return 0;
+}
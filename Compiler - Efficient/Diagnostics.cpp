@@ -0,0 +1,166 @@
+#include "Diagnostics.h"
+#include <algorithm>
+using namespace std;
+
+Diagnostics diagnosticLog;
+
+struct DiagInfo
+{
+    const char* id;
+    const char* format;     // {0}, {1}, .. are the arguments, {line} the first line of the span
+};
+
+// indexed by DiagCode
+const DiagInfo diagInfo[] =
+{
+    { "L001", "Line {line}\t\terror: Identifier length is greater than the prescribed length." },
+    { "L002", "Line {line}\t\terror: Unknwon Symbol <{0}>." },
+    { "L003", "Line {line}\t\terror: Unknwon Pattern <{0}>." },
+
+    { "P001", "Line {line}\t\terror: The token {0} for lexeme {1} does not match with the expected token {2}" },
+    { "P002", "Line {line}\t\terror: Invalid token {0} encountered with value {1} stack top {2}" },
+
+    { "S001", "Line {line}\t\terror: Unknown type {0}" },
+    { "S002", "Line {line}\t\terror: {0} cannot alias both {1} and {2}" },
+    { "S003", "Line {line}\t\terror: Duplicate field {0} in {1}" },
+    { "S004", "Line {line}\t\terror: Recursive definition of {0}: {1}" },
+
+    { "T001", "Assignment with incompatible types at line no. {line}" },
+    { "T002", "Operation {0} {1} {2} with incompatible types at line no. {line}" },
+    { "T003", "Operation {0} {1} with incompatible types at line no. {line}" },
+    { "T004", "Undeclared variable {0} at line no. {line}" },
+    { "T005", "Unknown field {0} in {1} at line no. {line}" },
+    { "T006", "Undefined function {0} at line no. {line}" },
+    { "T007", "Output parameters of call to {0} with incompatible types at line no. {line}" },
+    { "T008", "Input parameters of call to {0} with incompatible types at line no. {line}" },
+    { "T009", "Return values do not match the output parameters of {0} at line no. {line}" },
+
+    { "N001", "{0} more errors not shown" }
+};
+
+string message(const Diagnostic& diag)
+{
+    string text;
+
+    for (const char* c = diagInfo[(int)diag.code].format; *c; ++c)
+    {
+        if (*c != '{')
+        {
+            text += *c;
+            continue;
+        }
+
+        const char* close = c;
+        while (*close != '}')
+            close++;
+
+        string key(c + 1, close);
+
+        if (key == "line")
+            text += to_string(diag.span.line);
+        else
+            text += diag.args[stoi(key)];
+
+        c = close;
+    }
+
+    return text;
+}
+
+string jsonString(const string& s)
+{
+    string out = "\"";
+
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\', out += c;
+        else if (c == '\n')
+            out += "\\n";
+        else if (c == '\t')
+            out += "\\t";
+        else if ((unsigned char)c < 0x20)
+        {
+            const char* hex = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xF];
+            out += hex[c & 0xF];
+        }
+        else
+            out += c;
+    }
+
+    return out + "\"";
+}
+
+void write(ostream& out, const Diagnostic& diag, DiagFormat format, const string& file)
+{
+    if (format == DiagFormat::TEXT)
+    {
+        out << message(diag) << '\n';
+        return;
+    }
+
+    const char* severity = diag.severity == Severity::ERROR ? "error" : diag.severity == Severity::WARNING ? "warning" : "note";
+
+    out << "{";
+    if (!file.empty())
+        out << "\"file\":" << jsonString(file) << ",";
+    out << "\"code\":\"" << diagInfo[(int)diag.code].id << "\",\"severity\":\"" << severity << "\"";
+    out << ",\"span\":{\"line\":" << diag.span.line << ",\"endLine\":" << diag.span.endLine << "}";
+    out << ",\"args\":[";
+    for (size_t i = 0; i < diag.args.size(); ++i)
+        out << (i ? "," : "") << jsonString(diag.args[i]);
+    out << "],\"message\":" << jsonString(message(diag)) << "}\n";
+}
+
+void Diagnostics::merge(vector<Diagnostics>& units)
+{
+    for (auto& unit : units)
+    {
+        for (auto& diag : unit.records)
+            records.push_back(move(diag));
+
+        errors += unit.errors;
+        unit.records.clear();
+        unit.errors = 0;
+    }
+}
+
+int Diagnostics::render(ostream& out, DiagFormat format, int maxErrors, const string& file)
+{
+    stable_sort(records.begin(), records.end(), [](const Diagnostic& a, const Diagnostic& b) { return a.span.line < b.span.line; });
+
+    int shown = 0, distinct = 0;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const Diagnostic& diag = records[i];
+        bool repeated = false;
+
+        // equal records share a line, so only the earlier ones on this line need a look
+        for (size_t j = i; j-- > 0 && records[j].span.line == diag.span.line; )
+            if (records[j].code == diag.code && records[j].args == diag.args)
+                repeated = true;
+
+        if (repeated)
+            continue;
+
+        if (diag.severity == Severity::ERROR)
+            distinct++;
+
+        if (maxErrors > 0 && diag.severity == Severity::ERROR && shown == maxErrors)
+            continue;
+
+        if (diag.severity == Severity::ERROR)
+            shown++;
+
+        write(out, diag, format, file);
+    }
+
+    if (distinct > shown)
+        write(out, { DiagCode::TOO_MANY_ERRORS, Severity::NOTE, { 0, 0 }, { to_string(distinct - shown) } }, format, file);
+
+    out.flush();
+    return distinct;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Every message the compiler can emit. The wording lives in one table in Diagnostics.cpp,
+// a record only carries the code and the pieces that vary.
+enum class DiagCode
+{
+    // lexer
+    IDENTIFIER_TOO_LONG,
+    UNKNOWN_SYMBOL,
+    UNKNOWN_PATTERN,
+
+    // parser
+    TOKEN_MISMATCH,
+    INVALID_TOKEN,
+
+    // symbol table
+    UNKNOWN_TYPE,
+    CONFLICTING_ALIAS,
+    DUPLICATE_FIELD,
+    RECURSIVE_RECORD,
+
+    // type checker
+    INCOMPATIBLE_ASSIGNMENT,
+    INCOMPATIBLE_OPERATION,
+    INCOMPATIBLE_UNARY_OPERATION,
+    UNDECLARED_VARIABLE,
+    UNKNOWN_FIELD,
+    UNDEFINED_FUNCTION,
+    CALL_OUTPUT_MISMATCH,
+    CALL_INPUT_MISMATCH,
+    RETURN_MISMATCH,
+
+    // rendering
+    TOO_MANY_ERRORS
+};
+
+enum class Severity
+{
+    ERROR,
+    WARNING,
+    NOTE
+};
+
+enum class DiagFormat
+{
+    TEXT,
+    JSON
+};
+
+// source lines only, the lexer does not track columns
+struct Span
+{
+    int line;
+    int endLine;
+};
+
+struct Diagnostic
+{
+    DiagCode code;
+    Severity severity;
+    Span span;
+    std::vector<std::string> args;
+};
+
+// Records of one unit of work: the whole compilation, or one function being checked
+// in parallel. Reporting only stores the record; text is produced once, by render().
+class Diagnostics
+{
+    std::vector<Diagnostic> records;
+    int errors = 0;
+
+public:
+    void report(DiagCode code, int line, std::vector<std::string> args = {})
+    {
+        records.push_back({ code, Severity::ERROR, { line, line }, std::move(args) });
+        errors++;
+    }
+
+    bool hasErrors() const
+    {
+        return errors != 0;
+    }
+
+    int errorCount() const
+    {
+        return errors;
+    }
+
+    // moves the records of every unit over here, in unit order
+    void merge(std::vector<Diagnostics>& units);
+
+    // Writes the records sorted by line (ties keep report order) with exact repeats
+    // dropped, and stops after maxErrors errors when maxErrors > 0.
+    // Returns the number of distinct errors.
+    int render(std::ostream& out, DiagFormat format, int maxErrors = 0, const std::string& file = "");
+};
+
+// the compilation's buffer, rendered by the driver once all phases are done
+extern Diagnostics diagnosticLog;
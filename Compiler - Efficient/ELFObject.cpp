@@ -0,0 +1,215 @@
+#include "ELFObject.h"
+#include <algorithm>
+using namespace std;
+
+// section header numbers, in the order they are written
+enum { SH_NULL, SH_TEXT, SH_RELA_TEXT, SH_RODATA, SH_BSS, SH_NOTE_STACK, SH_SYMTAB, SH_STRTAB, SH_SHSTRTAB, SH_COUNT };
+
+const int sectionHeader[SECTION_COUNT] = { SH_TEXT, SH_RODATA, SH_BSS };
+
+enum { SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_RELA = 4, SHT_NOBITS = 8 };
+enum { SHF_WRITE = 1, SHF_ALLOC = 2, SHF_EXECINSTR = 4, SHF_INFO_LINK = 0x40 };
+enum { STB_LOCAL = 0, STB_GLOBAL = 1, STT_NOTYPE = 0, STT_OBJECT = 1, STT_FUNC = 2, STT_SECTION = 3 };
+enum { EHDR_BYTES = 64, SHDR_BYTES = 64, SYM_BYTES = 24, RELA_BYTES = 24 };
+
+// little endian fields appended to a byte buffer
+struct Bytes
+{
+    vector<uint8_t> data;
+
+    void put(uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            data.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    void zeros(size_t count)
+    {
+        data.insert(data.end(), count, 0);
+    }
+
+    void align(size_t to)
+    {
+        zeros((to - data.size() % to) % to);
+    }
+
+    void append(const vector<uint8_t>& bytes)
+    {
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    }
+};
+
+// a string table: offset 0 is the empty string
+struct Strings
+{
+    vector<uint8_t> data{ 0 };
+
+    uint32_t add(const string& text)
+    {
+        if (text.empty())
+            return 0;
+
+        uint32_t at = (uint32_t)data.size();
+        data.insert(data.end(), text.begin(), text.end());
+        data.push_back(0);
+        return at;
+    }
+};
+
+struct SectionHeader
+{
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint64_t flags = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t link = 0;
+    uint32_t info = 0;
+    uint64_t align = 1;
+    uint64_t entrySize = 0;
+};
+
+void writeELF(ostream& out, const ObjectFile& object)
+{
+    Strings names, sectionNames;
+    SectionHeader headers[SH_COUNT];
+
+    const char* const titles[SH_COUNT] = { "", ".text", ".rela.text", ".rodata", ".bss", ".note.GNU-stack", ".symtab", ".strtab", ".shstrtab" };
+    for (int i = 0; i < SH_COUNT; ++i)
+        headers[i].name = sectionNames.add(titles[i]);
+
+    // null, one per section, the locals, then the globals: the order the format requires
+    vector<int> order;
+    for (int pass = 0; pass < 2; ++pass)
+        for (int i = 0; i < (int)object.symbols.size(); ++i)
+            if (object.symbols[i].global == (pass == 1))
+                order.push_back(i);
+
+    vector<int> symbolIndex(object.symbols.size());
+    int firstGlobal = 1 + SECTION_COUNT;
+
+    Bytes symtab;
+    symtab.zeros(SYM_BYTES);
+
+    for (int section = 0; section < SECTION_COUNT; ++section)
+    {
+        symtab.put(0, 4);
+        symtab.put(STB_LOCAL << 4 | STT_SECTION, 1);
+        symtab.put(0, 1);
+        symtab.put(sectionHeader[section], 2);
+        symtab.put(0, 8);
+        symtab.put(0, 8);
+    }
+
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        const ObjectSymbol& symbol = object.symbols[order[k]];
+        int type = symbol.section == SECTION_UNDEFINED ? STT_NOTYPE : symbol.function ? STT_FUNC : STT_OBJECT;
+
+        symbolIndex[order[k]] = 1 + SECTION_COUNT + (int)k;
+        if (!symbol.global)
+            firstGlobal = 2 + SECTION_COUNT + (int)k;
+
+        symtab.put(names.add(symbol.name), 4);
+        symtab.put((symbol.global ? STB_GLOBAL : STB_LOCAL) << 4 | type, 1);
+        symtab.put(0, 1);
+        symtab.put(symbol.section == SECTION_UNDEFINED ? 0 : sectionHeader[symbol.section], 2);
+        symtab.put(symbol.offset, 8);
+        symtab.put(symbol.size, 8);
+    }
+
+    Bytes rela;
+    for (auto& relocation : object.relocations)
+    {
+        uint64_t symbol = relocation.symbol >= 0 ? symbolIndex[relocation.symbol] : 1 + relocation.section;
+        rela.put(relocation.offset, 8);
+        rela.put(symbol << 32 | relocation.type, 8);
+        rela.put((uint64_t)relocation.addend, 8);
+    }
+
+    // the file: the ELF header, each section's contents, then the section headers
+    Bytes file;
+    file.data.resize(EHDR_BYTES);
+
+    auto place = [&](int index, const vector<uint8_t>& contents, uint64_t align)
+    {
+        file.align((size_t)align);
+        headers[index].offset = file.data.size();
+        headers[index].size = contents.size();
+        headers[index].align = align;
+        file.append(contents);
+    };
+
+    headers[SH_TEXT].type = SHT_PROGBITS;
+    headers[SH_TEXT].flags = SHF_ALLOC | SHF_EXECINSTR;
+    place(SH_TEXT, object.text, 16);
+
+    headers[SH_RELA_TEXT].type = SHT_RELA;
+    headers[SH_RELA_TEXT].flags = SHF_INFO_LINK;
+    headers[SH_RELA_TEXT].link = SH_SYMTAB;
+    headers[SH_RELA_TEXT].info = SH_TEXT;
+    headers[SH_RELA_TEXT].entrySize = RELA_BYTES;
+    place(SH_RELA_TEXT, rela.data, 8);
+
+    headers[SH_RODATA].type = SHT_PROGBITS;
+    headers[SH_RODATA].flags = SHF_ALLOC;
+    place(SH_RODATA, object.rodata, 8);
+
+    headers[SH_BSS].type = SHT_NOBITS;
+    headers[SH_BSS].flags = SHF_ALLOC | SHF_WRITE;
+    headers[SH_BSS].offset = file.data.size();
+    headers[SH_BSS].size = object.bssSize;
+    headers[SH_BSS].align = object.bssAlign;
+
+    headers[SH_NOTE_STACK].type = SHT_PROGBITS;
+    headers[SH_NOTE_STACK].offset = file.data.size();
+
+    headers[SH_SYMTAB].type = SHT_SYMTAB;
+    headers[SH_SYMTAB].link = SH_STRTAB;
+    headers[SH_SYMTAB].info = firstGlobal;
+    headers[SH_SYMTAB].entrySize = SYM_BYTES;
+    place(SH_SYMTAB, symtab.data, 8);
+
+    headers[SH_STRTAB].type = SHT_STRTAB;
+    place(SH_STRTAB, names.data, 1);
+
+    headers[SH_SHSTRTAB].type = SHT_STRTAB;
+    place(SH_SHSTRTAB, sectionNames.data, 1);
+
+    file.align(8);
+    uint64_t headerTable = file.data.size();
+
+    for (auto& header : headers)
+    {
+        file.put(header.name, 4);
+        file.put(header.type, 4);
+        file.put(header.flags, 8);
+        file.put(0, 8);                 // address: none until linked
+        file.put(header.offset, 8);
+        file.put(header.size, 8);
+        file.put(header.link, 4);
+        file.put(header.info, 4);
+        file.put(header.align, 8);
+        file.put(header.entrySize, 8);
+    }
+
+    Bytes ehdr;
+    const uint8_t ident[16] = { 0x7F, 'E', 'L', 'F', 2, 1, 1 };     // 64 bit, little endian, version 1, System V
+    ehdr.data.assign(ident, ident + 16);
+    ehdr.put(1, 2);                     // relocatable
+    ehdr.put(62, 2);                    // x86-64
+    ehdr.put(1, 4);
+    ehdr.put(0, 8);                     // no entry point
+    ehdr.put(0, 8);                     // no program headers
+    ehdr.put(headerTable, 8);
+    ehdr.put(0, 4);
+    ehdr.put(EHDR_BYTES, 2);
+    ehdr.put(0, 2);
+    ehdr.put(0, 2);
+    ehdr.put(SHDR_BYTES, 2);
+    ehdr.put(SH_COUNT, 2);
+    ehdr.put(SH_SHSTRTAB, 2);
+    copy(ehdr.data.begin(), ehdr.data.end(), file.data.begin());
+
+    out.write((const char*)file.data.data(), file.data.size());
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The sections a compiled program has; UNDEFINED for a symbol another object defines
+enum ObjectSection { SECTION_TEXT, SECTION_RODATA, SECTION_BSS, SECTION_COUNT, SECTION_UNDEFINED = -1 };
+
+// the relocations the assembler asks for, numbered as in the x86-64 psABI
+enum { R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4, R_X86_64_GOTPCREL = 9 };
+
+struct ObjectSymbol
+{
+    std::string name;
+    int section;
+    uint64_t offset;
+    uint64_t size;
+    bool global;
+    bool function;
+};
+
+// a place in .text the linker fills in: against symbol, or the start of section when that is -1
+struct Relocation
+{
+    uint64_t offset;
+    int symbol;
+    int section;
+    uint32_t type;
+    int64_t addend;
+};
+
+// A relocatable object before it is written out
+struct ObjectFile
+{
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> rodata;
+    uint64_t bssSize = 0;
+    uint64_t bssAlign = 1;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<Relocation> relocations;
+};
+
+// Writes it as an ELF64 relocatable for x86-64 Linux, the way as would: a symbol for each
+// section first, then the local symbols, then the global and undefined ones, and a
+// .note.GNU-stack that keeps the stack of whatever links it non executable.
+void writeELF(std::ostream&, const ObjectFile&);
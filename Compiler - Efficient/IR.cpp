@@ -0,0 +1,487 @@
+#include "IR.h"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+int width(IRType type)
+{
+    return type == IRType::REAL ? 4 : 2;
+}
+
+bool isTerminator(Opcode op)
+{
+    return op == Opcode::JUMP || op == Opcode::BRANCH || op == Opcode::RET;
+}
+
+bool isPure(Opcode op)
+{
+    return op <= Opcode::NOT;
+}
+
+bool isVector(Opcode op)
+{
+    return op == Opcode::VCOPY || op == Opcode::VADD || op == Opcode::VSUB;
+}
+
+void usesOf(const IRFunction& fn, const Instr& in, vector<int>& out)
+{
+    switch (in.op)
+    {
+    case Opcode::CONST: case Opcode::LOAD: case Opcode::ARG: case Opcode::READ: case Opcode::JUMP:
+    case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB: case Opcode::ADDR:
+        break;
+    case Opcode::STORE:
+        out.push_back(in.c);
+        break;
+    case Opcode::LOADREF:
+        out.push_back(in.a);
+        break;
+    case Opcode::STOREREF:
+        out.push_back(in.a);
+        out.push_back(in.c);
+        break;
+    case Opcode::CALL:
+        out.insert(out.end(), fn.listItems(in.b), fn.listItems(in.b) + fn.listSize(in.b));
+        break;
+    case Opcode::RET:
+        out.insert(out.end(), fn.listItems(in.a), fn.listItems(in.a) + fn.listSize(in.a));
+        break;
+    case Opcode::BRANCH:
+        out.push_back(in.a);
+        break;
+    case Opcode::PHI:
+        for (int i = 1; i < fn.listSize(in.a); i += 2)
+            out.push_back(fn.listItems(in.a)[i]);
+        break;
+    default:
+        out.push_back(in.a);
+        if (in.b >= 0)
+            out.push_back(in.b);
+    }
+}
+
+void rewriteUses(IRFunction& fn, Instr& in, const function<int(int)>& map)
+{
+    auto rewriteList = [&](int list, int first, int step)
+    {
+        for (int i = first; i < fn.listSize(list); i += step)
+            fn.lists[list + 1 + i] = map(fn.lists[list + 1 + i]);
+    };
+
+    switch (in.op)
+    {
+    case Opcode::CONST: case Opcode::LOAD: case Opcode::ARG: case Opcode::READ: case Opcode::JUMP:
+    case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB: case Opcode::ADDR:
+        break;
+    case Opcode::STORE:
+        in.c = map(in.c);
+        break;
+    case Opcode::LOADREF:
+        in.a = map(in.a);
+        break;
+    case Opcode::STOREREF:
+        in.a = map(in.a);
+        in.c = map(in.c);
+        break;
+    case Opcode::CALL:
+        rewriteList(in.b, 0, 1);
+        break;
+    case Opcode::RET:
+        rewriteList(in.a, 0, 1);
+        break;
+    case Opcode::BRANCH:
+        in.a = map(in.a);
+        break;
+    case Opcode::PHI:
+        rewriteList(in.a, 1, 2);
+        break;
+    default:
+        in.a = map(in.a);
+        if (in.b >= 0)
+            in.b = map(in.b);
+    }
+}
+
+void defsOf(const IRFunction& fn, const Instr& in, vector<int>& out)
+{
+    if (in.dst >= 0)
+        out.push_back(in.dst);
+
+    if (in.op == Opcode::CALL)
+        out.insert(out.end(), fn.listItems(in.c), fn.listItems(in.c) + fn.listSize(in.c));
+}
+
+void buildCFG(IRFunction& fn)
+{
+    for (auto& block : fn.blocks)
+    {
+        block.succs.clear();
+        block.preds.clear();
+    }
+
+    for (int i = 0; i < (int)fn.blocks.size(); ++i)
+    {
+        const Instr& last = fn.blocks[i].code.back();
+
+        if (last.op == Opcode::JUMP)
+            fn.blocks[i].succs.push_back(last.a);
+        else if (last.op == Opcode::BRANCH)
+        {
+            fn.blocks[i].succs.push_back(last.b);
+            if (last.c != last.b)
+                fn.blocks[i].succs.push_back(last.c);
+        }
+
+        for (int succ : fn.blocks[i].succs)
+            fn.blocks[succ].preds.push_back(i);
+    }
+}
+
+void compactBlocks(IRFunction& fn, const vector<bool>& keep)
+{
+    vector<int> order;
+
+    for (int i = 0; i < (int)fn.blocks.size(); ++i)
+        if (keep[i])
+            order.push_back(i);
+
+    orderBlocks(fn, order);
+}
+
+void orderBlocks(IRFunction& fn, const vector<int>& order)
+{
+    vector<int> number(fn.blocks.size(), -1);
+    vector<BasicBlock> blocks;
+
+    for (int i : order)
+    {
+        number[i] = (int)blocks.size();
+        blocks.push_back(move(fn.blocks[i]));
+    }
+
+    fn.blocks = move(blocks);
+
+    for (auto& block : fn.blocks)
+    {
+        Instr& last = block.code.back();
+
+        if (last.op == Opcode::JUMP)
+            last.a = number[last.a];
+        else if (last.op == Opcode::BRANCH)
+        {
+            last.b = number[last.b];
+            last.c = number[last.c];
+        }
+
+        for (auto& in : block.code)
+            if (in.op == Opcode::PHI)
+                for (int i = 0; i < fn.listSize(in.a); i += 2)
+                {
+                    int& pred = fn.lists[in.a + 1 + i];
+                    pred = number[pred];
+                }
+    }
+
+    buildCFG(fn);
+
+    // edges into a block can only have disappeared: shrink its phi lists in place
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+        {
+            if (in.op != Opcode::PHI)
+                continue;
+
+            int* items = &fn.lists[in.a + 1];
+            int size = 0;
+
+            for (int i = 0; i < fn.listSize(in.a); i += 2)
+                if (items[i] >= 0 && find(block.preds.begin(), block.preds.end(), items[i]) != block.preds.end())
+                {
+                    items[size++] = items[i];
+                    items[size++] = items[i + 1];
+                }
+
+            fn.lists[in.a] = size;
+        }
+}
+
+// the jump ending each block that closes a cycle, found depth first from the entry
+vector<bool> backJumps(const IRFunction& fn)
+{
+    int count = (int)fn.blocks.size();
+    vector<bool> back(count), onPath(count), seen(count);
+    vector<pair<int, size_t>> path{ { 0, 0 } };
+    seen[0] = onPath[0] = true;
+
+    while (!path.empty())
+    {
+        int b = path.back().first;
+        size_t next = path.back().second++;
+
+        if (next == fn.blocks[b].succs.size())
+        {
+            onPath[b] = false;
+            path.pop_back();
+            continue;
+        }
+
+        int succ = fn.blocks[b].succs[next];
+        if (onPath[succ] && fn.blocks[b].code.back().op == Opcode::JUMP)
+            back[b] = true;
+        else if (!seen[succ])
+        {
+            seen[succ] = onPath[succ] = true;
+            path.push_back({ succ, 0 });
+        }
+    }
+
+    return back;
+}
+
+void threadJumps(IRFunction& fn)
+{
+    buildCFG(fn);
+
+    int count = (int)fn.blocks.size();
+    vector<bool> back = backJumps(fn);
+
+    auto forwards = [&](int b)
+    {
+        return b != 0 && !back[b] && fn.blocks[b].code.size() == 1 && fn.blocks[b].code[0].op == Opcode::JUMP && fn.blocks[b].code[0].a != b;
+    };
+
+    // from -> through -> where through jumps; false when a phi there cannot take the new edge
+    auto thread = [&](int from, int through)
+    {
+        auto& code = fn.blocks[fn.blocks[through].code[0].a].code;
+        size_t phis = 0;
+
+        for (; phis < code.size() && code[phis].op == Opcode::PHI; ++phis)
+            for (int i = 0; i < fn.listSize(code[phis].a); i += 2)
+                if (fn.listItems(code[phis].a)[i] == from)
+                    return false;
+
+        for (size_t k = 0; k < phis; ++k)
+        {
+            vector<int> items(fn.listItems(code[k].a), fn.listItems(code[k].a) + fn.listSize(code[k].a));
+
+            for (size_t i = 0; i < items.size(); i += 2)
+                if (items[i] == through)
+                {
+                    items.push_back(from);
+                    items.push_back(items[i + 1]);
+                    break;
+                }
+
+            code[k].a = fn.newList(items);
+        }
+
+        return true;
+    };
+
+    for (int b = 0; b < count; ++b)
+    {
+        Instr& last = fn.blocks[b].code.back();
+        int* targets[] = { last.op == Opcode::JUMP ? &last.a : last.op == Opcode::BRANCH ? &last.b : nullptr, last.op == Opcode::BRANCH ? &last.c : nullptr };
+
+        for (int* target : targets)
+            for (int hops = 0; target && hops < count && forwards(*target) && thread(b, *target); ++hops)
+                *target = fn.blocks[*target].code[0].a;
+
+        if (last.op == Opcode::BRANCH && last.b == last.c)
+            last = { Opcode::JUMP, IRType::VOID, -1, last.b, -1, -1 };
+    }
+
+    buildCFG(fn);
+}
+
+void layoutBlocks(IRFunction& fn)
+{
+    int count = (int)fn.blocks.size();
+    vector<bool> placed(count);
+    vector<int> order, pending{ 0 };
+
+    while (!pending.empty())
+    {
+        int b = pending.back();
+        pending.pop_back();
+
+        // a chain of blocks each falling into the next, the sides not taken wait their turn
+        while (b >= 0 && !placed[b])
+        {
+            placed[b] = true;
+            order.push_back(b);
+
+            const Instr& last = fn.blocks[b].code.back();
+            int targets[] = { last.op == Opcode::JUMP ? last.a : last.op == Opcode::BRANCH ? last.b : -1, last.op == Opcode::BRANCH ? last.c : -1 };
+            int next = -1;
+
+            for (int target : targets)
+                if (target >= 0 && !placed[target] && (next < 0 || (fn.blocks[target].preds.size() == 1 && fn.blocks[next].preds.size() > 1)))
+                    next = target;
+
+            for (int target : targets)
+                if (target >= 0 && target != next && !placed[target])
+                    pending.push_back(target);
+
+            b = next;
+        }
+    }
+
+    orderBlocks(fn, order);
+}
+
+int instructionCount(const IRFunction& fn)
+{
+    int count = 0;
+
+    for (auto& block : fn.blocks)
+        count += (int)block.code.size();
+
+    return count;
+}
+
+const char* typeName(IRType type)
+{
+    switch (type)
+    {
+    case IRType::INT: return "int";
+    case IRType::REAL: return "real";
+    case IRType::BOOL: return "bool";
+    case IRType::REF: return "ref";
+    default: return "void";
+    }
+}
+
+const char* opName(Opcode op)
+{
+    static const char* names[] = {
+        "const", "copy", "add", "sub", "mul", "div", "itof",
+        "lt", "le", "eq", "gt", "ge", "ne", "and", "or", "not",
+        "load", "store", "vcopy", "vadd", "vsub", "addr", "loadref", "storeref", "arg", "read", "write", "call", "jump", "br", "ret", "phi"
+    };
+
+    return names[(int)op];
+}
+
+void printList(ostream& out, const IRFunction& fn, int list)
+{
+    out << "[";
+    for (int i = 0; i < fn.listSize(list); ++i)
+        out << (i ? ", " : "") << "r" << fn.listItems(list)[i];
+    out << "]";
+}
+
+void printAddress(ostream& out, int address)
+{
+    out << (addressArea(address) == AREA_GLOBAL ? "global" : "frame") << "+" << addressOffset(address);
+}
+
+void printIR(ostream& out, const IRFunction& fn)
+{
+    out << "function " << fn.name << " (frame " << fn.frameSize << ", in " << fn.argTypes.size() << ", out " << fn.resultTypes.size() << ")" << endl;
+
+    for (int i = 0; i < (int)fn.blocks.size(); ++i)
+    {
+        const BasicBlock& block = fn.blocks[i];
+
+        out << "b" << i << ":";
+        if (!block.preds.empty())
+        {
+            out << "\t\t; preds";
+            for (int pred : block.preds)
+                out << " b" << pred;
+        }
+        out << endl;
+
+        for (const Instr& in : block.code)
+        {
+            out << "\t";
+
+            if (in.dst >= 0)
+                out << "r" << in.dst << ":" << typeName(fn.regs[in.dst]) << " = ";
+
+            out << opName(in.op);
+
+            switch (in.op)
+            {
+            case Opcode::CONST:
+                if (in.type == IRType::REAL)
+                {
+                    float value;
+                    memcpy(&value, &in.a, sizeof value);
+                    out << " " << value;
+                }
+                else
+                    out << " " << in.a;
+                break;
+            case Opcode::LOAD:
+                out << " " << (in.a == AREA_GLOBAL ? "global" : "frame") << "+" << in.b;
+                break;
+            case Opcode::STORE:
+                out << " " << (in.a == AREA_GLOBAL ? "global" : "frame") << "+" << in.b << ", r" << in.c;
+                break;
+            case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB:
+                out << " " << typeName(in.type) << " x" << in.c << " ";
+                printAddress(out, in.a);
+                out << ", ";
+                printAddress(out, in.b);
+                break;
+            case Opcode::ADDR:
+                out << " frame+" << in.a << " x" << in.b;
+                break;
+            case Opcode::LOADREF:
+                out << " r" << in.a << "+" << in.b;
+                break;
+            case Opcode::STOREREF:
+                out << " r" << in.a << "+" << in.b << ", r" << in.c;
+                break;
+            case Opcode::ARG:
+                out << " " << in.a;
+                break;
+            case Opcode::READ:
+                out << " " << typeName(in.type);
+                break;
+            case Opcode::CALL:
+                out << " f" << in.a << " ";
+                printList(out, fn, in.b);
+                out << " -> ";
+                printList(out, fn, in.c);
+                break;
+            case Opcode::JUMP:
+                out << " b" << in.a;
+                break;
+            case Opcode::BRANCH:
+                out << " r" << in.a << ", b" << in.b << ", b" << in.c;
+                break;
+            case Opcode::RET:
+                out << " ";
+                printList(out, fn, in.a);
+                break;
+            case Opcode::PHI:
+                out << " [";
+                for (int i = 0; i < fn.listSize(in.a); i += 2)
+                    out << (i ? ", " : "") << "b" << fn.listItems(in.a)[i] << ": r" << fn.listItems(in.a)[i + 1];
+                out << "]";
+                break;
+            default:
+                out << " r" << in.a;
+                if (in.b >= 0)
+                    out << ", r" << in.b;
+            }
+
+            out << endl;
+        }
+    }
+}
+
+void printIR(ostream& out, const IRModule& module)
+{
+    out << "globals " << module.globalSize << endl;
+
+    for (int i = 0; i < (int)module.functions.size(); ++i)
+    {
+        out << endl << "f" << i << ": ";
+        printIR(out, module.functions[i]);
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class FuncEntry;
+
+enum class IRType : uint8_t
+{
+    VOID,
+    INT,    // 16 bit two's complement
+    REAL,   // 32 bit float
+    BOOL,
+    REF     // where a record passed by reference sits, in the frame of some activation
+};
+
+enum class Opcode : uint8_t
+{
+    CONST,      // dst <- a (an int, or the bits of a float)
+    COPY,       // dst <- a
+
+    ADD,        // dst <- a op b, both of the instruction's type
+    SUB,
+    MUL,
+    DIV,        // REAL only, int operands go through ITOF first
+    ITOF,       // dst (REAL) <- a (INT)
+
+    LT,         // dst (BOOL) <- a cmp b, type is the operand type
+    LE,
+    EQ,
+    GT,
+    GE,
+    NE,
+    AND,        // BOOL
+    OR,
+    NOT,
+
+    LOAD,       // dst <- [area a + b]
+    STORE,      // [area a + b] <- c
+    VCOPY,      // [a] <- [b], c lanes of the instruction's type at once; a and b are address()es
+    VADD,       // [a] <- [a] op [b], lane by lane
+    VSUB,
+    ADDR,       // dst (REF) <- the address of the record of b bytes at frame offset a
+    LOADREF,    // dst <- [a + b], a a REF register
+    STOREREF,   // [a + b] <- c
+    ARG,        // dst <- scalar number a of the inputs, only in the entry block
+
+    READ,       // dst <- next value of the instruction's type from the input
+    WRITE,      // print a
+
+    CALL,       // a = callee's function index, b/c = list of argument/result registers
+    JUMP,       // to block a
+    BRANCH,     // to block b if a, else to block c
+    RET,        // a = list of the returned registers
+
+    PHI         // a = list of (predecessor block, register) pairs, dst <- the one of the edge taken
+};
+
+// memory areas a LOAD or STORE can address
+enum { AREA_FRAME = 0, AREA_GLOBAL = 1 };
+
+// the area and offset of a V instruction's operand, packed into one int
+inline int address(int area, int offset) { return offset * 2 + area; }
+inline int addressArea(int address) { return address & 1; }
+inline int addressOffset(int address) { return address >> 1; }
+
+// bytes a value of the type takes in memory, and so the width of one lane
+int width(IRType);
+
+// One three-address instruction. Every operand is a plain int: a register, block,
+// list, area, offset or immediate as the opcode says; unused ones are -1.
+struct Instr
+{
+    Opcode op;
+    IRType type;
+    int dst;
+    int a;
+    int b;
+    int c;
+};
+
+struct BasicBlock
+{
+    std::vector<Instr> code;    // ends in exactly one JUMP, BRANCH or RET
+    std::vector<int> succs;
+    std::vector<int> preds;
+};
+
+// Everything a function owns sits in flat vectors addressed by index: no instruction,
+// block or operand is a separate allocation, and dropping the function frees it all.
+struct IRFunction
+{
+    std::string name;
+    const FuncEntry* entry = nullptr;
+    int frameSize = 0;
+    std::vector<IRType> argTypes;       // scalars passed in, records count one per leaf field
+    std::vector<IRType> resultTypes;    // scalars handed back
+
+    std::vector<IRType> regs;           // type of every virtual register
+    std::vector<BasicBlock> blocks;     // blocks[0] is the entry
+    std::vector<int> lists;             // CALL/RET operand lists: a count, then that many registers
+
+    int newReg(IRType type)
+    {
+        regs.push_back(type);
+        return (int)regs.size() - 1;
+    }
+
+    int newBlock()
+    {
+        blocks.emplace_back();
+        return (int)blocks.size() - 1;
+    }
+
+    int newList(const std::vector<int>& items)
+    {
+        lists.push_back((int)items.size());
+        lists.insert(lists.end(), items.begin(), items.end());
+        return (int)lists.size() - (int)items.size() - 1;
+    }
+
+    int listSize(int list) const
+    {
+        return lists[list];
+    }
+
+    const int* listItems(int list) const
+    {
+        return &lists[list + 1];
+    }
+};
+
+struct IRModule
+{
+    std::vector<IRFunction> functions;  // in program order, main last
+    int mainIndex = -1;
+    int globalSize = 0;
+};
+
+bool isTerminator(Opcode);
+
+// computes its result from its operands alone: no memory, input, output or control flow
+bool isPure(Opcode);
+
+// VCOPY, VADD or VSUB: from memory to memory, no registers involved
+bool isVector(Opcode);
+
+// append the registers an instruction reads / writes to out
+void usesOf(const IRFunction&, const Instr&, std::vector<int>& out);
+void defsOf(const IRFunction&, const Instr&, std::vector<int>& out);
+
+// recomputes succs and preds of every block from the terminators
+void buildCFG(IRFunction&);
+
+// replaces every register an instruction reads with map(register)
+void rewriteUses(IRFunction&, Instr&, const std::function<int(int)>& map);
+
+// Drops the blocks not kept and renumbers the rest, then rebuilds the CFG and drops the
+// phi entries of edges that no longer exist. Kept blocks may only jump to kept blocks.
+void compactBlocks(IRFunction&, const std::vector<bool>& keep);
+
+// As compactBlocks, keeping the blocks listed and putting them in that order; block 0 first
+void orderBlocks(IRFunction&, const std::vector<int>& order);
+
+// Sends a jump or branch to a block that holds nothing but a jump on to where that one
+// goes, adding the phi entries the new edge needs. An edge into a block with phis from
+// the same predecessor already is left, as is a loop's jump back to its header, which
+// the loop passes expect to find. A branch left with one target becomes a jump. The
+// blocks skipped may be left unreachable.
+void threadJumps(IRFunction&);
+
+// Orders the blocks so that each is followed by the successor it most likely goes to, for
+// the backends to fall into: the one with no other predecessor, as a then side, a loop
+// body or the rest of a short circuit condition is, else the side taken when the branch
+// holds. Blocks the entry cannot reach are dropped. Needs the CFG built.
+void layoutBlocks(IRFunction&);
+
+int instructionCount(const IRFunction&);
+
+void printIR(std::ostream&, const IRFunction&);
+void printIR(std::ostream&, const IRModule&);
@@ -0,0 +1,238 @@
+#include "Inliner.h"
+#include "SymbolTable.h"
+#include <algorithm>
+#include <set>
+using namespace std;
+
+// instruction budgets: any callee this small, a callee called from one place up to the
+// larger size, and no caller grows past the last
+enum { INLINE_SMALL = 32, INLINE_ONCE = 256, MAX_CALLER_SIZE = 4096 };
+
+bool worthInlining(const IRModule& module, const CallGraph& graph, int caller, int callee)
+{
+    const IRFunction& body = module.functions[callee];
+
+    if (graph.recursive[callee] || graph.component[callee] == graph.component[caller])
+        return false;
+
+    int rets = 0;
+    for (auto& block : body.blocks)
+        rets += block.code.back().op == Opcode::RET;
+
+    if (rets != 1)
+        return false;
+
+    // the call itself goes away, with the ARGs that take the inputs apart
+    int size = instructionCount(body) - (int)body.argTypes.size() - 1;
+    int saved = 1 + (int)body.argTypes.size() + (int)body.resultTypes.size();
+
+    if (instructionCount(module.functions[caller]) + size > MAX_CALLER_SIZE)
+        return false;
+
+    return size <= INLINE_SMALL + saved || (graph.callSites[callee] == 1 && size <= INLINE_ONCE);
+}
+
+void splice(IRFunction& caller, int block, size_t at, const IRFunction& callee)
+{
+    Instr call = caller.blocks[block].code[at];
+    vector<int> args(caller.listItems(call.b), caller.listItems(call.b) + caller.listSize(call.b));
+    vector<int> results(caller.listItems(call.c), caller.listItems(call.c) + caller.listSize(call.c));
+
+    int regBase = (int)caller.regs.size();
+    int frameBase = roundUp(caller.frameSize, 4);
+    int blockBase = (int)caller.blocks.size();
+    int rest = blockBase + (int)callee.blocks.size();
+
+    caller.regs.insert(caller.regs.end(), callee.regs.begin(), callee.regs.end());
+    caller.frameSize = frameBase + callee.frameSize;
+    caller.blocks.resize(rest + 1);
+
+    // what follows the call moves to a block of its own, the callee's RET jumps there
+    auto& code = caller.blocks[block].code;
+    caller.blocks[rest].code.assign(code.begin() + at + 1, code.end());
+    code.erase(code.begin() + at, code.end());
+
+    // the callee's variables start at zero on every call, as its frame would
+    set<pair<int, IRType>> slots;
+    for (auto& b : callee.blocks)
+        for (auto& in : b.code)
+        {
+            if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_FRAME)
+                slots.insert({ in.b, in.type });
+
+            if (isVector(in.op))
+                for (int operand : { in.a, in.b })
+                    for (int lane = 0; lane < in.c && addressArea(operand) == AREA_FRAME; ++lane)
+                        slots.insert({ addressOffset(operand) + lane * width(in.type), in.type });
+        }
+
+    for (auto& slot : slots)
+    {
+        int zero = caller.newReg(slot.second);
+        code.push_back({ Opcode::CONST, slot.second, zero, 0, -1, -1 });
+        code.push_back({ Opcode::STORE, slot.second, -1, AREA_FRAME, frameBase + slot.first, zero });
+    }
+
+    code.push_back({ Opcode::JUMP, IRType::VOID, -1, blockBase, -1, -1 });
+
+    auto reg = [regBase](int r) { return r + regBase; };
+
+    for (int b = 0; b < (int)callee.blocks.size(); ++b)
+    {
+        auto& out = caller.blocks[blockBase + b].code;
+
+        for (Instr in : callee.blocks[b].code)
+        {
+            switch (in.op)
+            {
+            case Opcode::ARG:
+                out.push_back({ Opcode::COPY, in.type, reg(in.dst), args[in.a], -1, -1 });
+                continue;
+
+            case Opcode::RET:
+                for (int i = 0; i < callee.listSize(in.a); ++i)
+                    out.push_back({ Opcode::COPY, caller.regs[results[i]], results[i], reg(callee.listItems(in.a)[i]), -1, -1 });
+
+                out.push_back({ Opcode::JUMP, IRType::VOID, -1, rest, -1, -1 });
+                continue;
+
+            case Opcode::CALL:
+            {
+                vector<int> callArgs, callResults;
+                for (int i = 0; i < callee.listSize(in.b); ++i)
+                    callArgs.push_back(reg(callee.listItems(in.b)[i]));
+                for (int i = 0; i < callee.listSize(in.c); ++i)
+                    callResults.push_back(reg(callee.listItems(in.c)[i]));
+
+                in.b = caller.newList(callArgs);
+                in.c = caller.newList(callResults);
+                out.push_back(in);
+                continue;
+            }
+
+            case Opcode::JUMP:
+                in.a += blockBase;
+                break;
+
+            case Opcode::BRANCH:
+                in.b += blockBase;
+                in.c += blockBase;
+                break;
+
+            case Opcode::LOAD: case Opcode::STORE:
+                if (in.a == AREA_FRAME)
+                    in.b += frameBase;
+                break;
+
+            case Opcode::ADDR:
+                in.a += frameBase;
+                break;
+
+            case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB:
+                if (addressArea(in.a) == AREA_FRAME)
+                    in.a = address(AREA_FRAME, addressOffset(in.a) + frameBase);
+                if (addressArea(in.b) == AREA_FRAME)
+                    in.b = address(AREA_FRAME, addressOffset(in.b) + frameBase);
+                break;
+
+            default:
+                break;
+            }
+
+            rewriteUses(caller, in, reg);
+            if (in.dst >= 0)
+                in.dst = reg(in.dst);
+
+            out.push_back(in);
+        }
+    }
+}
+
+// A reference the caller made and an inlined callee used is now an address within one
+// frame: the loads and stores through it become plain frame accesses again. Before SSA
+// every register is set once, so following each ADDR through the copies passing it on
+// finds them all.
+void resolveReferences(IRFunction& fn)
+{
+    vector<int> offset(fn.regs.size(), -1);
+
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+            {
+                int known = in.op == Opcode::ADDR ? in.a : in.op == Opcode::COPY && fn.regs[in.dst] == IRType::REF ? offset[in.a] : -1;
+
+                if (known >= 0 && offset[in.dst] < 0)
+                {
+                    offset[in.dst] = known;
+                    changed = true;
+                }
+            }
+    }
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+        {
+            if (in.op == Opcode::LOADREF && offset[in.a] >= 0)
+                in = { Opcode::LOAD, in.type, in.dst, AREA_FRAME, offset[in.a] + in.b, -1 };
+            else if (in.op == Opcode::STOREREF && offset[in.a] >= 0)
+                in = { Opcode::STORE, in.type, -1, AREA_FRAME, offset[in.a] + in.b, in.c };
+        }
+
+    // what is left of a reference no call takes goes, or it would keep its record in memory
+    vector<bool> needed(fn.regs.size());
+    vector<int> regs;
+
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+            {
+                regs.clear();
+                if (in.op != Opcode::COPY)
+                    usesOf(fn, in, regs);
+                else if (needed[in.dst])
+                    regs.push_back(in.a);
+
+                for (int reg : regs)
+                    if (fn.regs[reg] == IRType::REF && !needed[reg])
+                        needed[reg] = changed = true;
+            }
+    }
+
+    for (auto& block : fn.blocks)
+        block.code.erase(remove_if(block.code.begin(), block.code.end(), [&](const Instr& in)
+        {
+            return (in.op == Opcode::ADDR || in.op == Opcode::COPY) && fn.regs[in.dst] == IRType::REF && offset[in.dst] >= 0 && !needed[in.dst];
+        }), block.code.end());
+}
+
+void inlineCalls(IRModule& module, const CallGraph& graph)
+{
+    for (auto& component : graph.components)
+        for (int fn : component)
+        {
+            IRFunction& caller = module.functions[fn];
+
+            // spliced blocks are appended, so their own calls come up later in this walk
+            for (int b = 0; b < (int)caller.blocks.size(); ++b)
+                for (size_t k = 0; k < caller.blocks[b].code.size(); ++k)
+                {
+                    const Instr& in = caller.blocks[b].code[k];
+
+                    if (in.op == Opcode::CALL && worthInlining(module, graph, fn, in.a))
+                    {
+                        splice(caller, b, k, module.functions[in.a]);
+                        break;
+                    }
+                }
+
+            resolveReferences(caller);
+            buildCFG(caller);
+        }
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "CallGraph.h"
+#include "IR.h"
+
+// Splices the bodies of small, or singly called, non-recursive functions into their callers,
+// visiting callees first so that what they inlined comes along. The call's argument and
+// result lists turn into copies from and to the callee's registers, and the callee's frame
+// becomes an area of the caller's, zeroed where the call was; records it was passed by
+// reference are read and written where they are. Runs before SSA construction.
+void inlineCalls(IRModule&, const CallGraph&);
@@ -0,0 +1,483 @@
+#include "JIT.h"
+#include "X86Encoder.h"
+#include <cstddef>
+#include <cstring>
+using namespace std;
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool jitAvailable()
+{
+    return true;
+}
+
+NativeFunction::~NativeFunction()
+{
+    munmap(pages, size);
+}
+
+unique_ptr<NativeFunction> mapExecutable(const vector<uint8_t>& code)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + page - 1) / page * page;
+
+    void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED)
+        return nullptr;
+
+    memcpy(pages, code.data(), code.size());
+
+    if (mprotect(pages, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(pages, size);
+        return nullptr;
+    }
+
+    return unique_ptr<NativeFunction>(new NativeFunction(pages, size));
+}
+#else
+bool jitAvailable()
+{
+    return false;
+}
+
+NativeFunction::~NativeFunction()
+{
+}
+
+unique_ptr<NativeFunction> mapExecutable(const vector<uint8_t>&)
+{
+    return nullptr;
+}
+#endif
+
+// rbx holds the registers, the frame follows them; r12 the NativeFrame, r13 the globals
+// and r14 the machine. All four are callee saved, so they survive the calls into the runtime.
+struct Translator
+{
+    const VMFunction& fn;
+    const JitRuntime& runtime;
+    X86Encoder out;
+    vector<int> labels;     // one per bytecode instruction
+    int fail, done;
+
+    Translator(const VMFunction& fn, const JitRuntime& runtime) : fn(fn), runtime(runtime) {}
+
+    Mem reg(int r) const { return Mem(RBX, r * (int)sizeof(Slot)); }
+    Mem frame(int offset) const { return Mem(RBX, fn.regCount * (int)sizeof(Slot) + offset); }
+    Mem global(int offset) const { return Mem(R13, offset); }
+    Mem field(size_t offset) const { return Mem(R12, (int)offset); }
+    Mem at(int address, int offset) const { return addressArea(address) == AREA_GLOBAL ? global(addressOffset(address) + offset) : frame(addressOffset(address) + offset); }
+
+    template <typename Hook>
+    void callRuntime(Hook hook)
+    {
+        out.moveImm64(RAX, (uint64_t)(uintptr_t)hook);
+        out.call(RAX);
+    }
+
+    // falls through to the next instruction when it is the target
+    void jumpTo(int target, int at)
+    {
+        if (target != at + 1)
+            out.jump(labels[target]);
+    }
+
+    // to whenTrue if cond holds, else to whenFalse; x86 numbers each condition next to its
+    // negation, so either side can be the one fallen into
+    void branch(Cond cond, int whenTrue, int whenFalse, int at)
+    {
+        if (whenTrue == at + 1)
+            out.jump((Cond)(cond ^ 1), labels[whenFalse]);
+        else
+        {
+            out.jump(cond, labels[whenTrue]);
+            jumpTo(whenFalse, at);
+        }
+    }
+
+    void intBinary(const VMInstr& in, int op)
+    {
+        out.load(RAX, reg(in.a));
+        if (op == -1)
+            out.imul(RAX, reg(in.b));
+        else
+            out.alu(op, RAX, reg(in.b));
+        out.signExtend16(RAX);
+        out.store(reg(in.dst), RAX);
+    }
+
+    // rax <- the address reference r holds
+    void reference(int r)
+    {
+        out.loadSigned32(RAX, reg(r));
+        out.alu64(ALU_ADD, RAX, field(offsetof(NativeFrame, stack)));
+    }
+
+    void realBinary(const VMInstr& in, uint8_t op)
+    {
+        out.movss(0, reg(in.a));
+        out.sse(op, 0, reg(in.b));
+        out.movss(reg(in.dst), 0);
+    }
+
+    void setFlag(const VMInstr& in, Cond cond)
+    {
+        out.set(cond, RAX);
+        out.zeroExtend8(RAX, RAX);
+        out.store(reg(in.dst), RAX);
+    }
+
+    // ucomiss is unordered on NaN, where only != holds: a < b is tested as b > a, which is false then
+    Cond realCompare(VMOp op, int a, int b, VMOp base)
+    {
+        static const Cond conditions[] = { CC_A, CC_AE, CC_E, CC_A, CC_AE, CC_NE };
+        int index = (int)op - (int)base;
+        bool swap = index < 2;
+
+        out.movss(0, reg(swap ? b : a));
+        out.ucomiss(0, reg(swap ? a : b));
+        return conditions[index];
+    }
+
+    void translate(int at)
+    {
+        static const Cond intConditions[] = { CC_L, CC_LE, CC_E, CC_G, CC_GE, CC_NE };
+        const VMInstr& in = fn.code[at];
+
+        switch (in.op)
+        {
+        case VMOp::LOADK: out.storeImm(reg(in.dst), in.a); break;
+        case VMOp::MOVE: out.load(RAX, reg(in.a)); out.store(reg(in.dst), RAX); break;
+
+        case VMOp::ADD_I: intBinary(in, ALU_ADD); break;
+        case VMOp::SUB_I: intBinary(in, ALU_SUB); break;
+        case VMOp::MUL_I: intBinary(in, -1); break;
+        case VMOp::ADDK_I:
+            out.load(RAX, reg(in.a));
+            out.aluImm(ALU_ADD, RAX, in.b);
+            out.signExtend16(RAX);
+            out.store(reg(in.dst), RAX);
+            break;
+
+        case VMOp::ADD_R: realBinary(in, SSE_ADD); break;
+        case VMOp::SUB_R: realBinary(in, SSE_SUB); break;
+        case VMOp::MUL_R: realBinary(in, SSE_MUL); break;
+        case VMOp::DIV_R: realBinary(in, SSE_DIV); break;
+        case VMOp::ITOF: out.cvtsi2ss(0, reg(in.a)); out.movss(reg(in.dst), 0); break;
+
+        case VMOp::LT_I: case VMOp::LE_I: case VMOp::EQ_I: case VMOp::GT_I: case VMOp::GE_I: case VMOp::NE_I:
+            out.load(RAX, reg(in.a));
+            out.alu(ALU_CMP, RAX, reg(in.b));
+            setFlag(in, intConditions[(int)in.op - (int)VMOp::LT_I]);
+            break;
+
+        case VMOp::LT_R: case VMOp::LE_R: case VMOp::GT_R: case VMOp::GE_R:
+            setFlag(in, realCompare(in.op, in.a, in.b, VMOp::LT_R));
+            break;
+
+        case VMOp::EQ_R: case VMOp::NE_R:
+        {
+            bool eq = in.op == VMOp::EQ_R;
+            out.movss(0, reg(in.a));
+            out.ucomiss(0, reg(in.b));
+            out.set(eq ? CC_E : CC_NE, RAX);
+            out.set(eq ? CC_NP : CC_P, RCX);
+            out.zeroExtend8(RAX, RAX);
+            out.zeroExtend8(RCX, RCX);
+            out.alu(eq ? ALU_AND : ALU_OR, RAX, RCX);
+            out.store(reg(in.dst), RAX);
+            break;
+        }
+
+        case VMOp::AND: intLogic(in, ALU_AND); break;
+        case VMOp::OR: intLogic(in, ALU_OR); break;
+        case VMOp::NOT:
+            out.aluImm(ALU_CMP, reg(in.a), 0);
+            setFlag(in, CC_E);
+            break;
+
+        case VMOp::LDF_I: out.loadSigned16(RAX, frame(in.a)); out.store(reg(in.dst), RAX); break;
+        case VMOp::LDF_R: out.load(RAX, frame(in.a)); out.store(reg(in.dst), RAX); break;
+        case VMOp::LDG_I: out.loadSigned16(RAX, global(in.a)); out.store(reg(in.dst), RAX); break;
+        case VMOp::LDG_R: out.load(RAX, global(in.a)); out.store(reg(in.dst), RAX); break;
+
+        case VMOp::STF_I: out.load(RAX, reg(in.b)); out.store16(frame(in.a), RAX); break;
+        case VMOp::STF_R: out.load(RAX, reg(in.b)); out.store(frame(in.a), RAX); break;
+        case VMOp::STG_I: out.load(RAX, reg(in.b)); out.store16(global(in.a), RAX); break;
+        case VMOp::STG_R: out.load(RAX, reg(in.b)); out.store(global(in.a), RAX); break;
+
+        case VMOp::ADDR:
+            out.lea(RAX, frame(in.a));
+            out.alu64(ALU_SUB, RAX, field(offsetof(NativeFrame, stack)));
+            out.store(reg(in.dst), RAX);
+            break;
+
+        case VMOp::LDR_I: case VMOp::LDR_R:
+            reference(in.a);
+            if (in.op == VMOp::LDR_I)
+                out.loadSigned16(RCX, Mem(RAX, in.b));
+            else
+                out.load(RCX, Mem(RAX, in.b));
+            out.store(reg(in.dst), RCX);
+            break;
+
+        case VMOp::STR_I: case VMOp::STR_R:
+            reference(in.a);
+            out.load(RCX, reg(in.c));
+            if (in.op == VMOp::STR_I)
+                out.store16(Mem(RAX, in.b), RCX);
+            else
+                out.store(Mem(RAX, in.b), RCX);
+            break;
+
+        case VMOp::INCF_I: case VMOp::INCG_I:
+        {
+            Mem at = in.op == VMOp::INCF_I ? frame(in.a) : global(in.a);
+            out.loadSigned16(RAX, at);
+            out.aluImm(ALU_ADD, RAX, in.b);
+            out.store16(at, RAX);
+            break;
+        }
+
+        case VMOp::INCF_R: case VMOp::INCG_R:
+        {
+            Mem at = in.op == VMOp::INCF_R ? frame(in.a) : global(in.a);
+            out.movss(0, at);
+            out.moveImm(RAX, in.b);
+            out.movd(1, RAX);
+            out.sse(SSE_ADD, 0, 1);
+            out.movss(at, 0);
+            break;
+        }
+
+        case VMOp::VCOPY: copyBytes(in); break;
+        case VMOp::VADD_I: lanes(in, false, false); break;
+        case VMOp::VSUB_I: lanes(in, false, true); break;
+        case VMOp::VADD_R: lanes(in, true, false); break;
+        case VMOp::VSUB_R: lanes(in, true, true); break;
+
+        case VMOp::BLT_I: case VMOp::BLE_I: case VMOp::BEQ_I: case VMOp::BGT_I: case VMOp::BGE_I: case VMOp::BNE_I:
+            out.load(RAX, reg(in.a));
+            out.alu(ALU_CMP, RAX, reg(in.b));
+            branch(intConditions[(int)in.op - (int)VMOp::BLT_I], in.dst, in.c, at);
+            break;
+
+        case VMOp::BLT_R: case VMOp::BLE_R: case VMOp::BGT_R: case VMOp::BGE_R:
+            out.jump(realCompare(in.op, in.a, in.b, VMOp::BLT_R), labels[in.dst]);
+            jumpTo(in.c, at);
+            break;
+
+        case VMOp::BEQ_R:
+            out.movss(0, reg(in.a));
+            out.ucomiss(0, reg(in.b));
+            out.jump(CC_NE, labels[in.c]);
+            out.jump(CC_P, labels[in.c]);
+            jumpTo(in.dst, at);
+            break;
+
+        case VMOp::BNE_R:
+            out.movss(0, reg(in.a));
+            out.ucomiss(0, reg(in.b));
+            out.jump(CC_NE, labels[in.dst]);
+            out.jump(CC_P, labels[in.dst]);
+            jumpTo(in.c, at);
+            break;
+
+        case VMOp::ARG:
+            out.load64(RAX, field(offsetof(NativeFrame, caller)));
+            out.load64(RCX, field(offsetof(NativeFrame, args)));
+            out.loadSigned32(RDX, Mem(RCX, in.a * (int)sizeof(int)));
+            out.load(RCX, Mem(RAX, RDX, (int)sizeof(Slot), 0));
+            out.store(reg(in.dst), RCX);
+            break;
+
+        case VMOp::READ_I:
+            out.move64(RDI, R14);
+            callRuntime(runtime.readInt);
+            out.store(reg(in.dst), RAX);
+            break;
+
+        case VMOp::READ_R:
+            out.move64(RDI, R14);
+            callRuntime(runtime.readReal);
+            out.movss(reg(in.dst), 0);
+            break;
+
+        case VMOp::WRITE_I:
+            out.move64(RDI, R14);
+            out.load(RSI, reg(in.a));
+            callRuntime(runtime.writeInt);
+            break;
+
+        case VMOp::WRITE_R:
+            out.move64(RDI, R14);
+            out.movss(0, reg(in.a));
+            callRuntime(runtime.writeReal);
+            break;
+
+        case VMOp::CALL:
+            out.move64(RDI, R14);
+            out.moveImm(RSI, in.a);
+            out.move64(RDX, RBX);
+            out.moveImm64(RCX, (uint64_t)(uintptr_t)&fn.lists[in.b + 1]);
+            out.moveImm64(R8, (uint64_t)(uintptr_t)&fn.lists[in.c + 1]);
+            callRuntime(runtime.call);
+            out.test8(RAX, RAX);
+            out.jump(CC_E, fail);
+            break;
+
+        case VMOp::JUMP:
+            jumpTo(in.a, at);
+            break;
+
+        case VMOp::BRANCH:
+            out.aluImm(ALU_CMP, reg(in.a), 0);
+            branch(CC_NE, in.b, in.c, at);
+            break;
+
+        case VMOp::RET:
+            out.load64(RAX, field(offsetof(NativeFrame, caller)));
+            out.load64(RCX, field(offsetof(NativeFrame, results)));
+
+            for (int i = 0; i < fn.lists[in.a]; ++i)
+            {
+                out.loadSigned32(RDX, Mem(RCX, i * (int)sizeof(int)));
+                out.load(RSI, reg(fn.lists[in.a + 1 + i]));
+                out.store(Mem(RAX, RDX, (int)sizeof(Slot), 0), RSI);
+            }
+
+            out.moveImm(RAX, 1);
+            out.jump(done);
+            break;
+        }
+    }
+
+    // sixteen bytes at a time, then the widest moves that fit what is left
+    void copyBytes(const VMInstr& in)
+    {
+        int offset = 0;
+
+        for (; offset + 16 <= in.c; offset += 16)
+        {
+            out.movups(0, at(in.b, offset));
+            out.movups(at(in.a, offset), 0);
+        }
+
+        for (; offset + 8 <= in.c; offset += 8)
+        {
+            out.load64(RAX, at(in.b, offset));
+            out.store64(at(in.a, offset), RAX);
+        }
+
+        for (; offset + 4 <= in.c; offset += 4)
+        {
+            out.load(RAX, at(in.b, offset));
+            out.store(at(in.a, offset), RAX);
+        }
+
+        if (offset < in.c)
+        {
+            out.loadSigned16(RAX, at(in.b, offset));
+            out.store16(at(in.a, offset), RAX);
+        }
+    }
+
+    // sixteen bytes per packed instruction, the lanes left over one at a time
+    void lanes(const VMInstr& in, bool real, bool subtract)
+    {
+        int lane = real ? 4 : 2;
+        int offset = 0;
+
+        for (; offset + 16 <= in.c * lane; offset += 16)
+        {
+            out.movups(0, at(in.a, offset));
+            out.movups(1, at(in.b, offset));
+
+            if (real && subtract)
+                out.subps(0, 1);
+            else if (real)
+                out.addps(0, 1);
+            else if (subtract)
+                out.psubw(0, 1);
+            else
+                out.paddw(0, 1);
+
+            out.movups(at(in.a, offset), 0);
+        }
+
+        for (; offset < in.c * lane; offset += lane)
+        {
+            if (real)
+            {
+                out.movss(0, at(in.a, offset));
+                out.sse(subtract ? SSE_SUB : SSE_ADD, 0, at(in.b, offset));
+                out.movss(at(in.a, offset), 0);
+            }
+            else
+            {
+                out.loadSigned16(RAX, at(in.a, offset));
+                out.loadSigned16(RCX, at(in.b, offset));
+                out.alu(subtract ? ALU_SUB : ALU_ADD, RAX, RCX);
+                out.store16(at(in.a, offset), RAX);
+            }
+        }
+    }
+
+    void intLogic(const VMInstr& in, int op)
+    {
+        out.load(RAX, reg(in.a));
+        out.alu(op, RAX, reg(in.b));
+        out.store(reg(in.dst), RAX);
+    }
+
+    vector<uint8_t> run()
+    {
+        // four pushes and 8 bytes keep rsp 16 byte aligned at the calls
+        out.push(RBX);
+        out.push(R12);
+        out.push(R13);
+        out.push(R14);
+        out.aluImm(ALU_SUB, RSP, 8, true);
+
+        out.move64(R12, RDI);
+        out.load64(RBX, field(offsetof(NativeFrame, regs)));
+        out.load64(R13, field(offsetof(NativeFrame, globals)));
+        out.moveImm64(R14, (uint64_t)(uintptr_t)runtime.machine);
+
+        fail = out.newLabel();
+        done = out.newLabel();
+        for (size_t i = 0; i < fn.code.size(); ++i)
+            labels.push_back(out.newLabel());
+
+        for (int i = 0; i < (int)fn.code.size(); ++i)
+        {
+            out.bind(labels[i]);
+            translate(i);
+        }
+
+        out.bind(fail);
+        out.alu(ALU_XOR, RAX, RAX);
+
+        out.bind(done);
+        out.aluImm(ALU_ADD, RSP, 8, true);
+        out.pop(R14);
+        out.pop(R13);
+        out.pop(R12);
+        out.pop(RBX);
+        out.ret();
+
+        return out.code;
+    }
+};
+
+unique_ptr<NativeFunction> compileNative(const VMFunction& fn, const JitRuntime& runtime)
+{
+    if (!jitAvailable())
+        return nullptr;
+
+    Translator translator(fn, runtime);
+    return mapExecutable(translator.run());
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "VM.h"
+#include <memory>
+
+// What compiled code calls back into the interpreter for. Every hook takes the opaque
+// machine pointer first, so plain function pointers do.
+struct JitRuntime
+{
+    void* machine;
+    bool (*call)(void* machine, int function, Slot* regs, const int* args, const int* results);
+    int32_t (*readInt)(void* machine);
+    float (*readReal)(void* machine);
+    void (*writeInt)(void* machine, int32_t value);
+    void (*writeReal)(void* machine, float value);
+};
+
+// One activation as compiled code receives it, the same memory the interpreter would use
+struct NativeFrame
+{
+    Slot* regs;                 // regCount registers, then frameSlots words of frame
+    Slot* caller;               // ARG and RET address the caller's registers through args/results
+    const int* args;
+    const int* results;
+    unsigned char* globals;
+    unsigned char* stack;       // what references are offsets from
+};
+
+// false when a call below failed at run time, after its message
+typedef bool (*NativeEntry)(NativeFrame*);
+
+// Machine code in pages of its own: mapped writable while it is copied in, then switched
+// to executable, never both at once.
+class NativeFunction
+{
+public:
+    NativeFunction(void* pages, size_t size) : pages(pages), size(size) {}
+    NativeFunction(const NativeFunction&) = delete;
+    NativeFunction& operator=(const NativeFunction&) = delete;
+    ~NativeFunction();
+
+    NativeEntry entry() const { return (NativeEntry)pages; }
+
+private:
+    void* pages;
+    size_t size;
+};
+
+// Only x86-64 Linux runs compiled code; elsewhere everything stays in the interpreter
+bool jitAvailable();
+
+// Translates one function's bytecode to x86-64, a fixed template per instruction over the
+// registers in memory, so frames look the same to both tiers. Null when unavailable.
+std::unique_ptr<NativeFunction> compileNative(const VMFunction&, const JitRuntime&);
@@ -21,6 +21,16 @@ std::ostream& operator<< (std::ostream& out, const Token& token)
 	return out;
 }
 
+void reportLexicalError(const Token& token)
+{
+	if (token.type == TokenType::TK_ERROR_LENGTH)
+		diagnosticLog.report(DiagCode::IDENTIFIER_TOO_LONG, token.line_number);
+	else if (token.type == TokenType::TK_ERROR_SYMBOL)
+		diagnosticLog.report(DiagCode::UNKNOWN_SYMBOL, token.line_number, { token.lexeme });
+	else if (token.type == TokenType::TK_ERROR_PATTERN)
+		diagnosticLog.report(DiagCode::UNKNOWN_PATTERN, token.line_number, { token.lexeme });
+}
+
 void loadDFA()
 {
 	std::ifstream dfaReader{ LexerLoc };
@@ -1,5 +1,6 @@
 #pragma once
 #include "Buffer.h"
+#include "Diagnostics.h"
 #include <fstream>
 #include <set>
 #include <string>
@@ -110,4 +111,7 @@ struct DFA
 extern DFA dfa;
 
 void loadDFA();
-Token* getNextToken(Buffer&);
\ No newline at end of file
+Token* getNextToken(Buffer&);
+
+// records a TK_ERROR_* token in diagnosticLog
+void reportLexicalError(const Token&);
\ No newline at end of file
@@ -0,0 +1,529 @@
+#include "Loops.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+using namespace std;
+
+vector<Loop> findLoops(const IRFunction& fn, const DominatorTree& tree)
+{
+    int count = (int)fn.blocks.size();
+    vector<Loop> loops;
+    vector<int> loopAt(count, -1);     // header -> its loop
+
+    for (int b : tree.order)
+        for (int succ : fn.blocks[b].succs)
+        {
+            if (!tree.dominates(succ, b))
+                continue;
+
+            if (loopAt[succ] < 0)
+            {
+                loopAt[succ] = (int)loops.size();
+                loops.emplace_back();
+                loops.back().header = succ;
+                loops.back().contains.assign(count, false);
+                loops.back().contains[succ] = true;
+            }
+
+            Loop& loop = loops[loopAt[succ]];
+            loop.latches.push_back(b);
+
+            vector<int> work{ b };
+            while (!work.empty())
+            {
+                int block = work.back();
+                work.pop_back();
+
+                if (loop.contains[block])
+                    continue;
+
+                loop.contains[block] = true;
+                for (int pred : fn.blocks[block].preds)
+                    work.push_back(pred);
+            }
+        }
+
+    for (auto& loop : loops)
+    {
+        for (int b : tree.order)
+            if (loop.contains[b])
+                loop.blocks.push_back(b);
+
+        int outside = -1, entries = 0;
+        for (int pred : fn.blocks[loop.header].preds)
+            if (!loop.contains[pred])
+            {
+                outside = pred;
+                ++entries;
+            }
+
+        if (entries == 1 && fn.blocks[outside].succs.size() == 1)
+            loop.preheader = outside;
+    }
+
+    stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+    return loops;
+}
+
+// Puts a new block between a header and the edges entering its loop from outside. Header
+// phis merging several outside edges leave those entries to a phi in the new block.
+void addPreheader(IRFunction& fn, const Loop& loop)
+{
+    int preheader = fn.newBlock();
+    vector<Instr> code;
+
+    for (auto& in : fn.blocks[loop.header].code)
+    {
+        if (in.op != Opcode::PHI)
+            continue;
+
+        vector<int> inside, outside;
+        for (int i = 0; i < fn.listSize(in.a); i += 2)
+        {
+            auto& entries = loop.contains[fn.listItems(in.a)[i]] ? inside : outside;
+            entries.push_back(fn.listItems(in.a)[i]);
+            entries.push_back(fn.listItems(in.a)[i + 1]);
+        }
+
+        int value = outside[1];
+        if (outside.size() > 2)
+        {
+            value = fn.newReg(in.type);
+            code.push_back({ Opcode::PHI, in.type, value, fn.newList(outside), -1, -1 });
+        }
+
+        inside.push_back(preheader);
+        inside.push_back(value);
+        in.a = fn.newList(inside);
+    }
+
+    code.push_back({ Opcode::JUMP, IRType::VOID, -1, loop.header, -1, -1 });
+    fn.blocks[preheader].code = move(code);
+
+    for (int pred : fn.blocks[loop.header].preds)
+    {
+        if (loop.contains[pred])
+            continue;
+
+        Instr& last = fn.blocks[pred].code.back();
+        if (last.op == Opcode::JUMP)
+            last.a = preheader;
+        else
+        {
+            if (last.b == loop.header)
+                last.b = preheader;
+            if (last.c == loop.header)
+                last.c = preheader;
+        }
+    }
+
+    buildCFG(fn);
+}
+
+// the loops of a function, each with a preheader; the entry block cannot head one
+vector<Loop> preparedLoops(IRFunction& fn)
+{
+    for (;;)
+    {
+        vector<Loop> loops = findLoops(fn, dominators(fn));
+
+        auto missing = find_if(loops.begin(), loops.end(), [](const Loop& loop) { return loop.preheader < 0 && loop.header != 0; });
+        if (missing == loops.end())
+        {
+            loops.erase(remove_if(loops.begin(), loops.end(), [](const Loop& loop) { return loop.preheader < 0; }), loops.end());
+            return loops;
+        }
+
+        addPreheader(fn, *missing);
+    }
+}
+
+// register -> the block defining it, -1 for none
+vector<int> definingBlocks(const IRFunction& fn)
+{
+    vector<int> block(fn.regs.size(), -1), regs;
+
+    for (int b = 0; b < (int)fn.blocks.size(); ++b)
+        for (auto& in : fn.blocks[b].code)
+        {
+            regs.clear();
+            defsOf(fn, in, regs);
+            for (int reg : regs)
+                block[reg] = b;
+        }
+
+    return block;
+}
+
+// register -> its CONST instruction's value, for the registers set by one
+unordered_map<int, int> constants(const IRFunction& fn)
+{
+    unordered_map<int, int> values;
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if (in.op == Opcode::CONST)
+                values[in.dst] = in.a;
+
+    return values;
+}
+
+void hoistInvariants(IRFunction& fn)
+{
+    vector<Loop> loops = preparedLoops(fn);
+    vector<int> defBlock = definingBlocks(fn);
+    unordered_map<int, int> constant = constants(fn);
+    vector<int> regs;
+
+    for (auto& loop : loops)
+    {
+        // a load stays when the loop may write what it reads; callees reach the globals, and
+        // the frame only through the references they are passed
+        bool writesFrame = false, writesGlobals = false;
+
+        for (int b : loop.blocks)
+            for (auto& in : fn.blocks[b].code)
+            {
+                bool writes = in.op == Opcode::STORE || isVector(in.op);
+                int area = isVector(in.op) ? addressArea(in.a) : in.a;
+
+                writesFrame |= writes && area == AREA_FRAME;
+                writesGlobals |= (writes && area == AREA_GLOBAL) || in.op == Opcode::CALL;
+
+                if (in.op == Opcode::CALL)
+                    for (int i = 0; i < fn.listSize(in.b); ++i)
+                        writesFrame |= fn.regs[fn.listItems(in.b)[i]] == IRType::REF;
+            }
+
+        auto invariant = [&](int reg) { return defBlock[reg] < 0 || !loop.contains[defBlock[reg]] || constant.count(reg); };
+
+        for (int b : loop.blocks)
+        {
+            vector<Instr> kept;
+
+            for (auto& in : fn.blocks[b].code)
+            {
+                // constants stay next to their uses, where the backends fold them into immediates
+                bool movable = (isPure(in.op) && in.op != Opcode::CONST) || in.op == Opcode::ADDR || in.op == Opcode::LOADREF
+                    || (in.op == Opcode::LOAD && !(in.a == AREA_FRAME ? writesFrame : writesGlobals));
+
+                regs.clear();
+                usesOf(fn, in, regs);
+
+                if (!movable || !all_of(regs.begin(), regs.end(), invariant))
+                {
+                    kept.push_back(in);
+                    continue;
+                }
+
+                auto& preheader = fn.blocks[loop.preheader].code;
+                Instr hoisted = in;
+
+                // a constant defined inside the loop is rematerialized in the preheader
+                rewriteUses(fn, hoisted, [&](int reg)
+                {
+                    if (defBlock[reg] < 0 || !loop.contains[defBlock[reg]])
+                        return reg;
+
+                    int copy = fn.newReg(fn.regs[reg]);
+                    preheader.insert(preheader.end() - 1, { Opcode::CONST, fn.regs[reg], copy, constant[reg], -1, -1 });
+                    defBlock.push_back(loop.preheader);
+                    return copy;
+                });
+
+                preheader.insert(preheader.end() - 1, hoisted);
+                defBlock[in.dst] = loop.preheader;
+            }
+
+            fn.blocks[b].code = move(kept);
+        }
+    }
+}
+
+// i = phi(init, next) in a loop header, with next = i + step or i - step for a constant step
+struct Induction
+{
+    int phi;
+    int init;
+    int next;
+    Opcode op;          // ADD or SUB
+    int step;
+    int update;         // the block computing next
+};
+
+vector<Induction> inductions(const IRFunction& fn, const Loop& loop, const unordered_map<int, int>& constant)
+{
+    vector<Induction> found;
+
+    if (loop.latches.size() != 1)
+        return found;
+
+    for (auto& phi : fn.blocks[loop.header].code)
+    {
+        if (phi.op != Opcode::PHI || phi.type != IRType::INT || fn.listSize(phi.a) != 4)
+            continue;
+
+        const int* items = fn.listItems(phi.a);
+        bool fromPreheader = items[0] == loop.preheader;
+        Induction iv{ phi.dst, items[fromPreheader ? 1 : 3], items[fromPreheader ? 3 : 1], Opcode::ADD, 0, -1 };
+
+        for (int b : loop.blocks)
+            for (auto& in : fn.blocks[b].code)
+            {
+                if (in.dst != iv.next || (in.op != Opcode::ADD && in.op != Opcode::SUB))
+                    continue;
+
+                int other = in.a == iv.phi ? in.b : in.op == Opcode::ADD && in.b == iv.phi ? in.a : -1;
+                auto step = constant.find(other);
+
+                if (other >= 0 && step != constant.end())
+                {
+                    iv.op = in.op;
+                    iv.step = step->second;
+                    iv.update = b;
+                }
+            }
+
+        if (iv.update >= 0)
+            found.push_back(iv);
+    }
+
+    return found;
+}
+
+void reduceStrength(IRFunction& fn)
+{
+    vector<Loop> loops = preparedLoops(fn);
+
+    for (auto& loop : loops)
+    {
+        vector<int> defBlock = definingBlocks(fn);
+        unordered_map<int, int> constant = constants(fn);
+        vector<Induction> ivs = inductions(fn, loop, constant);
+        map<pair<int, int>, pair<int, int>> reduced;   // (phi, factor) -> (running product, its next value)
+
+        if (ivs.empty())
+            continue;
+
+        for (int b : loop.blocks)
+            for (size_t k = 0; k < fn.blocks[b].code.size(); ++k)
+            {
+                Instr in = fn.blocks[b].code[k];
+                if (in.op != Opcode::MUL || in.type != IRType::INT)
+                    continue;
+
+                const Induction* iv = nullptr;
+                int factor = -1;
+                bool atNext = false;
+
+                for (auto& candidate : ivs)
+                    for (int side = 0; side < 2 && !iv; ++side)
+                    {
+                        int x = side ? in.b : in.a, y = side ? in.a : in.b;
+                        bool outside = defBlock[y] >= 0 && !loop.contains[defBlock[y]];
+
+                        if ((x == candidate.phi || x == candidate.next) && (outside || constant.count(y)))
+                        {
+                            iv = &candidate;
+                            factor = y;
+                            atNext = x == candidate.next;
+                        }
+                    }
+
+                if (!iv)
+                    continue;
+
+                auto& done = reduced[{ iv->phi, factor }];
+
+                if (!done.first)
+                {
+                    auto& preheader = fn.blocks[loop.preheader].code;
+                    vector<Instr> setup;
+
+                    if (defBlock[factor] >= 0 && loop.contains[defBlock[factor]])
+                    {
+                        int copy = fn.newReg(IRType::INT);
+                        setup.push_back({ Opcode::CONST, IRType::INT, copy, constant[factor], -1, -1 });
+                        factor = copy;
+                    }
+
+                    int start = fn.newReg(IRType::INT), step = fn.newReg(IRType::INT), delta = fn.newReg(IRType::INT);
+                    setup.push_back({ Opcode::MUL, IRType::INT, start, iv->init, factor, -1 });
+                    setup.push_back({ Opcode::CONST, IRType::INT, step, iv->step, -1, -1 });
+                    setup.push_back({ Opcode::MUL, IRType::INT, delta, factor, step, -1 });
+                    preheader.insert(preheader.end() - 1, setup.begin(), setup.end());
+
+                    // the product steps with the variable: (i + s) * k = i * k + s * k, also modulo 2^16
+                    int product = fn.newReg(IRType::INT), next = fn.newReg(IRType::INT);
+                    int latch = loop.latches[0];
+                    vector<int> entries{ loop.preheader, start, latch, next };
+                    auto& header = fn.blocks[loop.header].code;
+                    header.insert(header.begin(), { Opcode::PHI, IRType::INT, product, fn.newList(entries), -1, -1 });
+
+                    auto& update = fn.blocks[iv->update].code;
+                    auto at = find_if(update.begin(), update.end(), [&](const Instr& x) { return x.dst == iv->next; });
+                    update.insert(at + 1, { iv->op, IRType::INT, next, product, delta, -1 });
+
+                    done = { product, next };
+
+                    // the insertions may have shifted this instruction
+                    if (b == loop.header || b == iv->update)
+                        k = find_if(fn.blocks[b].code.begin(), fn.blocks[b].code.end(), [&](const Instr& x) { return x.dst == in.dst; }) - fn.blocks[b].code.begin();
+                }
+
+                fn.blocks[b].code[k] = { Opcode::COPY, IRType::INT, in.dst, atNext ? done.second : done.first, -1, -1 };
+            }
+    }
+}
+
+enum { UNROLL = 4, MAX_UNROLLED_BODY = 48 };
+
+void unrollLoops(IRFunction& fn)
+{
+    vector<Loop> loops = preparedLoops(fn);
+    vector<int> uses(fn.regs.size()), regs;
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+        {
+            regs.clear();
+            usesOf(fn, in, regs);
+            for (int reg : regs)
+                ++uses[reg];
+        }
+
+    for (auto& loop : loops)
+    {
+        // header: phis, i < n or i <= n, branch to the body or out; the body jumps back
+        if (loop.blocks.size() != 2 || loop.latches.size() != 1)
+            continue;
+
+        // blocks added by unrolling an earlier loop lie outside this one
+        loop.contains.resize(fn.blocks.size());
+
+        int header = loop.header, body = loop.latches[0], preheader = loop.preheader;
+        vector<int> defBlock = definingBlocks(fn);
+        const auto& headCode = fn.blocks[header].code;
+        const auto& bodyCode = fn.blocks[body].code;
+        size_t phis = find_if(headCode.begin(), headCode.end(), [](const Instr& in) { return in.op != Opcode::PHI; }) - headCode.begin();
+
+        if (headCode.size() != phis + 2 || bodyCode.size() > MAX_UNROLLED_BODY || bodyCode.back().op != Opcode::JUMP)
+            continue;
+
+        Instr test = headCode[phis], branch = headCode[phis + 1];
+        if (test.type != IRType::INT || branch.a != test.dst || branch.b != body || uses[test.dst] != 1)
+            continue;
+
+        // n >= i is i <= n
+        if (test.op == Opcode::GT || test.op == Opcode::GE)
+        {
+            swap(test.a, test.b);
+            test.op = test.op == Opcode::GT ? Opcode::LT : Opcode::LE;
+        }
+
+        if ((test.op != Opcode::LT && test.op != Opcode::LE) || (defBlock[test.b] >= 0 && loop.contains[defBlock[test.b]]))
+            continue;
+
+        unordered_map<int, int> constant = constants(fn);
+        vector<Induction> ivs = inductions(fn, loop, constant);
+        auto iv = find_if(ivs.begin(), ivs.end(), [&](const Induction& x) { return x.phi == test.a; });
+
+        if (iv == ivs.end() || iv->op != Opcode::ADD || iv->step <= 0 || iv->step > 64)
+            continue;
+
+        int span = (UNROLL - 1) * iv->step;
+        int unrolledHeader = fn.newBlock(), unrolledBody = fn.newBlock();
+        vector<Instr> original = fn.blocks[body].code;
+        vector<Instr> headerPhis(fn.blocks[header].code.begin(), fn.blocks[header].code.begin() + phis);
+
+        // the bodies run back to back while i + (UNROLL - 1) * step still passes the test
+        auto& pre = fn.blocks[preheader].code;
+        int spanReg = fn.newReg(IRType::INT), limit = fn.newReg(IRType::INT);
+        int lowest = fn.newReg(IRType::INT), fits = fn.newReg(IRType::BOOL);
+        pre.pop_back();
+        pre.push_back({ Opcode::CONST, IRType::INT, spanReg, span, -1, -1 });
+        pre.push_back({ Opcode::SUB, IRType::INT, limit, test.b, spanReg, -1 });
+        pre.push_back({ Opcode::CONST, IRType::INT, lowest, -32768 + span, -1, -1 });
+        pre.push_back({ Opcode::GE, IRType::INT, fits, test.b, lowest, -1 });
+        pre.push_back({ Opcode::BRANCH, IRType::VOID, -1, fits, unrolledHeader, header });
+
+        unordered_map<int, int> renamed;
+        auto lookup = [&](int reg) { auto found = renamed.find(reg); return found == renamed.end() ? reg : found->second; };
+        vector<int> unrolledPhis;
+
+        for (auto& phi : headerPhis)
+        {
+            unrolledPhis.push_back(fn.newReg(phi.type));
+            renamed[phi.dst] = unrolledPhis.back();
+        }
+
+        vector<Instr> code;
+
+        for (int copy = 0; copy < UNROLL; ++copy)
+        {
+            for (size_t k = 0; k + 1 < original.size(); ++k)
+            {
+                Instr in = original[k];
+
+                if (in.op == Opcode::CALL)
+                    in.b = fn.newList(vector<int>(fn.listItems(in.b), fn.listItems(in.b) + fn.listSize(in.b)));
+
+                rewriteUses(fn, in, lookup);
+
+                if (in.dst >= 0)
+                    renamed[original[k].dst] = in.dst = fn.newReg(fn.regs[in.dst]);
+                else if (in.op == Opcode::CALL)
+                {
+                    vector<int> results;
+                    for (int i = 0; i < fn.listSize(in.c); ++i)
+                    {
+                        int reg = fn.listItems(in.c)[i];
+                        results.push_back(renamed[reg] = fn.newReg(fn.regs[reg]));
+                    }
+                    in.c = fn.newList(results);
+                }
+
+                code.push_back(in);
+            }
+
+            // the next body starts from the values this one sends around the back edge
+            vector<int> carried;
+            for (auto& phi : headerPhis)
+                carried.push_back(lookup(fn.listItems(phi.a)[fn.listItems(phi.a)[0] == body ? 1 : 3]));
+
+            for (size_t p = 0; p < headerPhis.size(); ++p)
+                renamed[headerPhis[p].dst] = carried[p];
+        }
+
+        code.push_back({ Opcode::JUMP, IRType::VOID, -1, unrolledHeader, -1, -1 });
+        fn.blocks[unrolledBody].code = move(code);
+
+        // the unrolled loop hands its values to the original, which runs the remaining iterations
+        vector<Instr> head;
+        auto& headerCode = fn.blocks[header].code;
+
+        int counter = -1;
+
+        for (size_t p = 0; p < headerPhis.size(); ++p)
+        {
+            vector<int> entries(fn.listItems(headerPhis[p].a), fn.listItems(headerPhis[p].a) + 4);
+            int init = entries[entries[0] == preheader ? 1 : 3];
+            vector<int> unrolledEntries{ preheader, init, unrolledBody, renamed[headerPhis[p].dst] };
+            head.push_back({ Opcode::PHI, headerPhis[p].type, unrolledPhis[p], fn.newList(unrolledEntries), -1, -1 });
+
+            entries.push_back(unrolledHeader);
+            entries.push_back(unrolledPhis[p]);
+            headerCode[p].a = fn.newList(entries);
+
+            if (headerPhis[p].dst == test.a)
+                counter = unrolledPhis[p];
+        }
+
+        int unrolledTest = fn.newReg(IRType::BOOL);
+        head.push_back({ test.op, IRType::INT, unrolledTest, counter, limit, -1 });
+        head.push_back({ Opcode::BRANCH, IRType::VOID, -1, unrolledTest, unrolledBody, header });
+        fn.blocks[unrolledHeader].code = move(head);
+
+        buildCFG(fn);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "SSA.h"
+
+// A natural loop: the header and every block that reaches one of its back edges without
+// passing through the header. Back edges to one header make up a single loop.
+struct Loop
+{
+    int header;
+    int preheader = -1;             // the only block outside the loop jumping to the header, if any
+    std::vector<int> latches;       // sources of the back edges
+    std::vector<bool> contains;     // indexed by block
+    std::vector<int> blocks;        // in reverse postorder, header first
+};
+
+// innermost loops first
+std::vector<Loop> findLoops(const IRFunction&, const DominatorTree&);
+
+// the loops of a function after giving each a preheader, save those headed by the entry block
+std::vector<Loop> preparedLoops(IRFunction&);
+
+// Loop passes over SSA form. Each gives every loop a preheader first.
+void hoistInvariants(IRFunction&);  // moves pure code whose operands come from outside the loop to the preheader
+void reduceStrength(IRFunction&);   // i * k for an induction variable i becomes a running sum stepping by k
+void unrollLoops(IRFunction&);      // counted single-block loops run four bodies per bound check
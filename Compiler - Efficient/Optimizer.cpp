@@ -0,0 +1,649 @@
+#include "Optimizer.h"
+#include "Inliner.h"
+#include "Loops.h"
+#include "Promotion.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <set>
+#include <unordered_map>
+using namespace std;
+
+float asReal(int bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+int bitsOf(float value)
+{
+    int bits;
+    memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+
+// Evaluates a pure instruction on constant operands exactly as it runs: ints wrap at 16
+// bits, reals are single precision. False if the instruction does not compute a value.
+bool fold(const Instr& in, int a, int b, int& result)
+{
+    bool real = in.type == IRType::REAL;
+
+    switch (in.op)
+    {
+    case Opcode::CONST: result = in.a; return true;
+    case Opcode::COPY: result = a; return true;
+    case Opcode::ADD: result = real ? bitsOf(asReal(a) + asReal(b)) : (int16_t)(a + b); return true;
+    case Opcode::SUB: result = real ? bitsOf(asReal(a) - asReal(b)) : (int16_t)(a - b); return true;
+    case Opcode::MUL: result = real ? bitsOf(asReal(a) * asReal(b)) : (int16_t)(a * b); return true;
+    case Opcode::DIV: result = bitsOf(asReal(a) / asReal(b)); return true;
+    case Opcode::ITOF: result = bitsOf((float)a); return true;
+    case Opcode::LT: result = real ? asReal(a) < asReal(b) : a < b; return true;
+    case Opcode::LE: result = real ? asReal(a) <= asReal(b) : a <= b; return true;
+    case Opcode::EQ: result = real ? asReal(a) == asReal(b) : a == b; return true;
+    case Opcode::GT: result = real ? asReal(a) > asReal(b) : a > b; return true;
+    case Opcode::GE: result = real ? asReal(a) >= asReal(b) : a >= b; return true;
+    case Opcode::NE: result = real ? asReal(a) != asReal(b) : a != b; return true;
+    case Opcode::AND: result = a & b; return true;
+    case Opcode::OR: result = a | b; return true;
+    case Opcode::NOT: result = !a; return true;
+    default: return false;
+    }
+}
+
+bool hasSideEffects(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::STORE: case Opcode::READ: case Opcode::WRITE: case Opcode::CALL:
+    case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB: case Opcode::STOREREF:
+    case Opcode::JUMP: case Opcode::BRANCH: case Opcode::RET:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// register -> the register it was found equal to, followed to the end of the chain
+struct Replacements
+{
+    vector<int> to;
+
+    explicit Replacements(size_t count) : to(count, -1) {}
+
+    int find(int reg)
+    {
+        int root = reg;
+        while (to[root] >= 0)
+            root = to[root];
+
+        while (to[reg] >= 0)
+        {
+            int next = to[reg];
+            to[reg] = root == next ? next : root;
+            reg = next;
+        }
+
+        return root;
+    }
+
+    void apply(IRFunction& fn)
+    {
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+                rewriteUses(fn, in, [this](int reg) { return find(reg); });
+    }
+};
+
+void propagateCopies(IRFunction& fn)
+{
+    Replacements replace(fn.regs.size());
+
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+            {
+                if (in.dst < 0 || replace.to[in.dst] >= 0)
+                    continue;
+
+                if (in.op == Opcode::COPY && replace.find(in.a) != in.dst)
+                {
+                    replace.to[in.dst] = replace.find(in.a);
+                    changed = true;
+                }
+                else if (in.op == Opcode::PHI)
+                {
+                    // a phi whose inputs are all one value, or itself around a loop, is that value
+                    int unique = -1;
+                    bool trivial = true;
+
+                    for (int i = 1; i < fn.listSize(in.a) && trivial; i += 2)
+                    {
+                        int value = replace.find(fn.listItems(in.a)[i]);
+                        if (value == in.dst || value == unique)
+                            continue;
+
+                        trivial = unique < 0;
+                        unique = value;
+                    }
+
+                    if (trivial && unique >= 0)
+                    {
+                        replace.to[in.dst] = unique;
+                        changed = true;
+                    }
+                }
+            }
+    }
+
+    for (auto& block : fn.blocks)
+    {
+        auto& code = block.code;
+        code.erase(remove_if(code.begin(), code.end(), [&](const Instr& in)
+        {
+            return (in.op == Opcode::COPY || in.op == Opcode::PHI) && replace.to[in.dst] >= 0;
+        }), code.end());
+    }
+
+    replace.apply(fn);
+}
+
+// a lattice value of sparse conditional constant propagation
+struct Cell
+{
+    enum State : uint8_t { TOP, CONSTANT, BOTTOM } state = TOP;
+    int value = 0;
+};
+
+Cell meet(Cell x, Cell y)
+{
+    if (x.state == Cell::TOP)
+        return y;
+    if (y.state == Cell::TOP)
+        return x;
+    if (x.state == Cell::BOTTOM || y.state == Cell::BOTTOM || x.value != y.value)
+        return { Cell::BOTTOM, 0 };
+    return x;
+}
+
+struct ConstantPropagation
+{
+    IRFunction& fn;
+    vector<Cell> cells;
+    vector<vector<pair<int, int>>> users;   // instructions reading each register
+    vector<bool> executable;
+    set<pair<int, int>> edges;              // executable CFG edges
+    vector<pair<int, int>> flowWork;
+    vector<int> valueWork;
+
+    explicit ConstantPropagation(IRFunction& fn)
+        : fn(fn), cells(fn.regs.size()), users(fn.regs.size()), executable(fn.blocks.size())
+    {
+        vector<int> regs;
+
+        for (int b = 0; b < (int)fn.blocks.size(); ++b)
+            for (int i = 0; i < (int)fn.blocks[b].code.size(); ++i)
+            {
+                regs.clear();
+                usesOf(fn, fn.blocks[b].code[i], regs);
+
+                for (int reg : regs)
+                    users[reg].push_back({ b, i });
+            }
+    }
+
+    void lower(int reg, Cell cell)
+    {
+        Cell lowered = meet(cells[reg], cell);
+
+        if (lowered.state != cells[reg].state)
+        {
+            cells[reg] = lowered;
+            valueWork.push_back(reg);
+        }
+    }
+
+    void edge(int from, int to)
+    {
+        if (edges.insert({ from, to }).second)
+            flowWork.push_back({ from, to });
+    }
+
+    void visit(int b, int i)
+    {
+        const Instr& in = fn.blocks[b].code[i];
+
+        switch (in.op)
+        {
+        case Opcode::JUMP:
+            edge(b, in.a);
+            break;
+
+        case Opcode::BRANCH:
+        {
+            const Cell& condition = cells[in.a];
+
+            if (condition.state == Cell::CONSTANT)
+                edge(b, condition.value ? in.b : in.c);
+            else if (condition.state == Cell::BOTTOM)
+            {
+                edge(b, in.b);
+                edge(b, in.c);
+            }
+            break;
+        }
+
+        case Opcode::PHI:
+        {
+            Cell cell;
+
+            for (int k = 0; k < fn.listSize(in.a); k += 2)
+                if (edges.count({ fn.listItems(in.a)[k], b }))
+                    cell = meet(cell, cells[fn.listItems(in.a)[k + 1]]);
+
+            lower(in.dst, cell);
+            break;
+        }
+
+        case Opcode::CALL:
+            for (int k = 0; k < fn.listSize(in.c); ++k)
+                lower(fn.listItems(in.c)[k], { Cell::BOTTOM, 0 });
+            break;
+
+        case Opcode::LOAD: case Opcode::ARG: case Opcode::READ: case Opcode::ADDR: case Opcode::LOADREF:
+            lower(in.dst, { Cell::BOTTOM, 0 });
+            break;
+
+        case Opcode::STORE: case Opcode::WRITE: case Opcode::RET:
+        case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB: case Opcode::STOREREF:
+            break;
+
+        default:
+        {
+            Cell a = in.op == Opcode::CONST ? Cell{ Cell::CONSTANT, 0 } : cells[in.a];
+            Cell b = in.b >= 0 && in.op != Opcode::CONST ? cells[in.b] : Cell{ Cell::CONSTANT, 0 };
+            int result;
+
+            if (a.state == Cell::BOTTOM || b.state == Cell::BOTTOM)
+                lower(in.dst, { Cell::BOTTOM, 0 });
+            else if (a.state == Cell::CONSTANT && b.state == Cell::CONSTANT && fold(in, a.value, b.value, result))
+                lower(in.dst, { Cell::CONSTANT, result });
+        }
+        }
+    }
+
+    void solve()
+    {
+        edge(-1, 0);
+
+        while (!flowWork.empty() || !valueWork.empty())
+        {
+            while (!flowWork.empty())
+            {
+                int to = flowWork.back().second;
+                flowWork.pop_back();
+
+                bool first = !executable[to];
+                executable[to] = true;
+
+                // a block's first visit runs all of it, later edges only change its phis
+                for (int i = 0; i < (int)fn.blocks[to].code.size(); ++i)
+                    if (first || fn.blocks[to].code[i].op == Opcode::PHI)
+                        visit(to, i);
+            }
+
+            while (!valueWork.empty())
+            {
+                int reg = valueWork.back();
+                valueWork.pop_back();
+
+                for (auto& user : users[reg])
+                    if (executable[user.first])
+                        visit(user.first, user.second);
+            }
+        }
+    }
+
+    void rewrite()
+    {
+        for (int b = 0; b < (int)fn.blocks.size(); ++b)
+        {
+            if (!executable[b])
+                continue;
+
+            vector<Instr> phis, constants, rest;
+
+            for (auto& in : fn.blocks[b].code)
+            {
+                if (in.dst >= 0 && in.op != Opcode::CONST && cells[in.dst].state == Cell::CONSTANT)
+                    (in.op == Opcode::PHI ? constants : rest).push_back({ Opcode::CONST, fn.regs[in.dst], in.dst, cells[in.dst].value, -1, -1 });
+                else if (in.op == Opcode::PHI)
+                    phis.push_back(in);
+                else if (in.op == Opcode::BRANCH && cells[in.a].state == Cell::CONSTANT)
+                    rest.push_back({ Opcode::JUMP, IRType::VOID, -1, cells[in.a].value ? in.b : in.c, -1, -1 });
+                else
+                    rest.push_back(in);
+            }
+
+            phis.insert(phis.end(), constants.begin(), constants.end());
+            phis.insert(phis.end(), rest.begin(), rest.end());
+            fn.blocks[b].code = move(phis);
+        }
+
+        compactBlocks(fn, executable);
+    }
+};
+
+void propagateConstants(IRFunction& fn)
+{
+    ConstantPropagation sccp(fn);
+    sccp.solve();
+    sccp.rewrite();
+}
+
+struct ValueKey
+{
+    Opcode op;
+    IRType type;
+    int a;
+    int b;
+
+    bool operator==(const ValueKey& other) const
+    {
+        return op == other.op && type == other.type && a == other.a && b == other.b;
+    }
+};
+
+struct ValueKeyHash
+{
+    size_t operator()(const ValueKey& key) const
+    {
+        return (((size_t)key.op * 31 + (size_t)key.type) * 1000003 + (size_t)key.a) * 1000003 + (size_t)key.b;
+    }
+};
+
+// loads only go through the references a function's inputs came by, and nothing writes
+// what those point at while it runs, so they are as good as pure
+bool isNumbered(Opcode op)
+{
+    return (isPure(op) && op != Opcode::COPY) || op == Opcode::ADDR || op == Opcode::LOADREF;
+}
+
+bool isCommutative(Opcode op)
+{
+    return op == Opcode::ADD || op == Opcode::MUL || op == Opcode::EQ || op == Opcode::NE || op == Opcode::AND || op == Opcode::OR;
+}
+
+struct ValueNumbering
+{
+    IRFunction& fn;
+    const DominatorTree& tree;
+    Replacements replace;
+    unordered_map<ValueKey, int, ValueKeyHash> available;   // along the dominator tree path to the current block
+
+    ValueNumbering(IRFunction& fn, const DominatorTree& tree) : fn(fn), tree(tree), replace(fn.regs.size()) {}
+
+    void visit(int b)
+    {
+        vector<ValueKey> added;
+
+        for (auto& in : fn.blocks[b].code)
+        {
+            rewriteUses(fn, in, [this](int reg) { return replace.find(reg); });
+
+            if (!isNumbered(in.op))
+                continue;
+
+            ValueKey key{ in.op, in.type, in.a, in.op == Opcode::CONST ? -1 : in.b };
+            if (isCommutative(in.op) && key.a > key.b)
+                swap(key.a, key.b);
+
+            auto found = available.find(key);
+            if (found != available.end())
+                replace.to[in.dst] = found->second;
+            else
+            {
+                available.emplace(key, in.dst);
+                added.push_back(key);
+            }
+        }
+
+        for (int child : tree.children[b])
+            visit(child);
+
+        for (auto& key : added)
+            available.erase(key);
+    }
+};
+
+void numberValues(IRFunction& fn)
+{
+    DominatorTree tree = dominators(fn);
+    ValueNumbering numbering(fn, tree);
+
+    numbering.visit(0);
+
+    // phis read values from the ends of their predecessors, which may have been visited later
+    numbering.replace.apply(fn);
+}
+
+void eliminateDeadCode(IRFunction& fn)
+{
+    vector<const Instr*> definition(fn.regs.size());
+    vector<bool> live(fn.regs.size());
+    vector<int> work, regs;
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+        {
+            regs.clear();
+            defsOf(fn, in, regs);
+            for (int reg : regs)
+                definition[reg] = &in;
+        }
+
+    auto markUses = [&](const Instr& in)
+    {
+        regs.clear();
+        usesOf(fn, in, regs);
+
+        for (int reg : regs)
+            if (!live[reg])
+            {
+                live[reg] = true;
+                work.push_back(reg);
+            }
+    };
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if (hasSideEffects(in.op))
+                markUses(in);
+
+    while (!work.empty())
+    {
+        int reg = work.back();
+        work.pop_back();
+
+        if (definition[reg])
+            markUses(*definition[reg]);
+    }
+
+    for (auto& block : fn.blocks)
+    {
+        auto& code = block.code;
+        code.erase(remove_if(code.begin(), code.end(), [&](const Instr& in)
+        {
+            return !hasSideEffects(in.op) && in.dst >= 0 && !live[in.dst];
+        }), code.end());
+    }
+}
+
+void simplifyCFG(IRFunction& fn)
+{
+    int count = (int)fn.blocks.size();
+
+    for (auto& block : fn.blocks)
+    {
+        Instr& last = block.code.back();
+        if (last.op == Opcode::BRANCH && last.b == last.c)
+            last = { Opcode::JUMP, IRType::VOID, -1, last.b, -1, -1 };
+    }
+
+    buildCFG(fn);
+
+    // a block whose only successor has it as only predecessor absorbs that successor
+    vector<bool> keep(count, true);
+
+    for (int a = 0; a < count; ++a)
+    {
+        while (keep[a])
+        {
+            auto& code = fn.blocks[a].code;
+            int b = code.back().a;
+
+            if (code.back().op != Opcode::JUMP || b == a || b == 0 || fn.blocks[b].preds.size() != 1)
+                break;
+
+            code.pop_back();
+
+            // with a single predecessor a phi is a copy of its one input
+            for (auto& in : fn.blocks[b].code)
+            {
+                if (in.op == Opcode::PHI)
+                    code.push_back({ Opcode::COPY, in.type, in.dst, fn.listItems(in.a)[1], -1, -1 });
+                else
+                    code.push_back(in);
+            }
+
+            fn.blocks[b].code.clear();
+            fn.blocks[a].succs = fn.blocks[b].succs;
+            keep[b] = false;
+
+            for (int succ : fn.blocks[a].succs)
+            {
+                replace(fn.blocks[succ].preds.begin(), fn.blocks[succ].preds.end(), b, a);
+
+                for (auto& in : fn.blocks[succ].code)
+                    if (in.op == Opcode::PHI)
+                        for (int i = 0; i < fn.listSize(in.a); i += 2)
+                            if (fn.lists[in.a + 1 + i] == b)
+                                fn.lists[in.a + 1 + i] = a;
+            }
+        }
+    }
+
+    // whatever the entry cannot reach goes
+    vector<bool> reached(count);
+    vector<int> work{ 0 };
+    reached[0] = true;
+
+    while (!work.empty())
+    {
+        int b = work.back();
+        work.pop_back();
+
+        for (int succ : fn.blocks[b].succs)
+            if (!reached[succ])
+            {
+                reached[succ] = true;
+                work.push_back(succ);
+            }
+    }
+
+    for (int b = 0; b < count; ++b)
+        keep[b] = keep[b] && reached[b];
+
+    compactBlocks(fn, keep);
+
+    // what is left of jumps to jumps has more than one predecessor, the chains are merged
+    threadJumps(fn);
+    layoutBlocks(fn);
+}
+
+void PassManager::add(const string& name, Pass pass)
+{
+    addModulePass(name, [pass](IRModule& module)
+    {
+        for (auto& fn : module.functions)
+            pass(fn);
+    });
+}
+
+void PassManager::addModulePass(const string& name, ModulePass pass)
+{
+    passes.push_back({ name, pass, 0, 0 });
+}
+
+int instructionCount(const IRModule& module)
+{
+    int count = 0;
+
+    for (auto& fn : module.functions)
+        count += instructionCount(fn);
+
+    return count;
+}
+
+void PassManager::run(IRModule& module)
+{
+    initialInstructions = instructionCount(module);
+
+    for (auto& entry : passes)
+    {
+        auto start = chrono::steady_clock::now();
+
+        entry.pass(module);
+
+        entry.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        entry.instructions = instructionCount(module);
+    }
+}
+
+void PassManager::report(ostream& out) const
+{
+    double total = 0;
+
+    out << left << setw(16) << "pass" << right << setw(12) << "time (ms)" << setw(14) << "instructions" << endl;
+    out << left << setw(16) << "(lowered)" << right << setw(12) << "" << setw(14) << initialInstructions << endl;
+
+    for (auto& entry : passes)
+    {
+        out << left << setw(16) << entry.name << right << setw(12) << fixed << setprecision(3) << entry.seconds * 1000 << setw(14) << entry.instructions << endl;
+        total += entry.seconds;
+    }
+
+    out << left << setw(16) << "total" << right << setw(12) << total * 1000 << endl;
+}
+
+PassManager standardPipeline(const CallGraph& calls)
+{
+    PassManager passes;
+
+    passes.addModulePass("inline", [&calls](IRModule& module) { inlineCalls(module, calls); });
+    passes.add("promote-globals", promoteGlobals);
+    passes.add("sra", scalarizeRecords);
+    passes.add("ssa", buildSSA);
+    passes.add("sccp", propagateConstants);
+    passes.add("simplify-cfg", simplifyCFG);
+    passes.add("copy-prop", propagateCopies);
+    passes.add("gvn", numberValues);
+    passes.add("copy-prop", propagateCopies);
+    passes.add("licm", hoistInvariants);
+    passes.add("strength-reduce", reduceStrength);
+    passes.add("unroll", unrollLoops);
+    passes.add("sccp", propagateConstants);
+    passes.add("copy-prop", propagateCopies);
+    passes.add("gvn", numberValues);
+    passes.add("copy-prop", propagateCopies);
+    passes.add("dce", eliminateDeadCode);
+    passes.add("simplify-cfg", simplifyCFG);
+    passes.add("copy-prop", propagateCopies);
+    passes.add("out-of-ssa", leaveSSA);
+
+    return passes;
+}
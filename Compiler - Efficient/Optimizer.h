@@ -0,0 +1,45 @@
+#pragma once
+#include "CallGraph.h"
+#include "SSA.h"
+#include <functional>
+#include <ostream>
+#include <string>
+
+// Scalar passes over SSA form. Each leaves the function in SSA form with its CFG built.
+
+void propagateCopies(IRFunction&);      // uses of copies and of phis with one distinct input read the source
+void propagateConstants(IRFunction&);   // sparse conditional constant propagation (Wegman & Zadeck)
+void numberValues(IRFunction&);         // dominator scoped global value numbering of pure instructions
+void eliminateDeadCode(IRFunction&);    // drops pure instructions and phis whose results nobody reads
+void simplifyCFG(IRFunction&);          // folds branches with one target, drops unreachable blocks, merges chains, threads jumps, lays blocks out
+
+// Runs passes in order over a module, timing each and counting the instructions left
+// after it. A function pass runs over every function in turn.
+class PassManager
+{
+public:
+    typedef void (*Pass)(IRFunction&);
+    typedef std::function<void(IRModule&)> ModulePass;
+
+    void add(const std::string& name, Pass pass);
+    void addModulePass(const std::string& name, ModulePass pass);
+    void run(IRModule&);
+    void report(std::ostream&) const;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        ModulePass pass;
+        double seconds;
+        int instructions;
+    };
+
+    std::vector<Entry> passes;
+    int initialInstructions = 0;
+};
+
+// Inlining along the call graph, promotion of globals and records, SSA construction, the
+// scalar and loop passes, and back out of SSA for the backends. The graph must
+// outlive the pipeline.
+PassManager standardPipeline(const CallGraph&);
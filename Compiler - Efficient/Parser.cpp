@@ -1,4 +1,5 @@
 #include "Parser.h"
+#include "AST.h"
 #include <vector>
 #include <iostream>
 #include <iomanip>
@@ -309,6 +310,9 @@ void loadParser()
 			parser.symbolStr2symbolType[BUFF]);
 	}
 
+	parser.arithmeticExpression_index = parser.symbolStr2symbolType["arithmeticExpression"];
+	parser.booleanExpression_index = parser.symbolStr2symbolType["booleanExpression"];
+
 	parser.computeNullables();
 	parser.computeFirstSets();
 	parser.computeFollowSets();
@@ -350,6 +354,200 @@ void printStack(stack<int> st)
 	cerr << endl;
 }
 
+// Precedence climbing subparser for <arithmeticExpression> and <booleanExpression>.
+// The LL(1) grammar spells precedence out as term/expPrime/factor/termPrime chains, which
+// costs half a dozen parse tree nodes per operand; here the OperatorNode tree is built directly.
+
+struct ExpressionParser
+{
+	Buffer& buffer;
+	Token*& lookahead;
+	bool& isError;
+
+	TokenType peek() const
+	{
+		return lookahead->type;
+	}
+
+	void advance()
+	{
+		delete lookahead;
+		lookahead = getNextToken(buffer);
+
+		while (lookahead->type == TokenType::TK_ERROR_LENGTH ||
+			lookahead->type == TokenType::TK_ERROR_PATTERN ||
+			lookahead->type == TokenType::TK_ERROR_SYMBOL)
+		{
+			isError = true;
+			reportLexicalError(*lookahead);
+
+			delete lookahead;
+			lookahead = getNextToken(buffer);
+		}
+	}
+
+	bool expect(TokenType type)
+	{
+		if (peek() == type)
+		{
+			advance();
+			return true;
+		}
+
+		isError = true;
+		diagnosticLog.report(DiagCode::TOKEN_MISMATCH, lookahead->line_number, { dfa.tokenType2tokenStr[(int)peek()], lookahead->lexeme, dfa.tokenType2tokenStr[(int)type] });
+		return false;
+	}
+
+	ASTNode* leaf()
+	{
+		ASTNode* node = createLeaf(lookahead);
+		advance();
+		return node;
+	}
+
+	ASTNode* var()
+	{
+		// <var> ===> TK_NUM | TK_RNUM | TK_ID { TK_DOT TK_FIELDID }
+
+		if (peek() == TokenType::TK_NUM || peek() == TokenType::TK_RNUM)
+			return leaf();
+
+		if (peek() != TokenType::TK_ID)
+		{
+			isError = true;
+			diagnosticLog.report(DiagCode::INVALID_TOKEN, lookahead->line_number, { dfa.tokenType2tokenStr[(int)peek()], lookahead->lexeme, "var" });
+			return nullptr;
+		}
+
+		ASTNode* node = leaf();
+
+		while (peek() == TokenType::TK_DOT)
+		{
+			ASTNode* dot = leaf();
+			dot->children.resize(2);
+			dot->children[0] = node;
+
+			if (peek() == TokenType::TK_FIELDID)
+				dot->children[1] = leaf();
+			else
+				expect(TokenType::TK_FIELDID);
+
+			node = dot;
+		}
+
+		return node;
+	}
+
+	static int precedence(TokenType op)
+	{
+		if (op == TokenType::TK_PLUS || op == TokenType::TK_MINUS)
+			return 1;
+
+		if (op == TokenType::TK_MUL || op == TokenType::TK_DIV)
+			return 2;
+
+		return 0;
+	}
+
+	ASTNode* factor()
+	{
+		// <factor> ===> TK_OP <arithmeticExpression> TK_CL | <var>
+
+		if (peek() != TokenType::TK_OP)
+			return var();
+
+		advance();
+		ASTNode* node = arithmetic(1);
+		expect(TokenType::TK_CL);
+		return node;
+	}
+
+	ASTNode* arithmetic(int minPrecedence)
+	{
+		ASTNode* left = factor();
+
+		// every operator is left associative, so the right operand only takes tighter operators
+		for (int prec = precedence(peek()); prec && prec >= minPrecedence; prec = precedence(peek()))
+		{
+			ASTNode* op = leaf();
+			op->children.resize(2);
+			op->children[0] = left;
+			op->children[1] = arithmetic(prec + 1);
+			left = op;
+		}
+
+		return left;
+	}
+
+	static bool isRelational(TokenType op)
+	{
+		return op == TokenType::TK_LT || op == TokenType::TK_LE || op == TokenType::TK_EQ ||
+			op == TokenType::TK_GT || op == TokenType::TK_GE || op == TokenType::TK_NE;
+	}
+
+	ASTNode* parenthesisedBoolean()
+	{
+		expect(TokenType::TK_OP);
+		ASTNode* node = boolean();
+		expect(TokenType::TK_CL);
+		return node;
+	}
+
+	ASTNode* boolean()
+	{
+		// <booleanExpression> ===> TK_OP <booleanExpression> TK_CL <logicalOp> TK_OP <booleanExpression> TK_CL
+		//                       |  TK_NOT TK_OP <booleanExpression> TK_CL
+		//                       |  <var> <relationalOp> <var>
+
+		if (peek() == TokenType::TK_NOT)
+		{
+			ASTNode* op = leaf();
+			op->children.resize(1);
+			op->children[0] = parenthesisedBoolean();
+			return op;
+		}
+
+		if (peek() == TokenType::TK_OP)
+		{
+			ASTNode* left = parenthesisedBoolean();
+
+			if (peek() != TokenType::TK_AND && peek() != TokenType::TK_OR)
+			{
+				expect(TokenType::TK_AND);
+				return left;
+			}
+
+			ASTNode* op = leaf();
+			op->children.resize(2);
+			op->children[0] = left;
+			op->children[1] = parenthesisedBoolean();
+			return op;
+		}
+
+		ASTNode* left = var();
+
+		if (!isRelational(peek()))
+		{
+			expect(TokenType::TK_LT);
+			return left;
+		}
+
+		ASTNode* op = leaf();
+		op->children.resize(2);
+		op->children[0] = left;
+		op->children[1] = var();
+		return op;
+	}
+};
+
+ASTNode* parseExpression(Buffer& buffer, Token*& lookahead, bool isBoolean, bool& isError)
+{
+	ExpressionParser exprParser{ buffer, lookahead, isError };
+
+	return isBoolean ? exprParser.boolean() : exprParser.arithmetic(1);
+}
+
 ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 {
 	isError = false;
@@ -368,7 +566,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		if (lookahead->type == TokenType::TK_ERROR_LENGTH)
 		{
 			isError = true;
-			cerr << *lookahead << endl;
+			reportLexicalError(*lookahead);
 
 			lookahead = getNextToken(buffer);
 			continue;
@@ -376,7 +574,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		if (lookahead->type == TokenType::TK_ERROR_PATTERN)
 		{
 			isError = true;
-			cerr << *lookahead << endl;
+			reportLexicalError(*lookahead);
 
 			lookahead = getNextToken(buffer);
 			continue;
@@ -384,7 +582,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		if (lookahead->type == TokenType::TK_ERROR_SYMBOL)
 		{
 			isError = true;
-			cerr << *lookahead << endl;
+			reportLexicalError(*lookahead);
 
 			lookahead = getNextToken(buffer);
 			continue;
@@ -420,7 +618,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		if (stack_top < parser.num_terminals)
 		{
 			isError = true;
-			cerr << "Line " << line_number << "\t\terror: The token " << la_token << " for lexeme " << lexeme << " does not match with the expected token " << expected_token << endl;
+			diagnosticLog.report(DiagCode::TOKEN_MISMATCH, line_number, { la_token, lexeme, expected_token });
 			_pop(node, st);
 			continue;
 		}
@@ -429,6 +627,15 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 
 		int production_number = parser.parseTable[stack_top][input_terminal];
 
+		// expressions are handed over to the precedence climbing subparser
+		if (production_number >= 0 && (stack_top == parser.arithmeticExpression_index || stack_top == parser.booleanExpression_index))
+		{
+			node->productionNumber = production_number;
+			node->expression = parseExpression(buffer, lookahead, stack_top == parser.booleanExpression_index, isError);
+			_pop(node, st);
+			continue;
+		}
+
 		// if it is a valid production
 		if (production_number >= 0)
 		{
@@ -472,7 +679,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		if (production_number == -1)
 		{
 			isError = true;
-			cerr << "\t\terror: Invalid token " << la_token << " encountered with value " << lexeme << " stack top " << expected_token << endl;
+			diagnosticLog.report(DiagCode::INVALID_TOKEN, line_number, { la_token, lexeme, expected_token });
 			lookahead = getNextToken(buffer);
 			continue;
 		}
@@ -481,7 +688,7 @@ ParseTreeNode* parseInputSourceCode(Buffer& buffer, bool &isError)
 		assert(production_number == -2);
 
 		isError = true;
-		cerr << "Line " << line_number << "\t\terror: Invalid token " << la_token << " encountered with value " << lexeme << " stack top " << expected_token << endl;
+		diagnosticLog.report(DiagCode::INVALID_TOKEN, line_number, { la_token, lexeme, expected_token });
 		_pop(node, st);
 	}
 
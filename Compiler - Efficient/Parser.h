@@ -11,6 +11,8 @@ public:
 	int num_non_terminals;
 	int num_terminals;
 	int start_index;
+	int arithmeticExpression_index;
+	int booleanExpression_index;
 
 	std::vector<std::vector<int>> productions;
 	std::vector<std::string> symbolType2symbolStr;
@@ -20,7 +22,7 @@ public:
 	std::vector<std::bitset<128>> followSet;
 	std::vector<std::vector<int>> parseTable;
 
-	Parser() : num_non_terminals{ 0 }, num_terminals{ 0 }, start_index{ 0 }
+	Parser() : num_non_terminals{ 0 }, num_terminals{ 0 }, start_index{ 0 }, arithmeticExpression_index{ -1 }, booleanExpression_index{ -1 }
 	{
 
 	}
@@ -36,6 +38,8 @@ public:
 
 extern Parser parser;
 
+struct ASTNode;
+
 struct ParseTreeNode
 {
 	int symbol_index = 0;
@@ -44,6 +48,9 @@ struct ParseTreeNode
 
 	Token* token = nullptr;
 
+	// set instead of children for <arithmeticExpression> and <booleanExpression>
+	ASTNode* expression = nullptr;
+
 	int isLeaf = 0;
 	ParseTreeNode* parent = nullptr;
 	std::vector<ParseTreeNode*> children;
@@ -53,4 +60,6 @@ struct ParseTreeNode
 
 void loadParser();
 
+ASTNode* parseExpression(Buffer&, Token*&, bool, bool&);
+
 ParseTreeNode* parseInputSourceCode(Buffer&, bool&);
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "Promotion.h"
+#include "Loops.h"
+#include "SymbolTable.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <set>
+using namespace std;
+
+struct Field
+{
+    int offset;
+    IRType type;
+};
+
+// The type each (area, offset) is accessed with, from the instructions that name one. A
+// VCOPY of ints may be any record moved as 2 byte lanes, so it says nothing. Bytes a union
+// puts more than one type or width on are mixed: no one type is theirs.
+struct FieldTypes
+{
+    map<pair<int, int>, IRType> known;
+    set<pair<int, int>> mixed;
+
+    explicit FieldTypes(const IRFunction& fn)
+    {
+        map<pair<int, int>, int> extent;
+
+        auto access = [&](int area, int offset, IRType type)
+        {
+            auto found = known.find({ area, offset });
+            if (found != known.end() && found->second != type)
+                mixed.insert({ area, offset });
+
+            known[{ area, offset }] = type;
+            extent[{ area, offset }] = max(extent[{ area, offset }], width(type));
+        };
+
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+            {
+                if (in.op == Opcode::LOAD || in.op == Opcode::STORE)
+                    access(in.a, in.b, in.type);
+                else if (isVector(in.op) && !(in.op == Opcode::VCOPY && in.type == IRType::INT))
+                    for (int operand : { in.a, in.b })
+                        for (int lane = 0; lane < in.c; ++lane)
+                            access(addressArea(operand), addressOffset(operand) + lane * width(in.type), in.type);
+            }
+
+        for (auto i = extent.begin(); i != extent.end(); ++i)
+            for (auto j = next(i); j != extent.end() && j->first.first == i->first.first && j->first.second < i->first.second + i->second; ++j)
+            {
+                mixed.insert(i->first);
+                mixed.insert(j->first);
+            }
+    }
+
+    bool isReal(int address, int offset) const
+    {
+        pair<int, int> key{ addressArea(address), addressOffset(address) + offset };
+        auto found = known.find(key);
+        return found != known.end() && found->second == IRType::REAL && !mixed.count(key);
+    }
+
+    // bytes at a and b, same layout, as the fields either side is known to have; 2 byte
+    // ints where neither says or the bytes are mixed, which moves them unchanged
+    vector<Field> split(int a, int b, int bytes) const
+    {
+        vector<Field> fields;
+
+        for (int offset = 0; offset < bytes; )
+        {
+            bool real = offset + 4 <= bytes && (isReal(a, offset) || isReal(b, offset));
+            fields.push_back({ offset, real ? IRType::REAL : IRType::INT });
+            offset += width(fields.back().type);
+        }
+
+        return fields;
+    }
+};
+
+void scalarizeRecords(IRFunction& fn)
+{
+    FieldTypes types(fn);
+
+    for (auto& block : fn.blocks)
+    {
+        vector<Instr> code;
+
+        for (auto& in : block.code)
+        {
+            if (!isVector(in.op) || (addressArea(in.a) != AREA_FRAME && addressArea(in.b) != AREA_FRAME))
+            {
+                code.push_back(in);
+                continue;
+            }
+
+            vector<Field> fields;
+            if (in.op == Opcode::VCOPY && in.type == IRType::INT)
+                fields = types.split(in.a, in.b, in.c * width(in.type));
+            else
+                for (int lane = 0; lane < in.c; ++lane)
+                    fields.push_back({ lane * width(in.type), in.type });
+
+            for (auto& field : fields)
+            {
+                auto load = [&](int operand)
+                {
+                    int reg = fn.newReg(field.type);
+                    code.push_back({ Opcode::LOAD, field.type, reg, addressArea(operand), addressOffset(operand) + field.offset, -1 });
+                    return reg;
+                };
+
+                int value = load(in.b);
+
+                if (in.op != Opcode::VCOPY)
+                {
+                    int left = load(in.a);
+                    int result = fn.newReg(field.type);
+                    code.push_back({ in.op == Opcode::VADD ? Opcode::ADD : Opcode::SUB, field.type, result, left, value, -1 });
+                    value = result;
+                }
+
+                code.push_back({ Opcode::STORE, field.type, -1, addressArea(in.a), addressOffset(in.a) + field.offset, value });
+            }
+        }
+
+        block.code = move(code);
+    }
+
+    // Record scratch is shared by results of every type, which keeps its fields out of
+    // buildSSA's reach. Each (offset, type) that overlaps another gets a slot of its own
+    // when every load of it reads what a store of the same (offset, type) earlier in its
+    // block left there. A union read as another member than it was written fails that,
+    // and it and all it overlaps keep their bytes; so do records passed by reference.
+    set<pair<int, IRType>> accesses;
+    vector<pair<int, int>> taken;
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if (in.op == Opcode::ADDR)
+                taken.push_back({ in.a, in.a + in.b });
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_FRAME
+                && none_of(taken.begin(), taken.end(), [&](const pair<int, int>& range) { return range.first < in.b + width(in.type) && in.b < range.second; }))
+                accesses.insert({ in.b, in.type });
+
+    auto overlap = [](const pair<int, IRType>& a, const pair<int, IRType>& b)
+    {
+        return a.first < b.first + width(b.second) && b.first < a.first + width(a.second);
+    };
+
+    set<pair<int, IRType>> shared;
+
+    for (auto& block : fn.blocks)
+        for (size_t i = 0; i < block.code.size(); ++i)
+        {
+            const Instr& in = block.code[i];
+            pair<int, IRType> read{ in.b, in.type };
+
+            if (in.op != Opcode::LOAD || in.a != AREA_FRAME || !accesses.count(read))
+                continue;
+
+            // the nearest store to any of its bytes
+            bool fed = false;
+            for (size_t k = i; k-- > 0; )
+            {
+                const Instr& store = block.code[k];
+                pair<int, IRType> written{ store.b, store.type };
+
+                if (store.op == Opcode::STORE && store.a == AREA_FRAME && overlap(read, written))
+                {
+                    fed = written == read;
+                    break;
+                }
+            }
+
+            if (!fed)
+                shared.insert(read);
+        }
+
+    map<pair<int, IRType>, int> moved;
+    for (auto i = accesses.begin(); i != accesses.end(); ++i)
+        for (auto j = next(i); j != accesses.end() && j->first < i->first + width(i->second); ++j)
+            moved[*i] = moved[*j] = -1;
+
+    for (auto& read : shared)
+        for (auto i = moved.begin(); i != moved.end(); )
+            i = overlap(read, i->first) ? moved.erase(i) : next(i);
+
+    if (moved.empty())
+        return;
+
+    fn.frameSize = roundUp(fn.frameSize, 4);
+    for (auto& slot : moved)
+    {
+        slot.second = fn.frameSize;
+        fn.frameSize += width(slot.first.second);
+    }
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_FRAME)
+            {
+                auto found = moved.find({ in.b, in.type });
+                if (found != moved.end())
+                    in.b = found->second;
+            }
+}
+
+// Moves the globals a region touches into a new frame area: copied in at the end of the
+// preheader, or at the start of the function when there is none, and the fields the region
+// writes copied back on every edge out of it and before every RET in it.
+void shadowGlobals(IRFunction& fn, const vector<bool>& inside, int preheader)
+{
+    auto isInside = [&](int b) { return b < (int)inside.size() && inside[b]; };
+
+    int lo = INT_MAX, hi = 0;
+    vector<pair<int, int>> touched, written;
+
+    auto touch = [&](int offset, int bytes, bool writes)
+    {
+        lo = min(lo, offset);
+        hi = max(hi, offset + bytes);
+        touched.push_back({ offset, offset + bytes });
+        if (writes)
+            written.push_back({ offset, offset + bytes });
+    };
+
+    for (int b = 0; b < (int)fn.blocks.size(); ++b)
+        for (auto& in : fn.blocks[b].code)
+        {
+            if (!isInside(b))
+                break;
+
+            if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_GLOBAL)
+                touch(in.b, width(in.type), in.op == Opcode::STORE);
+            else if (isVector(in.op))
+            {
+                if (addressArea(in.a) == AREA_GLOBAL)
+                    touch(addressOffset(in.a), in.c * width(in.type), true);
+                if (addressArea(in.b) == AREA_GLOBAL)
+                    touch(addressOffset(in.b), in.c * width(in.type), false);
+            }
+        }
+
+    if (touched.empty())
+        return;
+
+    // the copy keeps the globals' alignment
+    lo -= lo % 4;
+    int base = roundUp(fn.frameSize, 4) - lo;
+    fn.frameSize = base + hi;
+
+    FieldTypes types(fn);
+    vector<Field> fields = types.split(address(AREA_GLOBAL, lo), address(AREA_GLOBAL, lo), hi - lo);
+
+    auto overlaps = [](const vector<pair<int, int>>& ranges, int from, int to)
+    {
+        for (auto& range : ranges)
+            if (range.first < to && from < range.second)
+                return true;
+        return false;
+    };
+
+    vector<Instr> copyIn;
+    vector<Field> copyOut;
+
+    for (auto& field : fields)
+    {
+        int at = lo + field.offset;
+        if (!overlaps(touched, at, at + width(field.type)))
+            continue;
+
+        int reg = fn.newReg(field.type);
+        copyIn.push_back({ Opcode::LOAD, field.type, reg, AREA_GLOBAL, at, -1 });
+        copyIn.push_back({ Opcode::STORE, field.type, -1, AREA_FRAME, base + at, reg });
+
+        if (overlaps(written, at, at + width(field.type)))
+            copyOut.push_back({ at, field.type });
+    }
+
+    // each exit copies with registers of its own, every register keeps a single definition
+    auto writeBack = [&](vector<Instr>& code)
+    {
+        for (auto& field : copyOut)
+        {
+            int reg = fn.newReg(field.type);
+            code.push_back({ Opcode::LOAD, field.type, reg, AREA_FRAME, base + field.offset, -1 });
+            code.push_back({ Opcode::STORE, field.type, -1, AREA_GLOBAL, field.offset, reg });
+        }
+    };
+
+    int count = (int)fn.blocks.size();
+
+    for (int b = 0; b < count; ++b)
+    {
+        if (!isInside(b))
+            continue;
+
+        for (auto& in : fn.blocks[b].code)
+        {
+            if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_GLOBAL)
+            {
+                in.a = AREA_FRAME;
+                in.b += base;
+            }
+            else if (isVector(in.op))
+            {
+                if (addressArea(in.a) == AREA_GLOBAL)
+                    in.a = address(AREA_FRAME, base + addressOffset(in.a));
+                if (addressArea(in.b) == AREA_GLOBAL)
+                    in.b = address(AREA_FRAME, base + addressOffset(in.b));
+            }
+        }
+
+        auto& code = fn.blocks[b].code;
+        if (code.back().op == Opcode::RET)
+        {
+            vector<Instr> back;
+            writeBack(back);
+            code.insert(code.end() - 1, back.begin(), back.end());
+            continue;
+        }
+
+        if (preheader < 0)
+            continue;
+
+        // a block on each edge leaving the loop; a branch with both edges to one block takes
+        // a single one
+        Instr last = code.back();
+        int targets[] = { last.op == Opcode::JUMP ? last.a : last.b, last.op == Opcode::BRANCH ? last.c : -1 };
+        int exits[] = { -1, -1 };
+
+        for (int t = 0; t < 2; ++t)
+        {
+            if (targets[t] < 0 || isInside(targets[t]))
+                continue;
+
+            if (t == 1 && targets[1] == targets[0])
+            {
+                exits[1] = exits[0];
+                continue;
+            }
+
+            exits[t] = fn.newBlock();
+            writeBack(fn.blocks[exits[t]].code);
+            fn.blocks[exits[t]].code.push_back({ Opcode::JUMP, IRType::VOID, -1, targets[t], -1, -1 });
+        }
+
+        Instr& rewired = fn.blocks[b].code.back();
+        if (exits[0] >= 0)
+            (rewired.op == Opcode::JUMP ? rewired.a : rewired.b) = exits[0];
+        if (exits[1] >= 0)
+            rewired.c = exits[1];
+    }
+
+    auto& entry = fn.blocks[preheader < 0 ? 0 : preheader].code;
+    entry.insert(preheader < 0 ? entry.begin() : entry.end() - 1, copyIn.begin(), copyIn.end());
+
+    buildCFG(fn);
+}
+
+void promoteGlobals(IRFunction& fn)
+{
+    bool calls = false;
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            calls |= in.op == Opcode::CALL;
+
+    if (!calls)
+    {
+        shadowGlobals(fn, vector<bool>(fn.blocks.size(), true), -1);
+        return;
+    }
+
+    // outermost first: a loop without calls takes the ones inside it along
+    vector<Loop> loops = preparedLoops(fn);
+    vector<bool> covered(fn.blocks.size());
+
+    for (auto loop = loops.rbegin(); loop != loops.rend(); ++loop)
+    {
+        bool callFree = true;
+        for (int b : loop->blocks)
+            for (auto& in : fn.blocks[b].code)
+                callFree &= in.op != Opcode::CALL;
+
+        if (!callFree || covered[loop->header])
+            continue;
+
+        for (int b : loop->blocks)
+            covered[b] = true;
+
+        shadowGlobals(fn, loop->contains, loop->preheader);
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "IR.h"
+
+// Passes that run before SSA construction and move memory where buildSSA can turn it into
+// registers. Neither promotes anything itself.
+
+// Scalar replacement of records: a V instruction with an operand in the frame becomes one
+// LOAD, op and STORE per field, so each field of a local record is a scalar slot of its own.
+// Nothing outside a function can see its frame, so every local record qualifies. Those on
+// globals only stay vector instructions. Frame slots reused with another type, as record
+// scratch is, are split apart.
+void scalarizeRecords(IRFunction&);
+
+// Globals read or written in a region without calls, a whole function or else the outermost
+// call free loops, are copied into the frame on entry to it and back out on leaving it, and
+// the region works on the copy. Only a call could see the global in between.
+void promoteGlobals(IRFunction&);
@@ -0,0 +1,141 @@
+#include "Pruning.h"
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+using namespace std;
+
+vector<const ASTNode*> programFunctions(const ASTNode* program)
+{
+    // program -> functions, main
+    vector<const ASTNode*> functions;
+
+    for (auto func = program->children[0]; func; func = func->sibling)
+        functions.push_back(func);
+
+    functions.push_back(program->children[1]);
+    return functions;
+}
+
+FuncEntry* entryOf(const ASTNode* function)
+{
+    return globalSymbolTable.lookup(static_cast<const FuncNode*>(function)->Name)->function();
+}
+
+void collectCallees(const ASTNode* node, vector<const FuncEntry*>& callees)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::FUNCTIONCALL)
+        {
+            TypeLog* callee = globalSymbolTable.lookup(static_cast<const FunctionCallNode*>(node)->name);
+            if (callee && callee->entryType == TypeTag::FUNCTION)
+                callees.push_back(callee->function());
+        }
+
+        for (auto child : node->children)
+            collectCallees(child, callees);
+    }
+}
+
+void pruneFunctions(ASTNode* program)
+{
+    vector<const ASTNode*> functions = programFunctions(program);
+    unordered_map<const FuncEntry*, const ASTNode*> nodeOf;
+
+    for (auto func : functions)
+        nodeOf[entryOf(func)] = func;
+
+    // breadth first from main over the calls each reached body makes
+    unordered_set<const ASTNode*> reached{ program->children[1] };
+    vector<const ASTNode*> pending{ program->children[1] };
+
+    while (!pending.empty())
+    {
+        const ASTNode* func = pending.back();
+        pending.pop_back();
+
+        vector<const FuncEntry*> callees;
+        collectCallees(func->children[2], callees);
+
+        for (auto callee : callees)
+        {
+            auto it = nodeOf.find(callee);
+            if (it != nodeOf.end() && reached.insert(it->second).second)
+                pending.push_back(it->second);
+        }
+    }
+
+    ASTNode** link = &program->children[0];
+
+    while (*link)
+    {
+        if (reached.count(*link))
+            link = &(*link)->sibling;
+        else
+            *link = (*link)->sibling;
+    }
+
+    cerr << "pruned " << functions.size() - reached.size() << " of " << functions.size() << " functions" << endl;
+}
+
+// globals named by one function body, walked the way bindNames walks it
+void collectGlobals(const ASTNode* node, const SymbolTable& scope, unordered_set<const VariableEntry*>& used)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::ID)
+        {
+            TypeLog* log = scope.lookup(static_cast<const IDNode*>(node)->symbol);
+            if (log && log->entryType == TypeTag::VARIABLE && log->variable()->isGlobal)
+                used.insert(log->variable());
+            continue;
+        }
+
+        if (node->type == NonTerminalType::OPERATOR && static_cast<const OperatorNode*>(node)->op == TokenType::TK_DOT)
+        {
+            // the field name itself is no variable, the root of the access on the left is
+            collectGlobals(node->children[0], scope, used);
+            continue;
+        }
+
+        if (node->type == NonTerminalType::STMTS)
+        {
+            // stmts -> .. .. stmt return
+            collectGlobals(node->children[2], scope, used);
+            collectGlobals(node->children[3], scope, used);
+            continue;
+        }
+
+        if (node->type == NonTerminalType::ASSIGNMENT)
+            collectGlobals(static_cast<const AssignmentNode*>(node)->target, scope, used);
+        else if (node->type == NonTerminalType::READ)
+            collectGlobals(static_cast<const ReadNode*>(node)->target, scope, used);
+        else if (node->type == NonTerminalType::WRITE)
+            collectGlobals(static_cast<const WriteNode*>(node)->target, scope, used);
+
+        for (auto child : node->children)
+            collectGlobals(child, scope, used);
+    }
+}
+
+void pruneGlobals(const ASTNode* program)
+{
+    unordered_set<const VariableEntry*> used;
+
+    for (auto func : programFunctions(program))
+    {
+        FuncEntry* entry = entryOf(func);
+        collectGlobals(func->children[2], entry->symbolTable, used);
+    }
+
+    size_t declared = globalVariables.size();
+    vector<VariableEntry*> kept;
+
+    for (auto var : globalVariables)
+        if (used.count(var))
+            kept.push_back(var);
+
+    globalVariables.swap(kept);
+
+    cerr << "pruned " << declared - globalVariables.size() << " of " << declared << " globals" << endl;
+}
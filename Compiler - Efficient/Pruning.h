@@ -0,0 +1,13 @@
+#pragma once
+#include "SymbolTable.h"
+
+// Unlinks every function _main cannot reach through calls from the program, so nothing
+// after it binds, lowers or emits them. Runs once checkFunctions accepted the program, so
+// unreached functions are still checked and every call names a function.
+void pruneFunctions(ASTNode* program);
+
+// Drops the global variables no function left in the program names from globalVariables,
+// so they take no room in the global area. Needs the locals checkFunctions declares, to
+// tell a global from a local of the same name, and must run before bindNames.
+// Record types stay declared: they have no storage or code of their own to remove.
+void pruneGlobals(const ASTNode* program);
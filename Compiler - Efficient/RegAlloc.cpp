@@ -0,0 +1,240 @@
+#include "RegAlloc.h"
+#include <algorithm>
+#include <cstdint>
+using namespace std;
+
+// caller saved ones first, so values that do not live across a call leave the callee
+// saved registers free and need no save in the prologue
+const int gprPool[] = { RSI, RDI, R8, R9, R10, RBX, R12, R13, R14, R15 };
+
+bool isCalleeSaved(int reg)
+{
+    return reg == RBX || reg >= R12;
+}
+
+bool isCall(Opcode op)
+{
+    return op == Opcode::CALL || op == Opcode::READ || op == Opcode::WRITE;
+}
+
+// a set of registers, one bit each
+struct RegSet
+{
+    vector<uint64_t> bits;
+
+    explicit RegSet(size_t count) : bits((count + 63) / 64) {}
+
+    bool has(int reg) const { return (bits[reg / 64] >> (reg % 64)) & 1; }
+    void add(int reg) { bits[reg / 64] |= 1ull << (reg % 64); }
+    void remove(int reg) { bits[reg / 64] &= ~(1ull << (reg % 64)); }
+
+    // this |= other & ~minus, true if anything was added
+    bool merge(const RegSet& other, const RegSet* minus = nullptr)
+    {
+        bool changed = false;
+
+        for (size_t i = 0; i < bits.size(); ++i)
+        {
+            uint64_t add = other.bits[i] & ~(minus ? minus->bits[i] : 0) & ~bits[i];
+            bits[i] |= add;
+            changed |= add != 0;
+        }
+
+        return changed;
+    }
+};
+
+vector<LiveInterval> liveIntervals(const IRFunction& fn)
+{
+    size_t regCount = fn.regs.size();
+    size_t blockCount = fn.blocks.size();
+
+    vector<RegSet> use(blockCount, RegSet(regCount)), def(blockCount, RegSet(regCount));
+    vector<RegSet> liveIn(blockCount, RegSet(regCount)), liveOut(blockCount, RegSet(regCount));
+    vector<int> first(blockCount), last(blockCount), calls;
+
+    vector<LiveInterval> intervals(regCount);
+    for (size_t r = 0; r < regCount; ++r)
+        intervals[r] = { (int)r, INT32_MAX, -1, false };
+
+    auto touch = [&](int reg, int position)
+    {
+        intervals[reg].start = min(intervals[reg].start, position);
+        intervals[reg].end = max(intervals[reg].end, position);
+    };
+
+    // number the instructions in block order, and collect upward exposed uses and defs
+    vector<int> regs;
+    int position = 0;
+
+    for (size_t b = 0; b < blockCount; ++b)
+    {
+        first[b] = position;
+
+        for (auto& in : fn.blocks[b].code)
+        {
+            regs.clear();
+            usesOf(fn, in, regs);
+            for (int reg : regs)
+            {
+                if (!def[b].has(reg))
+                    use[b].add(reg);
+                touch(reg, position);
+            }
+
+            regs.clear();
+            defsOf(fn, in, regs);
+            for (int reg : regs)
+            {
+                def[b].add(reg);
+                touch(reg, position);
+            }
+
+            if (isCall(in.op))
+                calls.push_back(position);
+
+            position += 2;
+        }
+
+        last[b] = position - 2;
+    }
+
+    // live out = union of the successors' live in, live in = use + (live out - def)
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+
+        for (size_t b = blockCount; b-- > 0; )
+        {
+            for (int succ : fn.blocks[b].succs)
+                liveOut[b].merge(liveIn[succ]);
+
+            changed |= liveIn[b].merge(use[b]);
+            changed |= liveIn[b].merge(liveOut[b], &def[b]);
+        }
+    }
+
+    for (size_t b = 0; b < blockCount; ++b)
+        for (size_t r = 0; r < regCount; ++r)
+        {
+            if (liveIn[b].has((int)r))
+                touch((int)r, first[b]);
+            if (liveOut[b].has((int)r))
+                touch((int)r, last[b]);
+        }
+
+    vector<LiveInterval> result;
+
+    for (auto& interval : intervals)
+    {
+        if (interval.end < 0)
+            continue;
+
+        // a call at the start defines the interval, one at the end reads it: neither clobbers it
+        auto after = upper_bound(calls.begin(), calls.end(), interval.start);
+        interval.crossesCall = after != calls.end() && *after < interval.end;
+        result.push_back(interval);
+    }
+
+    stable_sort(result.begin(), result.end(), [](const LiveInterval& x, const LiveInterval& y) { return x.start < y.start; });
+    return result;
+}
+
+Allocation allocateRegisters(const IRFunction& fn)
+{
+    Allocation alloc;
+    alloc.location.assign(fn.regs.size(), -1);
+    alloc.slot.assign(fn.regs.size(), -1);
+
+    vector<LiveInterval> intervals = liveIntervals(fn);
+    vector<const LiveInterval*> active;     // holding a register, by increasing end
+    bool gprFree[16], xmmFree[16];
+    bool used[16] = {};
+
+    fill(begin(gprFree), end(gprFree), false);
+    fill(begin(xmmFree), end(xmmFree), false);
+
+    for (int reg : gprPool)
+        gprFree[reg] = true;
+    for (int reg = 0; reg < SCRATCH_XMM; ++reg)
+        xmmFree[reg] = true;
+
+    auto isReal = [&](int reg) { return fn.regs[reg] == IRType::REAL; };
+    auto freeSet = [&](int reg) { return isReal(reg) ? xmmFree : gprFree; };
+    auto fits = [&](const LiveInterval& interval, int reg)
+    {
+        return !interval.crossesCall || (!isReal(interval.reg) && isCalleeSaved(reg));
+    };
+    auto spill = [&](int reg)
+    {
+        alloc.location[reg] = -1;
+        alloc.slot[reg] = alloc.spillSlots++;
+    };
+
+    for (auto& interval : intervals)
+    {
+        // expire the intervals that ended; one ending here may hand its register to this one,
+        // since an instruction reads all its operands before it writes its result
+        while (!active.empty() && active.front()->end <= interval.start)
+        {
+            int reg = active.front()->reg;
+            freeSet(reg)[alloc.location[reg]] = true;
+            active.erase(active.begin());
+        }
+
+        bool* free = freeSet(interval.reg);
+        int chosen = -1;
+
+        if (isReal(interval.reg))
+        {
+            for (int reg = 0; reg < SCRATCH_XMM && chosen < 0; ++reg)
+                if (free[reg] && fits(interval, reg))
+                    chosen = reg;
+        }
+        else
+        {
+            for (int reg : gprPool)
+                if (free[reg] && fits(interval, reg))
+                {
+                    chosen = reg;
+                    break;
+                }
+        }
+
+        if (chosen < 0)
+        {
+            // steal from the active interval of the same class that ends last, if it outlives this one
+            const LiveInterval* victim = nullptr;
+
+            for (auto other : active)
+                if (isReal(other->reg) == isReal(interval.reg) && fits(interval, alloc.location[other->reg]))
+                    if (!victim || other->end > victim->end)
+                        victim = other;
+
+            if (!victim || victim->end <= interval.end)
+            {
+                spill(interval.reg);
+                continue;
+            }
+
+            chosen = alloc.location[victim->reg];
+            spill(victim->reg);
+            active.erase(find(active.begin(), active.end(), victim));
+        }
+        else
+            free[chosen] = false;
+
+        alloc.location[interval.reg] = chosen;
+        if (!isReal(interval.reg))
+            used[chosen] = true;
+
+        active.insert(upper_bound(active.begin(), active.end(), &interval,
+            [](const LiveInterval* x, const LiveInterval* y) { return x->end < y->end; }), &interval);
+    }
+
+    for (int reg : gprPool)
+        if (used[reg] && isCalleeSaved(reg))
+            alloc.calleeSaved.push_back(reg);
+
+    return alloc;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "IR.h"
+#include "X86Encoder.h"
+
+// INT, BOOL and REF registers live in general purpose registers, REAL ones in xmm0..xmm13.
+// RAX, RCX, RDX, R11, xmm14 and xmm15 are never handed out: code generation uses them
+// as scratch, for operands that were spilled, for calls into the runtime and for int results.
+enum { SCRATCH_XMM = 14 };
+
+struct LiveInterval
+{
+    int reg;
+    int start;      // position of the first definition, positions count 2 per instruction
+    int end;        // position of the last use
+    bool crossesCall;
+};
+
+struct Allocation
+{
+    std::vector<int> location;      // Gpr or xmm number of every virtual register, -1 if spilled
+    std::vector<int> slot;          // its 8 byte spill slot, -1 if in a register
+    int spillSlots = 0;
+    std::vector<int> calleeSaved;   // callee saved registers the function writes
+};
+
+// instructions that call out and clobber every caller saved register
+bool isCall(Opcode);
+
+// One interval per register, from its first definition to its last use, stretched over
+// every block it is live through, in order of start
+std::vector<LiveInterval> liveIntervals(const IRFunction&);
+
+// Linear scan (Poletto & Sarkar): walks the intervals by start, freeing registers of the
+// ones that ended; when none is free the interval that ends last is spilled. An interval
+// live across a call may only take a callee saved register, so reals across calls spill.
+Allocation allocateRegisters(const IRFunction&);
@@ -0,0 +1,180 @@
+#include "Runtime.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+char ProgramIO::peek(size_t offset)
+{
+    while (next + offset >= input.size())
+    {
+        // waits for one byte at most, then takes what the stream already holds, so a line
+        // typed at a terminal is read without waiting for a whole chunk
+        streambuf* source = in.rdbuf();
+
+        if (!in || source->sgetc() == char_traits<char>::eof())
+        {
+            in.setstate(ios::eofbit | ios::failbit);
+            return 0;
+        }
+
+        // what is read already is no longer needed
+        input.erase(input.begin(), input.begin() + next);
+        next = 0;
+
+        streamsize available = min<streamsize>(max<streamsize>(source->in_avail(), 1), CHUNK);
+        size_t kept = input.size();
+        input.resize(kept + (size_t)available);
+        input.resize(kept + (size_t)source->sgetn(&input[kept], available));
+    }
+
+    return input[next + offset];
+}
+
+size_t ProgramIO::number(bool real)
+{
+    while (isspace((unsigned char)peek(0)))
+        ++next;
+
+    size_t length = 0;
+    size_t digits = 0;
+
+    auto sign = [&]()
+    {
+        if (peek(length) == '+' || peek(length) == '-')
+            ++length;
+    };
+
+    auto run = [&]()
+    {
+        while (isdigit((unsigned char)peek(length)))
+        {
+            ++length;
+            ++digits;
+        }
+    };
+
+    sign();
+    run();
+
+    if (real)
+    {
+        if (peek(length) == '.')
+        {
+            ++length;
+            run();
+        }
+
+        // an exponent only after a mantissa, and strtof has to take all of it
+        if (digits && (peek(length) == 'e' || peek(length) == 'E'))
+        {
+            ++length;
+            size_t mantissa = digits;
+            sign();
+            run();
+            digits = digits > mantissa ? digits : 0;
+        }
+    }
+
+    return digits ? length : 0;
+}
+
+const char* ProgramIO::text(size_t length)
+{
+    // number() looked at the byte after, so it is buffered unless the input ended there
+    if (next + length == input.size())
+        input.push_back(0);
+
+    displaced = input[next + length];
+    input[next + length] = 0;
+    return &input[next];
+}
+
+void ProgramIO::consume(size_t length)
+{
+    input[next + length] = displaced;
+    next += length;
+}
+
+int32_t ProgramIO::readInt()
+{
+    size_t length = failed ? 0 : number(false);
+    if (!length)
+    {
+        failed = true;
+        return 0;
+    }
+
+    errno = 0;
+    long value = strtol(text(length), nullptr, 10);
+    failed = errno == ERANGE;
+    consume(length);
+
+    return (int16_t)value;
+}
+
+float ProgramIO::readReal()
+{
+    size_t length = failed ? 0 : number(true);
+    if (!length)
+    {
+        failed = true;
+        return 0;
+    }
+
+    errno = 0;
+    float value = strtof(text(length), nullptr);
+    consume(length);
+
+    // too large, the extractor gives the largest float there is
+    if (errno == ERANGE && fabs(value) == HUGE_VALF)
+    {
+        failed = true;
+        value = copysign(FLT_MAX, value);
+    }
+
+    return value;
+}
+
+void ProgramIO::writeInt(int32_t value)
+{
+    char digits[16];
+    int count = 0;
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+    do
+    {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+        output.push_back('-');
+    while (count)
+        output.push_back(digits[--count]);
+    output.push_back('\n');
+
+    if (output.size() >= CHUNK)
+        flush();
+}
+
+void ProgramIO::writeReal(float value)
+{
+    char text[64];
+    int length = snprintf(text, sizeof text, "%.2f\n", value);
+    output.insert(output.end(), text, text + length);
+
+    if (output.size() >= CHUNK)
+        flush();
+}
+
+void ProgramIO::flush()
+{
+    out.write(output.data(), output.size());
+    out.flush();
+    output.clear();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// What read() and write() do while a program runs, for the interpreter and the code the
+// JIT compiles alike. Input is taken from the stream as it arrives, up to a chunk at a
+// time, and numbers are parsed straight out of the chunk; output collects in a buffer that
+// goes to the stream when it fills, before a runtime error is reported, and when the run
+// ends. Values come out as the iostream extractors would read them: an int as a long cut
+// down to 16 bits, a real as a float, and once one fails to parse every later read gives 0.
+class ProgramIO
+{
+public:
+    ProgramIO(std::istream& in, std::ostream& out) : in(in), out(out) { output.reserve(CHUNK); }
+    ProgramIO(const ProgramIO&) = delete;
+    ProgramIO& operator=(const ProgramIO&) = delete;
+    ~ProgramIO() { flush(); }
+
+    int32_t readInt();
+    float readReal();
+
+    // one value per line; a record is written a field at a time
+    void writeInt(int32_t value);
+    void writeReal(float value);
+
+    void flush();
+
+private:
+    enum { CHUNK = 1 << 16 };
+
+    std::istream& in;
+    std::ostream& out;
+
+    std::vector<char> input;
+    size_t next = 0;            // first unread byte of input
+    bool failed = false;
+
+    std::vector<char> output;
+
+    // the byte at next + offset, reading another chunk when it is not buffered yet; 0 past
+    // the end of input
+    char peek(size_t offset);
+
+    // skips whitespace, then the bytes the number at next takes; 0 when there is none
+    size_t number(bool real);
+
+    // the number's bytes as a string for strtol or strtof, in place: the byte after them is
+    // set aside until consume() puts it back and moves past them
+    const char* text(size_t length);
+    void consume(size_t length);
+
+    char displaced = 0;
+};
@@ -0,0 +1,488 @@
+#include "SSA.h"
+#include <algorithm>
+#include <map>
+using namespace std;
+
+bool DominatorTree::dominates(int a, int b) const
+{
+    while (b != a && b > 0)
+        b = idom[b];
+
+    return b == a;
+}
+
+DominatorTree dominators(const IRFunction& fn)
+{
+    int count = (int)fn.blocks.size();
+    DominatorTree tree;
+    vector<int> postorder(count, -1);
+
+    // iterative depth first search for the postorder
+    vector<pair<int, size_t>> stack{ { 0, 0 } };
+    vector<bool> seen(count);
+    vector<int> order;
+    seen[0] = true;
+
+    while (!stack.empty())
+    {
+        auto& top = stack.back();
+        const vector<int>& succs = fn.blocks[top.first].succs;
+
+        if (top.second < succs.size())
+        {
+            int succ = succs[top.second++];
+            if (!seen[succ])
+            {
+                seen[succ] = true;
+                stack.push_back({ succ, 0 });
+            }
+            continue;
+        }
+
+        postorder[top.first] = (int)order.size();
+        order.push_back(top.first);
+        stack.pop_back();
+    }
+
+    tree.order.assign(order.rbegin(), order.rend());
+
+    vector<int> idom(count, -1);
+    idom[0] = 0;
+
+    auto intersect = [&](int a, int b)
+    {
+        while (a != b)
+        {
+            while (postorder[a] < postorder[b])
+                a = idom[a];
+            while (postorder[b] < postorder[a])
+                b = idom[b];
+        }
+        return a;
+    };
+
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+
+        for (int block : tree.order)
+        {
+            if (block == 0)
+                continue;
+
+            int dom = -1;
+            for (int pred : fn.blocks[block].preds)
+                if (idom[pred] >= 0)
+                    dom = dom < 0 ? pred : intersect(pred, dom);
+
+            if (idom[block] != dom)
+            {
+                idom[block] = dom;
+                changed = true;
+            }
+        }
+    }
+
+    idom[0] = -1;
+    tree.idom = idom;
+    tree.children.resize(count);
+    tree.frontier.resize(count);
+
+    for (int block : tree.order)
+    {
+        if (block != 0)
+            tree.children[idom[block]].push_back(block);
+
+        const vector<int>& preds = fn.blocks[block].preds;
+        if (preds.size() < 2)
+            continue;
+
+        for (int pred : preds)
+        {
+            if (!tree.reachable(pred))
+                continue;
+
+            for (int runner = pred; runner != idom[block]; runner = idom[runner])
+            {
+                auto& df = tree.frontier[runner];
+                if (find(df.begin(), df.end(), block) == df.end())
+                    df.push_back(block);
+
+                if (runner == 0)
+                    break;
+            }
+        }
+    }
+
+    return tree;
+}
+
+struct Renamer
+{
+    IRFunction& fn;
+    const DominatorTree& tree;
+    map<int, int> variableAt;               // frame offset -> promoted variable
+    vector<IRType> types;
+    vector<vector<int>> stacks;             // current value of each variable
+    vector<vector<pair<int, int>>> phis;    // per block: (variable, index of the phi in code)
+    vector<int> value;                      // a removed load's register -> the value it read
+
+    Renamer(IRFunction& fn, const DominatorTree& tree) : fn(fn), tree(tree), value(fn.regs.size(), -1) {}
+
+    int variable(const Instr& in) const
+    {
+        if (in.a != AREA_FRAME)
+            return -1;
+
+        auto found = variableAt.find(in.b);
+        return found == variableAt.end() ? -1 : found->second;
+    }
+
+    int resolve(int reg) const
+    {
+        while (reg >= 0 && reg < (int)value.size() && value[reg] >= 0)
+            reg = value[reg];
+        return reg;
+    }
+
+    void rename(int block)
+    {
+        vector<int> pushed;
+        vector<Instr> code;
+
+        for (auto& phi : phis[block])
+        {
+            stacks[phi.first].push_back(fn.blocks[block].code[phi.second].dst);
+            pushed.push_back(phi.first);
+        }
+
+        for (auto& in : fn.blocks[block].code)
+        {
+            if (in.op != Opcode::PHI)
+                rewriteUses(fn, in, [this](int reg) { return resolve(reg); });
+
+            int var = in.op == Opcode::LOAD || in.op == Opcode::STORE ? variable(in) : -1;
+
+            if (var >= 0 && in.op == Opcode::LOAD)
+                value[in.dst] = stacks[var].back();
+            else if (var >= 0)
+            {
+                stacks[var].push_back(in.c);
+                pushed.push_back(var);
+            }
+            else
+                code.push_back(in);
+        }
+
+        fn.blocks[block].code = move(code);
+
+        // phis of the successors: their entry for this edge is the value at the end of this block
+        for (int succ : fn.blocks[block].succs)
+            for (auto& phi : phis[succ])
+            {
+                const Instr& in = fn.blocks[succ].code[phi.second];
+
+                for (int i = 0; i < fn.listSize(in.a); i += 2)
+                    if (fn.lists[in.a + 1 + i] == block)
+                        fn.lists[in.a + 2 + i] = stacks[phi.first].back();
+            }
+
+        for (int child : tree.children[block])
+            rename(child);
+
+        for (int var : pushed)
+            stacks[var].pop_back();
+    }
+};
+
+void buildSSA(IRFunction& fn)
+{
+    // unreachable blocks would keep loads of variables that no longer exist
+    {
+        DominatorTree tree = dominators(fn);
+        vector<bool> keep(fn.blocks.size());
+        for (int block : tree.order)
+            keep[block] = true;
+        compactBlocks(fn, keep);
+    }
+
+    DominatorTree tree = dominators(fn);
+    Renamer renamer(fn, tree);
+
+    // every (offset, type) the frame is accessed with, and the widest access at each offset;
+    // one that overlaps another, the lanes of a V instruction or a record passed by reference
+    // stays in memory
+    map<int, IRType> accesses;
+    map<int, int> extent;
+    map<int, bool> promotable;
+    vector<pair<int, int>> lanes;
+
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            if (isVector(in.op))
+            {
+                for (int operand : { in.a, in.b })
+                    if (addressArea(operand) == AREA_FRAME)
+                        lanes.push_back({ addressOffset(operand), addressOffset(operand) + in.c * width(in.type) });
+            }
+            else if (in.op == Opcode::ADDR)
+                lanes.push_back({ in.a, in.a + in.b });
+            else if ((in.op == Opcode::LOAD || in.op == Opcode::STORE) && in.a == AREA_FRAME)
+            {
+                auto found = accesses.find(in.b);
+                if (found == accesses.end())
+                {
+                    accesses[in.b] = in.type;
+                    extent[in.b] = width(in.type);
+                    promotable[in.b] = true;
+                }
+                else if (found->second != in.type)
+                {
+                    // a union read as another member than it was written
+                    extent[in.b] = max(extent[in.b], width(in.type));
+                    promotable[in.b] = false;
+                }
+            }
+
+    for (auto i = accesses.begin(); i != accesses.end(); ++i)
+        for (auto j = next(i); j != accesses.end() && j->first < i->first + extent[i->first]; ++j)
+            promotable[i->first] = promotable[j->first] = false;
+
+    for (auto& access : accesses)
+        for (auto& range : lanes)
+            if (access.first < range.second && range.first < access.first + extent[access.first])
+                promotable[access.first] = false;
+
+    for (auto& access : accesses)
+        if (promotable[access.first])
+        {
+            renamer.variableAt[access.first] = (int)renamer.types.size();
+            renamer.types.push_back(access.second);
+        }
+
+    int variables = (int)renamer.types.size();
+    if (!variables)
+        return;
+
+    // phis on the iterated dominance frontier of each variable's stores
+    vector<vector<int>> stores(variables);
+    for (int b = 0; b < (int)fn.blocks.size(); ++b)
+        for (auto& in : fn.blocks[b].code)
+            if (in.op == Opcode::STORE && renamer.variable(in) >= 0)
+                stores[renamer.variable(in)].push_back(b);
+
+    vector<vector<int>> phiVars(fn.blocks.size());
+
+    for (int var = 0; var < variables; ++var)
+    {
+        vector<bool> hasPhi(fn.blocks.size()), queued(fn.blocks.size());
+        vector<int> work = stores[var];
+
+        for (int b : work)
+            queued[b] = true;
+
+        while (!work.empty())
+        {
+            int b = work.back();
+            work.pop_back();
+
+            for (int df : tree.frontier[b])
+            {
+                if (hasPhi[df])
+                    continue;
+
+                hasPhi[df] = true;
+                phiVars[df].push_back(var);
+
+                if (!queued[df])
+                {
+                    queued[df] = true;
+                    work.push_back(df);
+                }
+            }
+        }
+    }
+
+    renamer.phis.resize(fn.blocks.size());
+
+    for (int b = 0; b < (int)fn.blocks.size(); ++b)
+    {
+        vector<Instr> code;
+
+        for (int var : phiVars[b])
+        {
+            vector<int> entries;
+            for (int pred : fn.blocks[b].preds)
+            {
+                entries.push_back(pred);
+                entries.push_back(-1);
+            }
+
+            IRType type = renamer.types[var];
+            renamer.phis[b].push_back({ var, (int)code.size() });
+            code.push_back({ Opcode::PHI, type, fn.newReg(type), fn.newList(entries), -1, -1 });
+        }
+
+        code.insert(code.end(), fn.blocks[b].code.begin(), fn.blocks[b].code.end());
+        fn.blocks[b].code = move(code);
+    }
+
+    // every variable starts as the zero its frame slot held
+    vector<Instr> zeros;
+    renamer.stacks.resize(variables);
+
+    for (int var = 0; var < variables; ++var)
+    {
+        IRType type = renamer.types[var];
+        int reg = fn.newReg(type);
+        zeros.push_back({ Opcode::CONST, type, reg, 0, -1, -1 });
+        renamer.stacks[var].push_back(reg);
+    }
+
+    auto& entry = fn.blocks[0].code;
+    entry.insert(entry.begin(), zeros.begin(), zeros.end());
+    renamer.value.resize(fn.regs.size(), -1);
+
+    // the entry has no phis, shifting its code leaves the recorded phi indices valid
+    renamer.rename(0);
+}
+
+// Orders one edge's parallel copies dst <- src so that no copy overwrites a register a
+// later one still reads. A cycle is broken by saving one destination in a new register.
+void sequentialize(IRFunction& fn, vector<pair<int, int>> copies, vector<Instr>& out)
+{
+    copies.erase(remove_if(copies.begin(), copies.end(), [](const pair<int, int>& copy) { return copy.first == copy.second; }), copies.end());
+
+    while (!copies.empty())
+    {
+        bool emitted = false;
+
+        for (size_t i = 0; i < copies.size(); ++i)
+        {
+            int dst = copies[i].first;
+            bool read = any_of(copies.begin(), copies.end(), [dst](const pair<int, int>& copy) { return copy.second == dst; });
+
+            if (!read)
+            {
+                out.push_back({ Opcode::COPY, fn.regs[dst], dst, copies[i].second, -1, -1 });
+                copies.erase(copies.begin() + i);
+                emitted = true;
+                break;
+            }
+        }
+
+        if (emitted)
+            continue;
+
+        int dst = copies[0].first;
+        int saved = fn.newReg(fn.regs[dst]);
+        out.push_back({ Opcode::COPY, fn.regs[dst], saved, dst, -1, -1 });
+
+        for (auto& copy : copies)
+            if (copy.second == dst)
+                copy.second = saved;
+    }
+}
+
+void leaveSSA(IRFunction& fn)
+{
+    bool anyPhi = false;
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+            anyPhi |= in.op == Opcode::PHI;
+
+    if (!anyPhi)
+        return;
+
+    // split the critical edges into blocks with phis, the copies need a block of their own
+    int original = (int)fn.blocks.size();
+
+    for (int b = 0; b < original; ++b)
+    {
+        if (fn.blocks[b].preds.size() < 2 || fn.blocks[b].code[0].op != Opcode::PHI)
+            continue;
+
+        for (int pred : vector<int>(fn.blocks[b].preds))
+        {
+            if (fn.blocks[pred].succs.size() < 2)
+                continue;
+
+            int split = fn.newBlock();
+            fn.blocks[split].code.push_back({ Opcode::JUMP, IRType::VOID, -1, b, -1, -1 });
+
+            Instr& branch = fn.blocks[pred].code.back();
+            if (branch.b == b)
+                branch.b = split;
+            if (branch.c == b)
+                branch.c = split;
+
+            for (auto& in : fn.blocks[b].code)
+                if (in.op == Opcode::PHI)
+                    for (int i = 0; i < fn.listSize(in.a); i += 2)
+                        if (fn.lists[in.a + 1 + i] == pred)
+                            fn.lists[in.a + 1 + i] = split;
+        }
+    }
+
+    buildCFG(fn);
+
+    vector<int> uses(fn.regs.size()), regs;
+    for (auto& block : fn.blocks)
+        for (auto& in : block.code)
+        {
+            regs.clear();
+            usesOf(fn, in, regs);
+            for (int reg : regs)
+                ++uses[reg];
+        }
+
+    for (int b = 0; b < (int)fn.blocks.size(); ++b)
+    {
+        auto& code = fn.blocks[b].code;
+        auto end = find_if(code.begin(), code.end(), [](const Instr& in) { return in.op != Opcode::PHI; });
+        vector<Instr> phis(code.begin(), end);
+
+        // a block looping to itself gets its copies in its own code
+        code.erase(code.begin(), end);
+
+        for (int pred : fn.blocks[b].preds)
+        {
+            vector<pair<int, int>> copies;
+
+            for (auto& phi : phis)
+                for (int i = 0; i < fn.listSize(phi.a); i += 2)
+                    if (fn.listItems(phi.a)[i] == pred)
+                        copies.push_back({ phi.dst, fn.listItems(phi.a)[i + 1] });
+
+            auto& predCode = fn.blocks[pred].code;
+
+            // a source computed in the predecessor only for this phi can be computed into the
+            // phi's register directly, when nothing after it reads the old value
+            for (auto& copy : copies)
+            {
+                auto def = find_if(predCode.begin(), predCode.end(), [&](const Instr& in) { return in.dst == copy.second && in.op != Opcode::PHI; });
+                if (def == predCode.end() || uses[copy.second] != 1 || copy.first == copy.second)
+                    continue;
+
+                bool readLater = any_of(copies.begin(), copies.end(), [&](const pair<int, int>& other) { return other.second == copy.first; });
+                for (auto in = def + 1; in != predCode.end() && !readLater; ++in)
+                {
+                    regs.clear();
+                    usesOf(fn, *in, regs);
+                    readLater = find(regs.begin(), regs.end(), copy.first) != regs.end();
+                }
+
+                if (!readLater)
+                {
+                    def->dst = copy.first;
+                    copy.second = copy.first;
+                }
+            }
+
+            vector<Instr> moves;
+            sequentialize(fn, copies, moves);
+
+            predCode.insert(predCode.end() - 1, moves.begin(), moves.end());
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "IR.h"
+
+// Cooper, Harvey & Kennedy's iterative dominators, over the blocks reachable from the entry
+struct DominatorTree
+{
+    std::vector<int> idom;                      // immediate dominator, -1 for the entry and unreachable blocks
+    std::vector<std::vector<int>> children;
+    std::vector<std::vector<int>> frontier;
+    std::vector<int> order;                     // reachable blocks in reverse postorder
+
+    bool reachable(int block) const { return block == 0 || idom[block] >= 0; }
+    bool dominates(int a, int b) const;
+};
+
+DominatorTree dominators(const IRFunction&);
+
+// mem2reg: frame scalars that are only ever loaded and stored whole, at one offset and type,
+// become SSA registers, with phis placed on the iterated dominance frontiers of their stores.
+// They start out as zero, like the frame they came from. Globals stay in memory.
+void buildSSA(IRFunction&);
+
+// Replaces the phis by copies at the end of the predecessors. Critical edges into blocks
+// with phis are split first, and each edge's copies are ordered so none clobbers a source.
+void leaveSSA(IRFunction&);
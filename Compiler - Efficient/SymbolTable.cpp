@@ -1,17 +1,32 @@
 #include "SymbolTable.h"
 #include <iostream>
 #include <string>
-#include <map>
+#include <algorithm>
 using namespace std;
 
-map<string, TypeLog*> globalSymbolTable;
-map<string, TokenType> prefixTable;
+thread_local TypeArena typeArena;
+TypeInterner typeInterner;
+SymbolTable globalSymbolTable;
+SymbolMap<TokenType> prefixTable;
 
 int dataTypeCount = 0;
 int identifierCount = 0;
+bool isSymbolError = false;
+bool reorderFields = false;
 
 vector<TypeLog*> structList;
-vector<vector<int>> adj;
+vector<VariableEntry*> globalVariables;
+
+SymbolMap<int> fieldUses;
+
+// adj[t] lists { record index, number of its fields of type t } for every record holding a t
+vector<vector<pair<int, int>>> adj;
+
+// definetype statements, resolved together once every record is known
+vector<const DefineTypeNode*> aliases;
+
+// union-find over type names: each set holds one record and all of its aliases
+SymbolMap<int> aliasParent;
 
 std::ostream& operator<<(std::ostream& out, const TypeEntry& entry)
 {
@@ -41,31 +56,106 @@ std::ostream& operator<<(std::ostream& out, const TypeLog& type)
     return out;
 }
 
-void dfs(int v, vector<bool>& visited, vector<int>& ans)
+// <dataType> is either a single name (int, real, #alias) or TK_RECORD/TK_UNION followed by the name
+TypeLog* resolveType(const ASTNode* typeNode, Diagnostics& diagnostics)
 {
-    visited[v] = true;
+    const IDNode* name = static_cast<const IDNode*>(typeNode->sibling ? typeNode->sibling : typeNode);
+    TypeLog* type = globalSymbolTable.lookup(name->symbol);
 
-    for (int i = 0; i < dataTypeCount; i++)
-        if (!visited[i] && adj[v][i] > 0)
-            dfs(i, visited, ans);
+    if (type == nullptr)
+    {
+        diagnostics.report(DiagCode::UNKNOWN_TYPE, name->line_number, { name->varName });
+    }
 
-    ans.push_back(v);
+    return type;
 }
 
-vector<int> topological_sort()
+// primitives are keyed by their tag, records and unions by their own index
+void internType(TypeLog* type)
 {
-    vector<bool> visited;
-    vector<int> ans;
+    if (type->entryType == TypeTag::DERIVED)
+        type->typeId = typeInterner.intern({ (int)TypeTag::DERIVED, type->index });
+    else
+        type->typeId = typeInterner.intern({ (int)type->entryType });
+}
 
-    visited.assign(dataTypeCount, false);
-    ans.clear();
+int tupleOf(const vector<pair<string, TypeLog*>>& params)
+{
+    vector<int> elements;
 
-    for (int i = 0; i < dataTypeCount; ++i)
-        if (!visited[i])
-            dfs(i, visited, ans);
+    for (auto& param : params)
+        elements.push_back(param.second ? param.second->typeId : (int)TypeInterner::INVALID);
 
-    reverse(ans.begin(), ans.end());
-    return ans;
+    return typeInterner.tuple(elements);
+}
+
+int findAlias(int symbol)
+{
+    int* parent = aliasParent.find(symbol);
+
+    if (parent == nullptr)
+        aliasParent.insert(symbol, symbol);
+
+    if (parent == nullptr || *parent == symbol)
+        return symbol;
+
+    int root = findAlias(*parent);
+    *aliasParent.find(symbol) = root;
+    return root;
+}
+
+void resolveAliases(Diagnostics& diagnostics)
+{
+    // merge both names of every definetype, whatever order the chain was written in
+    for (auto def : aliases)
+    {
+        int from = findAlias(internSymbol(def->from));
+        int to = findAlias(internSymbol(def->to));
+
+        if (from != to)
+            aliasParent.insert(to, from);
+    }
+
+    // the record each set stands for
+    SymbolMap<TypeLog*> setType;
+
+    for (auto def : aliases)
+    {
+        for (auto name : { &def->from, &def->to })
+        {
+            TypeLog* type = globalSymbolTable.lookup(*name);
+
+            if (type == nullptr || type->entryType != TypeTag::DERIVED)
+                continue;
+
+            int root = findAlias(findSymbol(*name));
+            TypeLog** known = setType.find(root);
+
+            if (known == nullptr)
+                setType.insert(root, type);
+            else if (*known != type)
+            {
+                diagnostics.report(DiagCode::CONFLICTING_ALIAS, def->line_number, { def->to, (*known)->derived()->name, type->derived()->name });
+            }
+        }
+    }
+
+    for (auto def : aliases)
+    {
+        int newName = internSymbol(def->to);
+        TypeLog** type = setType.find(findAlias(newName));
+
+        if (type == nullptr)
+        {
+            diagnostics.report(DiagCode::UNKNOWN_TYPE, def->line_number, { def->from });
+        }
+        else if (globalSymbolTable.find(newName) == nullptr)
+        {
+            (*type)->refCount++;
+            globalSymbolTable.insert(newName, *type);
+            prefixTable.insert(newName, def->isUnion ? TokenType::TK_UNION : TokenType::TK_RECORD);
+        }
+    }
 }
 
 void firstPass(const ASTNode* node, bool processTypedef = false)
@@ -73,7 +163,7 @@ void firstPass(const ASTNode* node, bool processTypedef = false)
     if (!node)
         return;
 
-    if (node->sym_index == 57)
+    if (node->type == NonTerminalType::PROGRAM)
     {
         // <program> -> <funcList> <mainFunction>
 
@@ -83,237 +173,457 @@ void firstPass(const ASTNode* node, bool processTypedef = false)
         firstPass(node->children[0], true);
         firstPass(node->children[1], true);
     }
-    else if (node->sym_index == 60 || node->sym_index == 58)
+    else if (node->type == NonTerminalType::FUNCTION)
     {
         // <function> -> <inputList><outputList> <stmts>
 
-        globalSymbolTable[node->token->lexeme] = new TypeLog
-        {
-            1,
-            identifierCount++,
-            -1,
-            TypeTag::FUNCTION,
-            new FuncEntry(node->token->lexeme)
-        };
+        const FuncNode* func = static_cast<const FuncNode*>(node);
+
+        if (!processTypedef)
+            globalSymbolTable.insert(internSymbol(func->Name), typeArena.make<TypeLog>(
+                1,
+                identifierCount++,
+                -1,
+                TypeTag::FUNCTION,
+                typeArena.make<FuncEntry>(func->Name)
+            ));
 
         firstPass(node->children[2], processTypedef);
     }
-    else if (node->sym_index == 68)
+    else if (node->type == NonTerminalType::STMTS)
     {
         // <stmts> -> <definitions> <declarations> <funcBody> <return>
 
         firstPass(node->children[0], processTypedef);
     }
-    else if (node->sym_index == 71 && !processTypedef)
+    else if (node->type == NonTerminalType::TYPE_DEFINITION && !processTypedef)
     {
         // typedefinition
-        prefixTable[node->children[0]->token->lexeme] = node->token->type;
 
-        globalSymbolTable[node->children[0]->token->lexeme] = new TypeLog
-        {
+        const TypeDefinitionNode* def = static_cast<const TypeDefinitionNode*>(node);
+        int symbol = internSymbol(def->name);
+
+        prefixTable.insert(symbol, def->isRecord ? TokenType::TK_RECORD : TokenType::TK_UNION);
+
+        DerivedEntry* entry = typeArena.make<DerivedEntry>(def->name, !def->isRecord);
+        entry->line_number = def->line_number;
+
+        internType(globalSymbolTable.insert(symbol, typeArena.make<TypeLog>(
             1,
             dataTypeCount++,
             -1,
             TypeTag::DERIVED,
-            new DerivedEntry
-            {
-                node->children[0]->token->lexeme,
-                node->token->type == TokenType::TK_UNION
-            }
-        };
+            entry
+        )));
     }
-    else if (node->sym_index == 108 && processTypedef)
+    else if (node->type == NonTerminalType::DEFINETYPE && processTypedef)
     {
-        // Type alias
-
-        const string& oldName = node->children[1]->token->lexeme;
-        const string& newName = node->children[2]->token->lexeme;
+        // Type alias, may name a type aliased further down
 
-        globalSymbolTable[oldName]->refCount++;
-        globalSymbolTable[newName] = globalSymbolTable[oldName];
-        prefixTable[newName] = node->token->type;
+        aliases.push_back(static_cast<const DefineTypeNode*>(node));
     }
 
     firstPass(node->sibling, processTypedef);
 }
 
-void secondPass(const ASTNode* node, map<string, TypeLog*>& symTable)
+// one variable or parameter, into the global table or the table of `func`
+void declareVariable(const ASTNode* node, FuncEntry* func, Storage storage, Diagnostics& diagnostics)
 {
-    static FuncEntry* local_func = nullptr;
+    // <declaration> ===> { TK_ID, <dataType>, isGlobal }
+    // <parameter_list> ===> { TK_ID, <dataType> }
+    // <dataType> ==> { TK_INT, TK_REAL, { TK_RECORD/TK_UNION, TK_RUID } }
 
+    bool isGlobal = false;
+    string name;
+    int symbol;
+    const ASTNode* varType;
+
+    if (node->type == NonTerminalType::PARAMETER)
+    {
+        const ParameterNode* param = static_cast<const ParameterNode*>(node);
+        name = param->varName;
+        symbol = param->symbol;
+        varType = param->varType;
+    }
+    else
+    {
+        const VariableDefinitionNode* decl = static_cast<const VariableDefinitionNode*>(node);
+        isGlobal = decl->isGlobal;
+        name = decl->varName;
+        symbol = decl->symbol;
+        varType = decl->varType;
+    }
+
+    auto &table = isGlobal ? globalSymbolTable : func->symbolTable;
+
+    TypeLog* log = table.insert(symbol, typeArena.make<TypeLog>(
+        1,
+        isGlobal ? identifierCount++ : func->identifierCount++,
+        -1,
+        TypeTag::VARIABLE,
+        typeArena.make<VariableEntry>(name)
+    ));
+
+    auto entry = log->variable();
+    entry->isGlobal = isGlobal;
+    entry->storage = isGlobal ? Storage::GLOBAL : storage;
+    entry->type = resolveType(varType, diagnostics);
+
+    (isGlobal ? globalVariables : func->variables).push_back(entry);
+}
+
+// Global half of the second pass: signatures, record fields and global variables
+void secondPass(const ASTNode* node, Diagnostics& diagnostics)
+{
     if (!node)
         return;
 
-    if (node->sym_index == 57)
+    if (node->type == NonTerminalType::PROGRAM)
     {
         // <program> -> <funcList> <mainFunction>
 
-        secondPass(node->children[0], symTable);
-        secondPass(node->children[1], symTable);
+        secondPass(node->children[0], diagnostics);
+        secondPass(node->children[1], diagnostics);
     }
-    else if (node->sym_index == 60 || node->sym_index == 58)
+    else if (node->type == NonTerminalType::FUNCTION)
     {
         // <function> -> <inputList><outputList> <stmts>
-        // Fill input argument 
+        // Fill input argument
 
-        FuncEntry* entry = dynamic_cast<FuncEntry*>(globalSymbolTable[node->token->lexeme]->structure);
+        const FuncNode* func = static_cast<const FuncNode*>(node);
+        FuncEntry* entry = globalSymbolTable.lookup(func->Name)->function();
 
         for (auto arg = node->children[0]; arg; arg = arg->sibling)
         {
-            entry->argTypes.push_back(
-            {
-                arg->token->lexeme,
-                globalSymbolTable[arg->type->sibling ? arg->type->sibling->token->lexeme : arg->type->token->lexeme]
-            });
+            const ParameterNode* param = static_cast<const ParameterNode*>(arg);
+            TypeLog* type = resolveType(param->varType, diagnostics);
+
+            entry->argTypes.push_back({ param->varName, type });
 
-            entry->argTypes.back().second->refCount++;
+            if (type)
+                type->refCount++;
         }
 
         for (auto ret = node->children[1]; ret; ret = ret->sibling)
         {
-            entry->retTypes.push_back(
-                {
-                    ret->token->lexeme,
-                    globalSymbolTable[ret->type->sibling ? ret->type->sibling->token->lexeme : ret->type->token->lexeme]
-                });
+            const ParameterNode* param = static_cast<const ParameterNode*>(ret);
+            TypeLog* type = resolveType(param->varType, diagnostics);
 
-            entry->argTypes.back().second->refCount++;
+            entry->retTypes.push_back({ param->varName, type });
+
+            if (type)
+                type->refCount++;
         }
 
-        local_func = entry;
-        secondPass(node->children[0], local_func->symbolTable);
-        secondPass(node->children[1], local_func->symbolTable);
-        secondPass(node->children[2], local_func->symbolTable);
+        entry->argTuple = tupleOf(entry->argTypes);
+        entry->retTuple = tupleOf(entry->retTypes);
+
+        secondPass(node->children[2], diagnostics);
     }
-    else if (node->sym_index == 68)
+    else if (node->type == NonTerminalType::STMTS)
     {
         // <stmts> -> <definitions> <declarations> <funcBody> <return>
 
-        secondPass(node->children[0], symTable);
-        secondPass(node->children[1], symTable);
+        secondPass(node->children[0], diagnostics);
+        secondPass(node->children[1], diagnostics);
     }
-    else if (node->sym_index == 71)
+    else if (node->type == NonTerminalType::TYPE_DEFINITION)
     {
         // <typeDefinition> -> TK_RUID <fieldDefinitions>
 
-        TypeLog* mediator = globalSymbolTable[node->children[0]->token->lexeme];
+        TypeLog* mediator = globalSymbolTable.lookup(static_cast<const TypeDefinitionNode*>(node)->name);
 
-        DerivedEntry* entry = dynamic_cast<DerivedEntry*>(mediator->structure);
+        DerivedEntry* entry = mediator->derived();
 
-        for (auto field = node->children[1]; field; field = field->sibling)
+        for (auto field = node->children[0]; field; field = field->sibling)
         {
-            entry->fields.push_back(
-                {
-                    field->token->lexeme,
-                    globalSymbolTable[field->type->token->lexeme]
-                });
+            const FieldDefinitionNode* def = static_cast<const FieldDefinitionNode*>(field);
+            TypeLog* type = resolveType(def->varType, diagnostics);
+
+            if (!type)
+                continue;
 
-            entry->fields.back().second->refCount++;
-            adj[entry->fields.back().second->index][mediator->index]++;
+            int symbol = def->symbol;
+
+            if (entry->fieldIndex.find(symbol))
+            {
+                diagnostics.report(DiagCode::DUPLICATE_FIELD, field->line_number, { def->varName, entry->name });
+                continue;
+            }
+
+            entry->fieldIndex.insert(symbol, (int)entry->fields.size());
+            entry->fields.push_back({ def->varName, symbol, type, 0 });
+
+            type->refCount++;
+
+            // all fields of this record are added back to back, so a repeated type can only be the last edge
+            auto& edges = adj[type->index];
+
+            if (!edges.empty() && edges.back().first == mediator->index)
+                edges.back().second++;
+            else
+                edges.push_back({ mediator->index, 1 });
         }
 
         structList[mediator->index] = mediator;
     }
-    else if ((node->sym_index == 63 || node->sym_index == 77))
+    else if (node->type == NonTerminalType::VARIABLE_DEFINITION && static_cast<const VariableDefinitionNode*>(node)->isGlobal)
+        declareVariable(node, nullptr, Storage::GLOBAL, diagnostics);
+
+    secondPass(node->sibling, diagnostics);
+}
+
+// Local half of the second pass, see loadLocalSymbols
+void declareLocals(const ASTNode* node, FuncEntry* func, Storage storage, Diagnostics& diagnostics)
+{
+    if (!node)
+        return;
+
+    if (node->type == NonTerminalType::STMTS)
     {
-        // <declaration> ===> { token: TK_ID, type: <dataType> }
-        // <dataType> ==> { TK_INT, TK_REAL, { TK_RECORD/TK_UNION, TK_RUID } }
+        // <stmts> -> <definitions> <declarations> <funcBody> <return>
+
+        declareLocals(node->children[1], func, storage, diagnostics);
+    }
+    else if (node->type == NonTerminalType::PARAMETER || (node->type == NonTerminalType::VARIABLE_DEFINITION && !static_cast<const VariableDefinitionNode*>(node)->isGlobal))
+        declareVariable(node, func, storage, diagnostics);
+
+    declareLocals(node->sibling, func, storage, diagnostics);
+}
+
+void loadLocalSymbols(const ASTNode* function, Diagnostics& diagnostics)
+{
+    // <function> -> <inputList><outputList> <stmts>
 
-        auto &table = node->isGlobal ? globalSymbolTable : symTable;
+    FuncEntry* entry = globalSymbolTable.lookup(static_cast<const FuncNode*>(function)->Name)->function();
 
-        table[node->token->lexeme] = new TypeLog
+    declareLocals(function->children[0], entry, Storage::PARAM, diagnostics);
+    declareLocals(function->children[1], entry, Storage::RETURN, diagnostics);
+    declareLocals(function->children[2], entry, Storage::LOCAL, diagnostics);
+}
+
+// number of TK_DOT accesses naming each field symbol, anywhere in the program
+void countFieldUses(const ASTNode* node)
+{
+    for (; node; node = node->sibling)
+    {
+        if (node->type == NonTerminalType::OPERATOR && static_cast<const OperatorNode*>(node)->op == TokenType::TK_DOT)
         {
-            1,
-            node->isGlobal ? identifierCount++ : local_func->identifierCount++,
-            -1,
-            TypeTag::VARIABLE,
-            new VariableEntry(node->token->lexeme)
-        };
+            int field = static_cast<const IDNode*>(node->children[1])->symbol;
+            int* uses = fieldUses.find(field);
 
-        auto entry = dynamic_cast<VariableEntry*>(table[node->token->lexeme]->structure);
-        entry->isGlobal = node->isGlobal;
-        entry->type = globalSymbolTable[node->type->sibling == nullptr ? node->type->token->lexeme : node->type->sibling->token->lexeme];
+            if (uses)
+                (*uses)++;
+            else
+                fieldUses.insert(field, 1);
+        }
+        else if (node->type == NonTerminalType::ASSIGNMENT)
+            countFieldUses(static_cast<const AssignmentNode*>(node)->target);
+        else if (node->type == NonTerminalType::READ)
+            countFieldUses(static_cast<const ReadNode*>(node)->target);
+        else if (node->type == NonTerminalType::WRITE)
+            countFieldUses(static_cast<const WriteNode*>(node)->target);
+
+        for (auto child : node->children)
+            countFieldUses(child);
     }
+}
 
-    secondPass(node->sibling, symTable);
+int roundUp(int value, int align)
+{
+    return (value + align - 1) / align * align;
 }
 
-void calculateWidth()
+// Each field sits at a multiple of its own alignment and the width is padded to a multiple
+// of the record's, so consecutive records in memory stay aligned as well. With reorderFields
+// offsets go out widest alignment first, which leaves no holes since every width is a
+// multiple of its alignment; ties put the most used fields next to each other up front.
+void layoutRecord(TypeLog* record)
 {
-    auto width_cal_order = topological_sort();
+    DerivedEntry* entry = record->derived();
+    vector<FieldEntry*> order;
 
-    for (int i = 0; i < structList.size(); ++i)
+    for (auto& field : entry->fields)
+        order.push_back(&field);
+
+    if (reorderFields && !entry->isUnion)
     {
-        int width = 0;
-        int actualIndex = width_cal_order[i];
+        auto uses = [](const FieldEntry* field) { const int* count = fieldUses.find(field->symbol); return count ? *count : 0; };
+
+        stable_sort(order.begin(), order.end(), [&](const FieldEntry* a, const FieldEntry* b)
+        {
+            if (a->type->align != b->type->align)
+                return a->type->align > b->type->align;
+            return uses(a) > uses(b);
+        });
+    }
+
+    int width = 0, align = 1, data = 0;
 
-        DerivedEntry* entry = dynamic_cast<DerivedEntry*>(structList[actualIndex]->structure);
-        if (!entry)
+    for (auto field : order)
+    {
+        align = max(align, field->type->align);
+
+        if (entry->isUnion)
+        {
+            field->offset = 0;
+            width = max(width, field->type->width);
+            data = width;
+        }
+        else
+        {
+            field->offset = roundUp(width, field->type->align);
+            width = field->offset + field->type->width;
+            data += field->type->width;
+        }
+    }
+
+    record->align = align;
+    record->width = roundUp(width, align);
+    entry->padding = record->width - data;
+}
+
+// Every record left with unresolved fields either sits on a cycle or holds one. Walking from
+// a record into any unresolved field type must therefore close a cycle, which is reported once.
+void reportRecursiveRecords(const vector<int>& pending, Diagnostics& diagnostics)
+{
+    vector<int> walk(dataTypeCount, 0);
+
+    for (int start = 0; start < dataTypeCount; ++start)
+    {
+        if (!pending[start] || walk[start])
             continue;
 
-        int isUnion = entry->isUnion;
+        vector<int> path;
+        int v = start;
 
-        for (int i = 0; i < dataTypeCount; i++)
+        while (!walk[v])
         {
-            int size = adj[i][actualIndex] * structList[i]->width;
+            walk[v] = start + 1;
+            path.push_back(v);
 
-            width = isUnion ? max(width, size) : width + size;
+            for (auto& field : structList[v]->derived()->fields)
+            {
+                if (pending[field.type->index])
+                {
+                    v = field.type->index;
+                    break;
+                }
+            }
         }
 
-        structList[actualIndex]->width = width;
+        // reached a record seen by an earlier walk, its cycle is already reported
+        if (walk[v] != start + 1)
+            continue;
+
+        DerivedEntry* entry = structList[v]->derived();
+
+        string chain;
+
+        for (auto it = find(path.begin(), path.end(), v); it != path.end(); ++it)
+            chain += structList[*it]->derived()->name + " -> ";
+
+        diagnostics.report(DiagCode::RECURSIVE_RECORD, entry->line_number, { entry->name, chain + entry->name });
+    }
+}
+
+// Kahn's algorithm over the field dependency graph. A record is laid out as soon as
+// all the types of its fields are, so widths and offsets come out in a single pass.
+void calculateWidth(Diagnostics& diagnostics)
+{
+    vector<int> pending(dataTypeCount, 0);
+
+    for (auto& edges : adj)
+        for (auto& edge : edges)
+            pending[edge.first] += edge.second;
+
+    vector<int> ready;
+    int laidOut = 0;
+
+    for (int i = 0; i < dataTypeCount; ++i)
+        if (pending[i] == 0)
+            ready.push_back(i);
+
+    while (!ready.empty())
+    {
+        int v = ready.back();
+        ready.pop_back();
+        laidOut++;
+
+        if (structList[v] && structList[v]->entryType == TypeTag::DERIVED)
+            layoutRecord(structList[v]);
+
+        for (auto& edge : adj[v])
+            if ((pending[edge.first] -= edge.second) == 0)
+                ready.push_back(edge.first);
     }
+
+    if (laidOut < dataTypeCount)
+        reportRecursiveRecords(pending, diagnostics);
 }
 
 void loadSymbolTable(const ASTNode* node)
 {
-	globalSymbolTable["int"] = new TypeLog
-	{
-		1,
-		dataTypeCount++,
-		2,
-		TypeTag::INT,
-		nullptr
-	};
-
-	globalSymbolTable["real"] = new TypeLog
-	{
-		1,
-		dataTypeCount++,
-		4,
-		TypeTag::REAL,
-		nullptr
-	};
-
-	globalSymbolTable["##bool"] = new TypeLog
-	{
-		1,
-		dataTypeCount++,
-		0,
-		TypeTag::BOOL,
-		nullptr
-	};
-
-	globalSymbolTable["##void"] = new TypeLog
-	{
-		1,
-		dataTypeCount++,
-		0,
-		TypeTag::VOID,
-		nullptr
-	};
+    globalSymbolTable.insert(internSymbol("int"), typeArena.make<TypeLog>(
+        1,
+        dataTypeCount++,
+        2,
+        TypeTag::INT,
+        nullptr
+    ));
+
+    globalSymbolTable.insert(internSymbol("real"), typeArena.make<TypeLog>(
+        1,
+        dataTypeCount++,
+        4,
+        TypeTag::REAL,
+        nullptr
+    ));
+
+    globalSymbolTable.insert(internSymbol("##bool"), typeArena.make<TypeLog>(
+        1,
+        dataTypeCount++,
+        0,
+        TypeTag::BOOL,
+        nullptr
+    ));
+
+    globalSymbolTable.insert(internSymbol("##void"), typeArena.make<TypeLog>(
+        1,
+        dataTypeCount++,
+        0,
+        TypeTag::VOID,
+        nullptr
+    ));
+
+    // primitives are naturally aligned
+    for (auto name : { "int", "real", "##bool", "##void" })
+    {
+        TypeLog* type = globalSymbolTable.lookup(name);
+        type->align = max(type->width, 1);
+        internType(type);
+    }
+
+    int errors = diagnosticLog.errorCount();
 
     firstPass(node);
+    resolveAliases(diagnosticLog);
 
     structList.resize(dataTypeCount);
-    structList[0] = globalSymbolTable["int"];
-    structList[1] = globalSymbolTable["real"];
-    structList[2] = globalSymbolTable["##bool"];
-    structList[3] = globalSymbolTable["##void"];
+    structList[0] = globalSymbolTable.lookup("int");
+    structList[1] = globalSymbolTable.lookup("real");
+    structList[2] = globalSymbolTable.lookup("##bool");
+    structList[3] = globalSymbolTable.lookup("##void");
 
     adj.clear();
-    adj.resize(dataTypeCount, vector<int>(dataTypeCount, 0));
+    adj.resize(dataTypeCount);
+
+    secondPass(node, diagnosticLog);
 
-    secondPass(node, globalSymbolTable);
+    if (reorderFields)
+        countFieldUses(node);
 
-    calculateWidth();
-}
\ No newline at end of file
+    calculateWidth(diagnosticLog);
+
+    isSymbolError = diagnosticLog.errorCount() > errors;
+}
@@ -1,8 +1,12 @@
 #pragma once
 #include "AST.h"
-#include <list>
+#include "Diagnostics.h"
+#include <cassert>
+#include <new>
 #include <string>
-#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 enum class TypeTag
 {
@@ -16,11 +20,13 @@ enum class TypeTag
     VARIABLE
 };
 
+class FuncEntry;
+class VariableEntry;
+class DerivedEntry;
+
+// Plain descriptor, the concrete kind is given by TypeLog::entryType
 class TypeEntry
 {
-    // only for dynamic cast to work
-    virtual void foo() { }
-    
 public:
     const std::string name;
 
@@ -41,17 +47,250 @@ struct TypeLog
     TypeTag entryType;
     TypeEntry* structure;
 
+    int typeId = 0;     // canonical id from typeInterner, shared with every alias
+    int align = 0;      // every offset of a value of this type is a multiple of align
+
+    // checked downcasts, dispatching on entryType instead of RTTI
+    FuncEntry* function() const;
+    VariableEntry* variable() const;
+    DerivedEntry* derived() const;
+
     friend std::ostream& operator<<(std::ostream&, const TypeLog&);
 };
 
+// Bump allocator for TypeLogs and their descriptors. They live as long as the
+// compiler does, so nothing is ever freed and neighbours end up adjacent in memory.
+// There is one arena per thread, functions declared in parallel never share a block.
+class TypeArena
+{
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<char*> blocks;
+    size_t used = BLOCK_SIZE;
+
+    void* allocate(size_t size, size_t align)
+    {
+        used = (used + align - 1) & ~(align - 1);
+
+        if (used + size > BLOCK_SIZE)
+        {
+            blocks.push_back(new char[size > BLOCK_SIZE ? size : BLOCK_SIZE]);
+            used = 0;
+        }
+
+        void* memory = blocks.back() + used;
+        used += size;
+        return memory;
+    }
+
+public:
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T{ std::forward<Args>(args)... };
+    }
+};
+
+extern thread_local TypeArena typeArena;
+
+// Hash-consed type structure: every distinct key gets exactly one id, so two
+// types are the same type iff their ids are equal. Records and unions are keyed
+// by their own index (name equivalence), tuples by the ids of their elements.
+class TypeInterner
+{
+    struct KeyHash
+    {
+        size_t operator()(const std::vector<int>& key) const
+        {
+            size_t hash = key.size();
+            for (int part : key)
+                hash ^= (unsigned)part + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+    };
+
+    std::unordered_map<std::vector<int>, int, KeyHash> ids;
+
+public:
+    enum { INVALID = 0, TUPLE = -1, UNKNOWN = -2 };
+
+    int intern(const std::vector<int>& key)
+    {
+        return ids.emplace(key, (int)ids.size() + 1).first->second;
+    }
+
+    // a one element tuple is the element itself, so a single assignment and a
+    // one entry idList compare alike; any INVALID element poisons the tuple
+    int tuple(const std::vector<int>& elements)
+    {
+        if (elements.size() == 1)
+            return elements[0];
+
+        std::vector<int> key{ TUPLE };
+        for (int element : elements)
+        {
+            if (element == INVALID)
+                return INVALID;
+            key.push_back(element);
+        }
+
+        return intern(key);
+    }
+
+    // tuple() without adding the key, safe while other threads read the table.
+    // A tuple nobody interned matches no signature and comes back as UNKNOWN.
+    int findTuple(const std::vector<int>& elements) const
+    {
+        if (elements.size() == 1)
+            return elements[0];
+
+        std::vector<int> key{ TUPLE };
+        for (int element : elements)
+        {
+            if (element == INVALID)
+                return INVALID;
+            key.push_back(element);
+        }
+
+        auto it = ids.find(key);
+        return it == ids.end() ? (int)UNKNOWN : it->second;
+    }
+};
+
+extern TypeInterner typeInterner;
+
+// Open addressing hash map keyed by interned symbol ids (see internSymbol).
+// A miss never inserts; find() hands back nullptr instead.
+template <typename T>
+class SymbolMap
+{
+    enum { EMPTY = -1 };
+
+    std::vector<int> keys;
+    std::vector<T> values;
+    int count = 0;
+
+    int slotOf(int symbol) const
+    {
+        // multiplying by an odd constant permutes the dense ids across the table
+        unsigned mask = (unsigned)keys.size() - 1;
+        unsigned slot = ((unsigned)symbol * 2654435769u) & mask;
+
+        while (keys[slot] != EMPTY && keys[slot] != symbol)
+            slot = (slot + 1) & mask;
+
+        return slot;
+    }
+
+    void grow()
+    {
+        std::vector<int> oldKeys(keys.empty() ? 16 : keys.size() * 2, EMPTY);
+        std::vector<T> oldValues(oldKeys.size());
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+
+        for (size_t i = 0; i < oldKeys.size(); ++i)
+        {
+            if (oldKeys[i] == EMPTY)
+                continue;
+
+            int slot = slotOf(oldKeys[i]);
+            keys[slot] = oldKeys[i];
+            values[slot] = oldValues[i];
+        }
+    }
+
+public:
+    T* find(int symbol)
+    {
+        if (count == 0 || symbol < 0)
+            return nullptr;
+
+        int slot = slotOf(symbol);
+        return keys[slot] == EMPTY ? nullptr : &values[slot];
+    }
+
+    const T* find(int symbol) const
+    {
+        return const_cast<SymbolMap*>(this)->find(symbol);
+    }
+
+    T& insert(int symbol, const T& value)
+    {
+        // keep the load factor under 3/4
+        if ((count + 1) * 4 > (int)keys.size() * 3)
+            grow();
+
+        int slot = slotOf(symbol);
+
+        if (keys[slot] == EMPTY)
+        {
+            keys[slot] = symbol;
+            count++;
+        }
+
+        return values[slot] = value;
+    }
+
+    int size() const
+    {
+        return count;
+    }
+
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+            if (keys[i] != EMPTY)
+                func(keys[i], values[i]);
+    }
+};
+
+// A scope: lookups fall through to the parent scope (function -> global)
+class SymbolTable : public SymbolMap<TypeLog*>
+{
+public:
+    const SymbolTable* parent;
+
+    SymbolTable(const SymbolTable* parent = nullptr) : parent{ parent }
+    {
+
+    }
+
+    TypeLog* lookup(int symbol) const
+    {
+        for (auto scope = this; scope; scope = scope->parent)
+            if (auto entry = scope->find(symbol))
+                return *entry;
+
+        return nullptr;
+    }
+
+    TypeLog* lookup(const std::string& name) const
+    {
+        return lookup(findSymbol(name));
+    }
+};
+
+extern SymbolTable globalSymbolTable;
+
 // Derived Classes
 class FuncEntry : public TypeEntry
 {
 public:
     int identifierCount = 0;
-    std::list<std::pair<std::string, TypeLog*>> argTypes;
-    std::list<std::pair<std::string, TypeLog*>> retTypes;
-    std::map<std::string, TypeLog*> symbolTable;
+    std::vector<std::pair<std::string, TypeLog*>> argTypes;
+    std::vector<std::pair<std::string, TypeLog*>> retTypes;
+    int argTuple = 0;   // typeInterner ids of the parameter lists
+    int retTuple = 0;
+
+    // frame: inputs from 0, then outputs, then locals; offsets and sizes set by bindNames
+    std::vector<VariableEntry*> variables;  // declaration order
+    int outputOffset = 0;
+    int localOffset = 0;
+    int frameSize = 0;
+    int order = 0;      // position among the program's functions, main last
+    SymbolTable symbolTable{ &globalSymbolTable };
 
     FuncEntry(const std::string& name) : TypeEntry(name)
     {
@@ -62,8 +301,10 @@ public:
 class VariableEntry : public TypeEntry
 {
 public:
-    int offset = 0;
+    int offset = 0;     // in the frame of its function, or in the global area
+    int slot = 0;       // position among the variables of the same storage
     bool isGlobal = 0;
+    Storage storage = Storage::LOCAL;
     TypeLog* type = nullptr;
 
     VariableEntry(const std::string& name) : TypeEntry(name)
@@ -72,21 +313,66 @@ public:
     }
 };
 
+struct FieldEntry
+{
+    std::string name;
+    int symbol;
+    TypeLog* type;
+    int offset;     // bytes from the start of the record, always 0 in a union
+};
+
 class DerivedEntry : public TypeEntry
 {
 public:
     const bool isUnion;
-    std::list<std::pair<std::string, TypeLog*>> fields;
+    int line_number = 0;
+    int padding = 0;                // bytes of the width not taken by field data
+    std::vector<FieldEntry> fields; // declaration order, offsets need not increase along it
+    SymbolMap<int> fieldIndex;      // field symbol -> position in fields
 
     DerivedEntry(const std::string& name, bool isUnion) : TypeEntry(name), isUnion {isUnion}
     {
 
     }
+
+    const FieldEntry* findField(int symbol) const
+    {
+        const int* position = fieldIndex.find(symbol);
+        return position ? &fields[*position] : nullptr;
+    }
 };
 
+inline FuncEntry* TypeLog::function() const
+{
+    assert(entryType == TypeTag::FUNCTION);
+    return static_cast<FuncEntry*>(structure);
+}
+
+inline VariableEntry* TypeLog::variable() const
+{
+    assert(entryType == TypeTag::VARIABLE);
+    return static_cast<VariableEntry*>(structure);
+}
+
+inline DerivedEntry* TypeLog::derived() const
+{
+    assert(entryType == TypeTag::DERIVED);
+    return static_cast<DerivedEntry*>(structure);
+}
+
+extern std::vector<VariableEntry*> globalVariables;     // declaration order
+
+int roundUp(int value, int align);
+
 extern int dataTypeCount;
 extern int identifierCount;
-extern std::map<std::string, TypeLog*> globalSymbolTable;
-extern std::map<std::string, TokenType> prefixTable;
+extern bool isSymbolError;
+extern bool reorderFields;      // lay records out by alignment and field use instead of declaration order
+extern SymbolMap<TokenType> prefixTable;
+
+// Global pass: functions, records, aliases, global variables and signatures.
+// The global tables are read-only afterwards.
+void loadSymbolTable(const ASTNode*);
 
-void loadSymbolTable(const ASTNode*);
\ No newline at end of file
+// Parameters and locals of one function, touches nothing but its own FuncEntry
+void loadLocalSymbols(const ASTNode* function, Diagnostics&);
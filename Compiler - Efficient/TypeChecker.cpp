@@ -1,268 +1,399 @@
 #include "TypeChecker.h"
+#include "WorkPool.h"
 #include <iostream>
+#include <algorithm>
+#include <cassert>
 
 using namespace std;
 
 TypeLog* real, * integer, * boolean, * void_empty;
 bool isTypeError;
-map<string, TypeLog*> *localSymbolTable;
 
-int areCompatible(ASTNode* leftNode, ASTNode* rightNode)
+// Everything the checker needs while inside one function. Each function has its own,
+// so functions can be checked in parallel against the frozen global tables.
+struct CheckContext
 {
-    TypeLog* left = leftNode->derived_type;
-    TypeLog* right = rightNode->derived_type;
-    while (leftNode && rightNode)
-    {
-        left = leftNode->derived_type;
-        right = rightNode->derived_type;
+    const SymbolTable* scope;
+    Diagnostics& diagnostics;
+};
+
+// how an operand is spelled in diagnostics
+string describe(const ASTNode* node)
+{
+    if (!node)
+        return "(null)";
 
-        if (left != right || left == boolean || left == void_empty || !left || !right)
-            return 0;
+    if (node->type == NonTerminalType::ID)
+        return static_cast<const IDNode*>(node)->varName;
 
-        leftNode = leftNode->sibling;
-        rightNode = rightNode->sibling;
+    if (node->type == NonTerminalType::NUM)
+        return static_cast<const NumNode*>(node)->lexeme;
+
+    if (node->type == NonTerminalType::OPERATOR && static_cast<const OperatorNode*>(node)->op == TokenType::TK_DOT)
+        return describe(node->children[0]) + "." + describe(node->children[1]);
+
+    return "(expression)";
+}
+
+const char* opLexeme(TokenType op)
+{
+    switch (op)
+    {
+    case TokenType::TK_PLUS: return "+";
+    case TokenType::TK_MINUS: return "-";
+    case TokenType::TK_MUL: return "*";
+    case TokenType::TK_DIV: return "/";
+    case TokenType::TK_AND: return "&&&";
+    case TokenType::TK_OR: return "@@@";
+    case TokenType::TK_NOT: return "~";
+    case TokenType::TK_LT: return "<";
+    case TokenType::TK_LE: return "<=";
+    case TokenType::TK_EQ: return "==";
+    case TokenType::TK_GT: return ">";
+    case TokenType::TK_GE: return ">=";
+    case TokenType::TK_NE: return "!=";
+    default: return "<---";
     }
-    return !leftNode && !rightNode;
 }
 
-TypeLog* finalType(ASTNode* leftNode, ASTNode* rightNode, Token* opToken)
+int typeIdOf(const ASTNode* node)
+{
+    return node && node->derived_type ? node->derived_type->typeId : (int)TypeInterner::INVALID;
+}
+
+// canonical id of the types along a sibling chain, e.g. an idList
+int listTypeId(const ASTNode* list)
+{
+    vector<int> elements;
+
+    for (; list; list = list->sibling)
+        elements.push_back(typeIdOf(list));
+
+    return typeInterner.findTuple(elements);
+}
+
+// a list holding an already reported undeclared name or unknown type is not reported again
+bool mismatch(int listId, int expectedId)
+{
+    return listId != TypeInterner::INVALID && expectedId != TypeInterner::INVALID && listId != expectedId;
+}
+
+int areCompatible(ASTNode* leftNode, ASTNode* rightNode)
+{
+    int left = listTypeId(leftNode);
+
+    return left != TypeInterner::INVALID && left != boolean->typeId && left != void_empty->typeId && left == listTypeId(rightNode);
+}
+
+TypeLog* finalType(ASTNode* leftNode, ASTNode* rightNode, TokenType op, int line_number, CheckContext& context)
 {
     TypeLog* left = leftNode->derived_type;
     TypeLog* right = rightNode ? rightNode->derived_type : nullptr;
-    TokenType op = opToken->type;
+    const char* opName = opLexeme(op);
 
     if (op == TokenType::TK_ASSIGNOP)
     {
         if (areCompatible(leftNode, rightNode))
             return void_empty;
 
-        isTypeError = true;
-        cerr << "Assignment with incompatible types at line no. " << opToken->line_number << endl;
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_ASSIGNMENT, line_number);
         return nullptr;
     }
 
     if (op == TokenType::TK_PLUS || op == TokenType::TK_MINUS)
     {
-        if (left == right && left != boolean && left != void_empty && left && right)
+        int id = typeIdOf(leftNode);
+
+        if (id == typeIdOf(rightNode) && id != TypeInterner::INVALID && id != boolean->typeId && id != void_empty->typeId)
             return right;
 
-        isTypeError = true;
-        cerr << "Operation " << leftNode->token->lexeme << " " << opToken->lexeme << " " << rightNode->token->lexeme << " with incompatible types at line no. " << opToken->line_number << endl;
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_OPERATION, line_number, { describe(leftNode), opName, describe(rightNode) });
         return nullptr;
     }
 
     if (op == TokenType::TK_MUL)
     {
-        if (left == right && (left == real || left == integer) && left != boolean && left != void_empty)
-            return left;
+        int id = typeIdOf(leftNode);
 
-        // TODO
+        if (id == typeIdOf(rightNode) && (id == real->typeId || id == integer->typeId))
+            return left;
 
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_OPERATION, line_number, { describe(leftNode), opName, describe(rightNode) });
         return nullptr;
     }
 
     if (op == TokenType::TK_DIV)
     {
-        int first_type = left == real ? 0x01 : left == integer ? 0x02 : 0x04;
-        int second_type = right == real ? 0x01 : right == integer ? 0x02 : 0x04;
+        int first = typeIdOf(leftNode), second = typeIdOf(rightNode);
 
-        if ((first_type & 0x03) && (second_type & 0x03) && left != boolean && left != void_empty)
+        if ((first == real->typeId || first == integer->typeId) && (second == real->typeId || second == integer->typeId))
             return real;
 
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_OPERATION, line_number, { describe(leftNode), opName, describe(rightNode) });
         return nullptr;
     }
 
     if (op == TokenType::TK_AND || op == TokenType::TK_OR)
     {
-        if (left == boolean && right == boolean)
+        if (typeIdOf(leftNode) == boolean->typeId && typeIdOf(rightNode) == boolean->typeId)
             return boolean;
 
-        isTypeError = true;
-        cerr << "Operation " << leftNode->token->lexeme << " " << opToken->lexeme << " " << rightNode->token->lexeme << " with incompatible types at line no. " << opToken->line_number << endl;
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_OPERATION, line_number, { describe(leftNode), opName, describe(rightNode) });
         return nullptr;
     }
 
     if (op == TokenType::TK_EQ || op == TokenType::TK_NE || op == TokenType::TK_GE || op == TokenType::TK_LE || op == TokenType::TK_LT || op == TokenType::TK_GT)
     {
-        if (left == real && right == real)
-            return boolean;
+        int id = typeIdOf(leftNode);
 
-        if (left == integer && right == integer)
+        if (id == typeIdOf(rightNode) && (id == real->typeId || id == integer->typeId))
             return boolean;
 
-        isTypeError = true;
-        cerr << "Operation " << leftNode->token->lexeme << " " << opToken->lexeme << " " << rightNode->token->lexeme << " with incompatible types at line no. " << opToken->line_number << endl;
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_OPERATION, line_number, { describe(leftNode), opName, describe(rightNode) });
         return nullptr;
     }
 
     if (op == TokenType::TK_NOT)
     {
-        if (left == boolean)
+        if (typeIdOf(leftNode) == boolean->typeId)
             return boolean;
 
-        isTypeError = true;
-        cerr << "Operation " << leftNode->token->lexeme << " " << opToken->lexeme << " with incompatible types at line no. " << opToken->line_number << endl;
+        context.diagnostics.report(DiagCode::INCOMPATIBLE_UNARY_OPERATION, line_number, { opName, describe(leftNode) });
         return nullptr;
     }
 
     assert(false);
+    return nullptr;
 }
 
 void typeChecker_init()
 {
-    real = globalSymbolTable["real"];
-    integer = globalSymbolTable["int"];
-    boolean = globalSymbolTable["##bool"];
-    void_empty = globalSymbolTable["##void"];
-    localSymbolTable = &globalSymbolTable;
+    real = globalSymbolTable.lookup("real");
+    integer = globalSymbolTable.lookup("int");
+    boolean = globalSymbolTable.lookup("##bool");
+    void_empty = globalSymbolTable.lookup("##void");
 }
 
-void assignTypes(ASTNode* node)
+void assignTypes(ASTNode* node, CheckContext& context)
 {
     if (!node)
         return;
 
-    if (node->sym_index == 57)
+    if (node->type == NonTerminalType::STMTS)
     {
-        // program -> functions, main
+        // stmts -> .. .. stmt return
 
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
+        assignTypes(node->children[2], context);
+        assignTypes(node->children[3], context);
     }
-    else if (node->sym_index == 58 || node->sym_index == 60)
+    else if (node->type == NonTerminalType::ASSIGNMENT)
     {
-        // function/main-function
+        // assignment --> <identifier> = <expression>
 
-        localSymbolTable = &(dynamic_cast<FuncEntry*>(globalSymbolTable[node->token->lexeme]->structure))->symbolTable;
+        AssignmentNode* assignment = static_cast<AssignmentNode*>(node);
 
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
-        assignTypes(node->children[2]);
+        assignTypes(assignment->target, context);
+        assignTypes(node->children[0], context);
+        node->derived_type = finalType(assignment->target, node->children[0], TokenType::TK_ASSIGNOP, node->line_number, context);
     }
-    else if (node->sym_index == 68)
+    else if (node->type == NonTerminalType::FUNCTIONCALL)
     {
-        // stmts -> .. .. stmt ..
+        // function call statement
 
-        assignTypes(node->children[1]);
-        assignTypes(node->children[2]);
-    }
-    else if (node->sym_index == 81)
-    {
-        // assignment --> <identifier> = <expression>
+        FunctionCallNode* call = static_cast<FunctionCallNode*>(node);
+        TypeLog* callee = globalSymbolTable.lookup(call->name);
 
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
-        node->derived_type = finalType(node->children[0], node->children[1], node->token);
-    }
-    else if (node->sym_index == 86)
-    {
-        // function call statement
+        assignTypes(node->children[0], context);
+        assignTypes(node->children[1], context);
+
+        node->derived_type = node->children[0] ? node->children[0]->derived_type : void_empty;
+
+        if (callee == nullptr || callee->entryType != TypeTag::FUNCTION)
+        {
+            context.diagnostics.report(DiagCode::UNDEFINED_FUNCTION, node->line_number, { call->name });
+        }
+        else
+        {
+            FuncEntry* entry = callee->function();
 
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
+            if (mismatch(listTypeId(node->children[0]), entry->retTuple))
+            {
+                context.diagnostics.report(DiagCode::CALL_OUTPUT_MISMATCH, node->line_number, { call->name });
+            }
 
-        node->derived_type = node->children[0]->derived_type;
+            if (mismatch(listTypeId(node->children[1]), entry->argTuple))
+            {
+                context.diagnostics.report(DiagCode::CALL_INPUT_MISMATCH, node->line_number, { call->name });
+            }
+        }
     }
-    else if (node->sym_index == 89)
+    else if (node->type == NonTerminalType::ITERATIVE)
     {
         // iterative statement, while
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
+        assignTypes(node->children[0], context);
+        assignTypes(node->children[1], context);
 
         node->derived_type = void_empty;
     }
-    else if (node->sym_index == 90)
+    else if (node->type == NonTerminalType::CONDITIONAL)
     {
         // if-else
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
-        assignTypes(node->children[2]);
+        assignTypes(node->children[0], context);
+        assignTypes(node->children[1], context);
+        assignTypes(node->children[2], context);
 
         node->derived_type = void_empty;
     }
-    else if (node->sym_index == 92)
+    else if (node->type == NonTerminalType::READ)
     {
-        // io
-        assignTypes(node->children[0]);
+        assignTypes(static_cast<ReadNode*>(node)->target, context);
 
         node->derived_type = void_empty;
     }
-    else if (node->sym_index == 63 || node->sym_index == 77)
+    else if (node->type == NonTerminalType::WRITE)
     {
-        // idList
+        assignTypes(static_cast<WriteNode*>(node)->target, context);
 
-        for (auto temp = node; temp; temp = temp->sibling)
-        {
-            TypeLog* mediator = (*localSymbolTable)[node->token->lexeme];
+        node->derived_type = void_empty;
+    }
+    else if (node->type == NonTerminalType::ID)
+    {
+        // identifier use, or one entry of an idList
 
-            if (mediator == nullptr)
-                mediator = globalSymbolTable[node->token->lexeme];
+        IDNode* id = static_cast<IDNode*>(node);
+        TypeLog* entry = context.scope->lookup(id->symbol);
 
-            VariableEntry* entry = dynamic_cast<VariableEntry*>(mediator->structure);
-            temp->derived_type = entry->type;
+        if (entry == nullptr || entry->entryType != TypeTag::VARIABLE)
+        {
+            context.diagnostics.report(DiagCode::UNDECLARED_VARIABLE, node->line_number, { id->varName });
         }
+        else
+            node->derived_type = entry->variable()->type;
     }
-    else if (node->sym_index == 108)
+    else if (node->type == NonTerminalType::NUM)
+        node->derived_type = static_cast<NumNode*>(node)->isReal ? real : integer;
+    else if (node->type == NonTerminalType::OPERATOR)
     {
-        // typedef
+        TokenType op = static_cast<OperatorNode*>(node)->op;
 
-        node->derived_type = globalSymbolTable[node->children[0]->token->lexeme];
-        node->children[1]->derived_type = node->children[2]->derived_type = node->derived_type;
-    }
-    else if (
-        node->token->type == TokenType::TK_PLUS ||
-        node->token->type == TokenType::TK_MINUS ||
-        node->token->type == TokenType::TK_MUL ||
-        node->token->type == TokenType::TK_DIV ||
-        node->token->type == TokenType::TK_AND ||
-        node->token->type == TokenType::TK_OR ||
-        node->token->type == TokenType::TK_EQ ||
-        node->token->type == TokenType::TK_NE ||
-        node->token->type == TokenType::TK_GE ||
-        node->token->type == TokenType::TK_GT ||
-        node->token->type == TokenType::TK_LE ||
-        node->token->type == TokenType::TK_LT)
-    {
-        assignTypes(node->children[0]);
-        assignTypes(node->children[1]);
+        if (op == TokenType::TK_DOT)
+        {
+            // <dot> ===> <left> TK_DOT <right>
+            assignTypes(node->children[0], context);
+
+            TypeLog* left = node->children[0]->derived_type;
+            IDNode* field = static_cast<IDNode*>(node->children[1]);
+
+            if (left && left->entryType == TypeTag::DERIVED)
+            {
+                // the left side already carries the offset of everything before this TK_DOT
+                const FieldEntry* entry = left->derived()->findField(field->symbol);
+                const ASTNode* base = node->children[0];
+
+                if (entry)
+                {
+                    field->derived_type = entry->type;
+                    static_cast<OperatorNode*>(node)->offset = entry->offset +
+                        (base->type == NonTerminalType::OPERATOR ? static_cast<const OperatorNode*>(base)->offset : 0);
+                }
+            }
+
+            if (left && field->derived_type == nullptr)
+            {
+                context.diagnostics.report(DiagCode::UNKNOWN_FIELD, node->line_number, { field->varName, describe(node->children[0]) });
+            }
+
+            node->derived_type = field->derived_type;
+        }
+        else if (op == TokenType::TK_NOT)
+        {
+            assignTypes(node->children[0], context);
 
-        node->derived_type = finalType(node->children[0], node->children[1], node->token);
-    }
-    else if (node->token->type == TokenType::TK_NOT)
-    {
-        assignTypes(node->children[0]);
+            node->derived_type = finalType(node->children[0], nullptr, op, node->line_number, context);
+        }
+        else
+        {
+            assignTypes(node->children[0], context);
+            assignTypes(node->children[1], context);
 
-        node->derived_type = finalType(node->children[0], nullptr, node->token);
+            node->derived_type = finalType(node->children[0], node->children[1], op, node->line_number, context);
+        }
     }
-    else if (node->token->type == TokenType::TK_ID)
-    {
-        TypeLog* entry = (*localSymbolTable)[node->token->lexeme];
 
-        if (entry == nullptr)
-            entry = globalSymbolTable[node->token->lexeme];
+    assignTypes(node->sibling, context);
+}
 
-        node->derived_type = (dynamic_cast<VariableEntry*>(entry->structure))->type;
-    }
-    else if (node->token->type == TokenType::TK_DOT)
+void checkFunction(ASTNode* node, Diagnostics& diagnostics)
+{
+    // function/main-function
+
+    FuncNode* func = static_cast<FuncNode*>(node);
+    FuncEntry* entry = globalSymbolTable.lookup(func->Name)->function();
+    CheckContext context{ &entry->symbolTable, diagnostics };
+
+    assignTypes(node->children[2], context);
+
+    // the return statement hands back the output parameters
+    ASTNode* returned = node->children[2]->children[3];
+    int line_number = returned ? returned->line_number : node->line_number;
+
+    if (mismatch(listTypeId(returned), entry->retTuple))
+        diagnostics.report(DiagCode::RETURN_MISMATCH, line_number, { func->Name });
+}
+
+int nodeCount(const ASTNode* node)
+{
+    int count = 0;
+
+    for (; node; node = node->sibling)
     {
-        // <dot> ===> <left> TK_DOT <right>
-        assignTypes(node->children[0]);
+        count++;
+        for (auto child : node->children)
+            count += nodeCount(child);
+    }
+
+    return count;
+}
+
+void checkFunctions(ASTNode* program, int threads)
+{
+    // program -> functions, main
+
+    vector<ASTNode*> functions;
 
-        DerivedEntry* leftEntry = dynamic_cast<DerivedEntry*>(node->children[0]->derived_type->structure);
+    for (auto func = program->children[0]; func; func = func->sibling)
+        functions.push_back(func);
 
-        // search for token on right of DOT
-        for (auto& x : leftEntry->fields)
-            if (x.first == node->children[1]->token->lexeme)
-                node->children[1]->derived_type = x.second;
+    functions.push_back(program->children[1]);
 
-        assert(node->children[1]->derived_type != nullptr);
+    // biggest functions first, so the longest one is never left to start last
+    vector<int> order(functions.size()), weight(functions.size());
 
-        node->derived_type = node->children[1]->derived_type;
+    for (size_t i = 0; i < functions.size(); ++i)
+    {
+        order[i] = (int)i;
+        weight[i] = nodeCount(functions[i]->children[2]);
     }
-    else if (node->token->type == TokenType::TK_NUM)
-        node->derived_type = globalSymbolTable["int"];
-    else if (node->token->type == TokenType::TK_RNUM)
-        node->derived_type = globalSymbolTable["real"];
 
-    assignTypes(node->sibling);
-}
\ No newline at end of file
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return weight[a] > weight[b]; });
+
+    vector<Diagnostics> diagnostics(functions.size());
+    int count = (int)functions.size();
+
+    parallelFor(count, threads, [&](int i) { loadLocalSymbols(functions[order[i]], diagnostics[order[i]]); });
+
+    for (auto& unit : diagnostics)
+        isSymbolError |= unit.hasErrors();
+
+    diagnosticLog.merge(diagnostics);
+
+    if (isSymbolError)
+        return;
+
+    parallelFor(count, threads, [&](int i) { checkFunction(functions[order[i]], diagnostics[order[i]]); });
+
+    for (auto& unit : diagnostics)
+        isTypeError |= unit.hasErrors();
+
+    diagnosticLog.merge(diagnostics);
+}
@@ -4,4 +4,8 @@
 
 extern bool isTypeError;
 void typeChecker_init();
-void assignTypes(ASTNode*);
\ No newline at end of file
+
+// Declares the locals of every function and type checks the bodies, on `threads`
+// workers when threads > 1. Needs loadSymbolTable first; the global tables are
+// only read from here on. Diagnostics land in diagnosticLog in line order either way.
+void checkFunctions(ASTNode* program, int threads = 1);
\ No newline at end of file
@@ -0,0 +1,682 @@
+#include "VM.h"
+#include "JIT.h"
+#include "Runtime.h"
+#include <cassert>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// picks the _I or _R member of a run of opcodes laid out like Opcode's
+VMOp typed(VMOp intBase, VMOp realBase, IRType type, int index = 0)
+{
+    return (VMOp)((int)(type == IRType::REAL ? realBase : intBase) + index);
+}
+
+int negated(int value, IRType type)
+{
+    if (type != IRType::REAL)
+        return (int16_t)-value;
+
+    float real;
+    memcpy(&real, &value, sizeof real);
+    real = -real;
+    memcpy(&value, &real, sizeof value);
+    return value;
+}
+
+struct Assembler
+{
+    const IRFunction& ir;
+    VMFunction& out;
+
+    vector<int> uses;
+    vector<int> defs;
+    vector<int> useBlock;           // the block of a register's last use
+    vector<bool> pending;           // a single use CONST not emitted yet, its value waits in constant
+    vector<int> constant;
+    vector<int> blockStart;
+    vector<pair<size_t, int VMInstr::*>> fixups;   // operands that still hold a block number
+
+    Assembler(const IRFunction& ir, VMFunction& out)
+        : ir(ir), out(out), uses(ir.regs.size()), defs(ir.regs.size()), useBlock(ir.regs.size()), pending(ir.regs.size()), constant(ir.regs.size())
+    {
+    }
+
+    void emit(VMOp op, int dst = -1, int a = -1, int b = -1, int c = -1)
+    {
+        out.code.push_back({ op, dst, a, b, c });
+    }
+
+    void target(int VMInstr::* field)
+    {
+        fixups.push_back({ out.code.size() - 1, field });
+    }
+
+    // a register ready to be read, materializing a postponed constant
+    int operand(int reg)
+    {
+        if (pending[reg])
+        {
+            emit(VMOp::LOADK, reg, constant[reg]);
+            pending[reg] = false;
+        }
+
+        return reg;
+    }
+
+    bool immediate(int reg, int& value)
+    {
+        if (!pending[reg])
+            return false;
+
+        value = constant[reg];
+        pending[reg] = false;
+        return true;
+    }
+
+    void operands(int list)
+    {
+        for (int i = 0; i < ir.listSize(list); ++i)
+            operand(ir.listItems(list)[i]);
+    }
+
+    void countUses()
+    {
+        vector<int> regs;
+
+        for (int b = 0; b < (int)ir.blocks.size(); ++b)
+            for (auto& in : ir.blocks[b].code)
+            {
+                regs.clear();
+                usesOf(ir, in, regs);
+
+                for (int reg : regs)
+                {
+                    ++uses[reg];
+                    useBlock[reg] = b;
+                }
+
+                regs.clear();
+                defsOf(ir, in, regs);
+
+                for (int reg : regs)
+                    ++defs[reg];
+            }
+    }
+
+    // LOAD m; [CONST k;] ADD/SUB; STORE m, with every temporary used once: m += k in place.
+    // Returns how many instructions it covered, 0 if the shape does not match.
+    size_t increment(const vector<Instr>& code, size_t k)
+    {
+        const Instr& load = code[k];
+        size_t j = k + 1;
+        int constReg = -1, value = 0;
+
+        if (load.type == IRType::BOOL || uses[load.dst] != 1)
+            return 0;
+
+        if (j < code.size() && code[j].op == Opcode::CONST && uses[code[j].dst] == 1)
+            constReg = code[j++].dst;
+
+        if (j + 1 >= code.size())
+            return 0;
+
+        const Instr& op = code[j];
+        const Instr& store = code[j + 1];
+
+        if ((op.op != Opcode::ADD && op.op != Opcode::SUB) || op.type != load.type)
+            return 0;
+
+        if (store.op != Opcode::STORE || store.a != load.a || store.b != load.b || store.c != op.dst || uses[op.dst] != 1)
+            return 0;
+
+        int other;
+        if (op.a == load.dst)
+            other = op.b;
+        else if (op.b == load.dst && op.op == Opcode::ADD)
+            other = op.a;
+        else
+            return 0;
+
+        if (other == constReg)
+            value = code[k + 1].a;
+        else if (constReg >= 0 || !immediate(other, value))
+            return 0;
+
+        if (op.op == Opcode::SUB)
+            value = negated(value, op.type);
+
+        VMOp inc = load.a == AREA_GLOBAL ? typed(VMOp::INCG_I, VMOp::INCG_R, load.type) : typed(VMOp::INCF_I, VMOp::INCF_R, load.type);
+        emit(inc, -1, load.b, value);
+
+        return j + 2 - k;
+    }
+
+    void lower(const vector<Instr>& code, int block)
+    {
+        for (size_t k = 0; k < code.size(); ++k)
+        {
+            const Instr& in = code[k];
+
+            switch (in.op)
+            {
+            case Opcode::CONST:
+                // out of SSA a register may be set on several paths, only a local temporary waits
+                if (uses[in.dst] == 1 && defs[in.dst] == 1 && useBlock[in.dst] == block)
+                {
+                    pending[in.dst] = true;
+                    constant[in.dst] = in.a;
+                }
+                else
+                    emit(VMOp::LOADK, in.dst, in.a);
+                break;
+
+            case Opcode::COPY:
+                emit(VMOp::MOVE, in.dst, operand(in.a));
+                break;
+
+            case Opcode::ADD:
+            case Opcode::SUB:
+            {
+                int value;
+
+                if (in.type == IRType::INT && immediate(in.b, value))
+                    emit(VMOp::ADDK_I, in.dst, operand(in.a), in.op == Opcode::SUB ? negated(value, in.type) : value);
+                else if (in.type == IRType::INT && in.op == Opcode::ADD && immediate(in.a, value))
+                    emit(VMOp::ADDK_I, in.dst, operand(in.b), value);
+                else
+                {
+                    VMOp op = in.op == Opcode::ADD ? typed(VMOp::ADD_I, VMOp::ADD_R, in.type) : typed(VMOp::SUB_I, VMOp::SUB_R, in.type);
+                    int a = operand(in.a);
+                    emit(op, in.dst, a, operand(in.b));
+                }
+                break;
+            }
+
+            case Opcode::MUL:
+            {
+                int a = operand(in.a);
+                emit(typed(VMOp::MUL_I, VMOp::MUL_R, in.type), in.dst, a, operand(in.b));
+                break;
+            }
+
+            case Opcode::DIV:
+            {
+                int a = operand(in.a);
+                emit(VMOp::DIV_R, in.dst, a, operand(in.b));
+                break;
+            }
+
+            case Opcode::ITOF:
+                emit(VMOp::ITOF, in.dst, operand(in.a));
+                break;
+
+            case Opcode::LT: case Opcode::LE: case Opcode::EQ:
+            case Opcode::GT: case Opcode::GE: case Opcode::NE:
+            {
+                int index = (int)in.op - (int)Opcode::LT;
+                int a = operand(in.a);
+                int b = operand(in.b);
+
+                if (k + 1 < code.size() && code[k + 1].op == Opcode::BRANCH && code[k + 1].a == in.dst && uses[in.dst] == 1)
+                {
+                    // compare and branch in one dispatch
+                    ++k;
+                    emit(typed(VMOp::BLT_I, VMOp::BLT_R, in.type, index), code[k].b, a, b, code[k].c);
+                    target(&VMInstr::dst);
+                    target(&VMInstr::c);
+                }
+                else
+                    emit(typed(VMOp::LT_I, VMOp::LT_R, in.type, index), in.dst, a, b);
+                break;
+            }
+
+            case Opcode::AND:
+            case Opcode::OR:
+            {
+                int a = operand(in.a);
+                emit(in.op == Opcode::AND ? VMOp::AND : VMOp::OR, in.dst, a, operand(in.b));
+                break;
+            }
+
+            case Opcode::NOT:
+                emit(VMOp::NOT, in.dst, operand(in.a));
+                break;
+
+            case Opcode::LOAD:
+            {
+                size_t covered = increment(code, k);
+
+                if (covered)
+                    k += covered - 1;
+                else if (in.a == AREA_GLOBAL)
+                    emit(typed(VMOp::LDG_I, VMOp::LDG_R, in.type), in.dst, in.b);
+                else
+                    emit(typed(VMOp::LDF_I, VMOp::LDF_R, in.type), in.dst, in.b);
+                break;
+            }
+
+            case Opcode::STORE:
+                if (in.a == AREA_GLOBAL)
+                    emit(typed(VMOp::STG_I, VMOp::STG_R, in.type), -1, in.b, operand(in.c));
+                else
+                    emit(typed(VMOp::STF_I, VMOp::STF_R, in.type), -1, in.b, operand(in.c));
+                break;
+
+            case Opcode::VCOPY:
+                emit(VMOp::VCOPY, -1, in.a, in.b, in.c * width(in.type));
+                break;
+
+            case Opcode::VADD:
+            case Opcode::VSUB:
+                emit(typed(VMOp::VADD_I, VMOp::VADD_R, in.type, in.op == Opcode::VSUB), -1, in.a, in.b, in.c);
+                break;
+
+            case Opcode::ADDR:
+                emit(VMOp::ADDR, in.dst, in.a);
+                break;
+
+            case Opcode::LOADREF:
+                emit(typed(VMOp::LDR_I, VMOp::LDR_R, in.type), in.dst, operand(in.a), in.b);
+                break;
+
+            case Opcode::STOREREF:
+            {
+                int a = operand(in.a);
+                emit(typed(VMOp::STR_I, VMOp::STR_R, in.type), -1, a, in.b, operand(in.c));
+                break;
+            }
+
+            case Opcode::ARG:
+                emit(VMOp::ARG, in.dst, in.a);
+                break;
+
+            case Opcode::READ:
+                emit(typed(VMOp::READ_I, VMOp::READ_R, in.type), in.dst);
+                break;
+
+            case Opcode::WRITE:
+                emit(typed(VMOp::WRITE_I, VMOp::WRITE_R, in.type), -1, operand(in.a));
+                break;
+
+            case Opcode::CALL:
+                operands(in.b);
+                emit(VMOp::CALL, -1, in.a, in.b, in.c);
+                break;
+
+            case Opcode::JUMP:
+                // falling through is free
+                if (in.a != block + 1)
+                {
+                    emit(VMOp::JUMP, -1, in.a);
+                    target(&VMInstr::a);
+                }
+                break;
+
+            case Opcode::BRANCH:
+                emit(VMOp::BRANCH, -1, operand(in.a), in.b, in.c);
+                target(&VMInstr::b);
+                target(&VMInstr::c);
+                break;
+
+            case Opcode::RET:
+                operands(in.a);
+                emit(VMOp::RET, -1, in.a);
+                break;
+
+            case Opcode::PHI:
+                assert(false && "phis are removed by leaveSSA");
+                break;
+            }
+        }
+    }
+
+    void run()
+    {
+        out.name = ir.name;
+        out.regCount = (int)ir.regs.size();
+        out.frameSlots = (ir.frameSize + (int)sizeof(Slot) - 1) / (int)sizeof(Slot);
+        out.lists = ir.lists;
+
+        countUses();
+
+        for (int i = 0; i < (int)ir.blocks.size(); ++i)
+        {
+            blockStart.push_back((int)out.code.size());
+            lower(ir.blocks[i].code, i);
+        }
+
+        for (auto& fixup : fixups)
+        {
+            int& operand = out.code[fixup.first].*fixup.second;
+            operand = blockStart[operand];
+        }
+    }
+};
+
+Bytecode assemble(const IRModule& module)
+{
+    Bytecode program;
+    program.mainIndex = module.mainIndex;
+    program.globalSlots = (module.globalSize + (int)sizeof(Slot) - 1) / (int)sizeof(Slot);
+    program.functions.resize(module.functions.size());
+
+    for (size_t i = 0; i < module.functions.size(); ++i)
+        Assembler(module.functions[i], program.functions[i]).run();
+
+    return program;
+}
+
+const char* const vmOpNames[] = {
+#define VM_NAME(name) #name,
+    VM_OPCODES(VM_NAME)
+#undef VM_NAME
+};
+
+void printBytecode(ostream& out, const Bytecode& program)
+{
+    for (size_t i = 0; i < program.functions.size(); ++i)
+    {
+        const VMFunction& fn = program.functions[i];
+        out << endl << "f" << i << ": " << fn.name << " (regs " << fn.regCount << ", frame " << fn.frameSlots << ")" << endl;
+
+        for (size_t pc = 0; pc < fn.code.size(); ++pc)
+        {
+            const VMInstr& in = fn.code[pc];
+            out << "\t" << pc << "\t" << vmOpNames[(int)in.op] << "\t" << in.dst << ", " << in.a << ", " << in.b << ", " << in.c;
+            out << endl;
+        }
+    }
+}
+
+// [to] <- [to] op [from] over count lanes, with SSE four reals or eight ints at a time
+template <bool subtract>
+void realLanes(unsigned char* to, const unsigned char* from, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 a = _mm_loadu_ps((const float*)(to + 4 * i));
+        __m128 b = _mm_loadu_ps((const float*)(from + 4 * i));
+        _mm_storeu_ps((float*)(to + 4 * i), subtract ? _mm_sub_ps(a, b) : _mm_add_ps(a, b));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float a, b;
+        memcpy(&a, to + 4 * i, sizeof a);
+        memcpy(&b, from + 4 * i, sizeof b);
+        a = subtract ? a - b : a + b;
+        memcpy(to + 4 * i, &a, sizeof a);
+    }
+}
+
+template <bool subtract>
+void intLanes(unsigned char* to, const unsigned char* from, int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(to + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(from + 2 * i));
+        _mm_storeu_si128((__m128i*)(to + 2 * i), subtract ? _mm_sub_epi16(a, b) : _mm_add_epi16(a, b));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        int16_t a, b;
+        memcpy(&a, to + 2 * i, sizeof a);
+        memcpy(&b, from + 2 * i, sizeof b);
+        a = (int16_t)(subtract ? a - b : a + b);
+        memcpy(to + 2 * i, &a, sizeof a);
+    }
+}
+
+// One run of a program. Registers and frames of every live activation sit back to back
+// in one preallocated stack, so a call is a bump of top and never allocates.
+struct Machine
+{
+    enum { STACK_SLOTS = 1 << 20 };
+
+    const Bytecode& program;
+    ProgramIO io;
+    ostream& err;
+
+    vector<Slot> stack;
+    vector<Slot> globals;
+    size_t top = 0;
+
+    // a function is compiled to machine code once its calls and loop trips reach jitThreshold
+    int jitThreshold;
+    vector<int> heat;
+    vector<bool> tried;
+    vector<unique_ptr<NativeFunction>> native;
+    JitRuntime runtime;
+
+    Machine(const Bytecode& program, istream& in, ostream& out, ostream& err, int jitThreshold)
+        : program(program), io(in, out), err(err), stack(STACK_SLOTS), globals(program.globalSlots),
+          jitThreshold(jitAvailable() ? jitThreshold : -1), heat(program.functions.size()), tried(program.functions.size()),
+          native(program.functions.size())
+    {
+        runtime.machine = this;
+        runtime.call = [](void* m, int index, Slot* caller, const int* args, const int* results) { return ((Machine*)m)->call(index, caller, args, results); };
+        runtime.readInt = [](void* m) { return ((Machine*)m)->io.readInt(); };
+        runtime.readReal = [](void* m) { return ((Machine*)m)->io.readReal(); };
+        runtime.writeInt = [](void* m, int32_t value) { ((Machine*)m)->io.writeInt(value); };
+        runtime.writeReal = [](void* m, float value) { ((Machine*)m)->io.writeReal(value); };
+    }
+
+    static int16_t loadInt(const unsigned char* at)
+    {
+        int16_t value;
+        memcpy(&value, at, sizeof value);
+        return value;
+    }
+
+    static float loadReal(const unsigned char* at)
+    {
+        float value;
+        memcpy(&value, at, sizeof value);
+        return value;
+    }
+
+    static void storeInt(unsigned char* at, int32_t value)
+    {
+        int16_t narrow = (int16_t)value;
+        memcpy(at, &narrow, sizeof narrow);
+    }
+
+    static void storeReal(unsigned char* at, float value)
+    {
+        memcpy(at, &value, sizeof value);
+    }
+
+    // ARG reads the caller's registers named by args, RET writes the ones named by results
+    bool call(int index, Slot* caller, const int* args, const int* results);
+};
+
+bool Machine::call(int index, Slot* caller, const int* args, const int* results)
+{
+    const VMFunction& fn = program.functions[index];
+    size_t size = (size_t)fn.regCount + fn.frameSlots;
+
+    if (stack.size() - top < size)
+    {
+        io.flush();
+        err << "Runtime error: call stack overflow in " << fn.name << endl;
+        return false;
+    }
+
+    Slot* regs = &stack[top];
+    unsigned char* frame = (unsigned char*)(regs + fn.regCount);
+    unsigned char* data = (unsigned char*)globals.data();
+    unsigned char* base = (unsigned char*)stack.data();
+    const VMInstr* code = fn.code.data();
+    const VMInstr* pc = code;
+
+    memset(frame, 0, fn.frameSlots * sizeof(Slot));
+    top += size;
+
+    // the tiers switch only here, at entry, where both see the same fresh frame
+    if (jitThreshold >= 0 && !tried[index] && heat[index] >= jitThreshold)
+    {
+        tried[index] = true;
+        native[index] = compileNative(fn, runtime);
+    }
+
+    if (native[index])
+    {
+        NativeFrame activation = { regs, caller, args, results, data, base };
+        bool ok = native[index]->entry()(&activation);
+        top -= size;
+        return ok;
+    }
+
+    ++heat[index];
+
+#if defined(__GNUC__)
+    // threaded dispatch: every handler jumps straight to the next one's label
+    static const void* const labels[] = {
+#define VM_LABEL(name) &&op_##name,
+        VM_OPCODES(VM_LABEL)
+#undef VM_LABEL
+    };
+
+#define TARGET(name) op_##name:
+#define DISPATCH() goto *labels[(int)pc->op]
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+
+    DISPATCH();
+#else
+#define TARGET(name) case VMOp::name:
+#define DISPATCH() continue
+#define NEXT() do { ++pc; continue; } while (0)
+
+    for (;;) switch (pc->op) {
+#endif
+
+#define R(field) regs[pc->field]
+#define AT(field) ((addressArea(pc->field) == AREA_GLOBAL ? data : frame) + addressOffset(pc->field))
+#define REF(field) (base + R(field).i + pc->b)
+#define BINARY(name, slot, expr) TARGET(name) { R(dst).slot = (expr); NEXT(); }
+#define COMPARE(name, slot, cmp) TARGET(name) { R(dst).i = R(a).slot cmp R(b).slot; NEXT(); }
+#define BRANCH_IF(name, slot, cmp) TARGET(name) { pc = code + (R(a).slot cmp R(b).slot ? pc->dst : pc->c); DISPATCH(); }
+
+    TARGET(LOADK) { R(dst).i = pc->a; NEXT(); }
+    TARGET(MOVE) { R(dst) = R(a); NEXT(); }
+
+    BINARY(ADD_I, i, (int16_t)(R(a).i + R(b).i))
+    BINARY(SUB_I, i, (int16_t)(R(a).i - R(b).i))
+    BINARY(MUL_I, i, (int16_t)(R(a).i * R(b).i))
+    BINARY(ADDK_I, i, (int16_t)(R(a).i + pc->b))
+    BINARY(ADD_R, f, R(a).f + R(b).f)
+    BINARY(SUB_R, f, R(a).f - R(b).f)
+    BINARY(MUL_R, f, R(a).f * R(b).f)
+    BINARY(DIV_R, f, R(a).f / R(b).f)
+    BINARY(ITOF, f, (float)R(a).i)
+
+    COMPARE(LT_I, i, <) COMPARE(LE_I, i, <=) COMPARE(EQ_I, i, ==)
+    COMPARE(GT_I, i, >) COMPARE(GE_I, i, >=) COMPARE(NE_I, i, !=)
+    COMPARE(LT_R, f, <) COMPARE(LE_R, f, <=) COMPARE(EQ_R, f, ==)
+    COMPARE(GT_R, f, >) COMPARE(GE_R, f, >=) COMPARE(NE_R, f, !=)
+
+    BINARY(AND, i, R(a).i & R(b).i)
+    BINARY(OR, i, R(a).i | R(b).i)
+    BINARY(NOT, i, !R(a).i)
+
+    BINARY(LDF_I, i, loadInt(frame + pc->a))
+    BINARY(LDF_R, f, loadReal(frame + pc->a))
+    BINARY(LDG_I, i, loadInt(data + pc->a))
+    BINARY(LDG_R, f, loadReal(data + pc->a))
+
+    TARGET(STF_I) { storeInt(frame + pc->a, R(b).i); NEXT(); }
+    TARGET(STF_R) { storeReal(frame + pc->a, R(b).f); NEXT(); }
+    TARGET(STG_I) { storeInt(data + pc->a, R(b).i); NEXT(); }
+    TARGET(STG_R) { storeReal(data + pc->a, R(b).f); NEXT(); }
+
+    TARGET(INCF_I) { storeInt(frame + pc->a, loadInt(frame + pc->a) + pc->b); NEXT(); }
+    TARGET(INCG_I) { storeInt(data + pc->a, loadInt(data + pc->a) + pc->b); NEXT(); }
+    TARGET(INCF_R) { Slot k; k.i = pc->b; storeReal(frame + pc->a, loadReal(frame + pc->a) + k.f); NEXT(); }
+    TARGET(INCG_R) { Slot k; k.i = pc->b; storeReal(data + pc->a, loadReal(data + pc->a) + k.f); NEXT(); }
+
+    TARGET(VCOPY) { memmove(AT(a), AT(b), pc->c); NEXT(); }
+    TARGET(VADD_I) { intLanes<false>(AT(a), AT(b), pc->c); NEXT(); }
+    TARGET(VSUB_I) { intLanes<true>(AT(a), AT(b), pc->c); NEXT(); }
+    TARGET(VADD_R) { realLanes<false>(AT(a), AT(b), pc->c); NEXT(); }
+    TARGET(VSUB_R) { realLanes<true>(AT(a), AT(b), pc->c); NEXT(); }
+
+    TARGET(ADDR) { R(dst).i = (int32_t)(frame + pc->a - base); NEXT(); }
+    TARGET(LDR_I) { R(dst).i = loadInt(REF(a)); NEXT(); }
+    TARGET(LDR_R) { R(dst).f = loadReal(REF(a)); NEXT(); }
+    TARGET(STR_I) { storeInt(REF(a), R(c).i); NEXT(); }
+    TARGET(STR_R) { storeReal(REF(a), R(c).f); NEXT(); }
+
+    BRANCH_IF(BLT_I, i, <) BRANCH_IF(BLE_I, i, <=) BRANCH_IF(BEQ_I, i, ==)
+    BRANCH_IF(BGT_I, i, >) BRANCH_IF(BGE_I, i, >=) BRANCH_IF(BNE_I, i, !=)
+    BRANCH_IF(BLT_R, f, <) BRANCH_IF(BLE_R, f, <=) BRANCH_IF(BEQ_R, f, ==)
+    BRANCH_IF(BGT_R, f, >) BRANCH_IF(BGE_R, f, >=) BRANCH_IF(BNE_R, f, !=)
+
+    TARGET(ARG) { R(dst) = caller[args[pc->a]]; NEXT(); }
+
+    TARGET(READ_I) { R(dst).i = io.readInt(); NEXT(); }
+    TARGET(READ_R) { R(dst).f = io.readReal(); NEXT(); }
+
+    TARGET(WRITE_I) { io.writeInt(R(a).i); NEXT(); }
+    TARGET(WRITE_R) { io.writeReal(R(a).f); NEXT(); }
+
+    TARGET(CALL)
+    {
+        if (!call(pc->a, regs, &fn.lists[pc->b + 1], &fn.lists[pc->c + 1]))
+            return false;
+        NEXT();
+    }
+
+    TARGET(JUMP)
+    {
+        // loops end in a jump back, so a long running function heats up like a busy one
+        if (pc->a <= pc - code)
+            ++heat[index];
+        pc = code + pc->a;
+        DISPATCH();
+    }
+    TARGET(BRANCH) { pc = code + (R(a).i ? pc->b : pc->c); DISPATCH(); }
+
+    TARGET(RET)
+    {
+        const int* list = &fn.lists[pc->a];
+
+        for (int i = 0; i < list[0]; ++i)
+            caller[results[i]] = regs[list[i + 1]];
+
+        top -= size;
+        return true;
+    }
+
+#if !defined(__GNUC__)
+    }
+#endif
+
+#undef BRANCH_IF
+#undef COMPARE
+#undef BINARY
+#undef REF
+#undef AT
+#undef R
+#undef NEXT
+#undef DISPATCH
+#undef TARGET
+}
+
+bool execute(const Bytecode& program, istream& in, ostream& out, ostream& err, int jitThreshold)
+{
+    Machine machine(program, in, out, err, jitThreshold);
+    return machine.call(program.mainIndex, nullptr, nullptr, nullptr);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "IR.h"
+#include <istream>
+
+// _I opcodes work on 16 bit ints, _R ones on 32 bit floats. Operands are register numbers
+// of the current activation unless noted: K is an immediate, F/G a byte offset into the
+// frame/global area, targets are instruction indices. A reference is a byte offset from
+// the start of the machine's stack, where every frame lives.
+#define VM_OPCODES(X) \
+    X(LOADK)    /* dst <- K a (an int, or the bits of a float) */ \
+    X(MOVE)     /* dst <- a */ \
+    X(ADD_I) X(SUB_I) X(MUL_I) \
+    X(ADDK_I)   /* dst <- a + K b */ \
+    X(ADD_R) X(SUB_R) X(MUL_R) X(DIV_R) \
+    X(ITOF) \
+    X(LT_I) X(LE_I) X(EQ_I) X(GT_I) X(GE_I) X(NE_I) \
+    X(LT_R) X(LE_R) X(EQ_R) X(GT_R) X(GE_R) X(NE_R) \
+    X(AND) X(OR) X(NOT) \
+    X(LDF_I) X(LDF_R)   /* dst <- [F a] */ \
+    X(LDG_I) X(LDG_R)   /* dst <- [G a] */ \
+    X(STF_I) X(STF_R)   /* [F a] <- b */ \
+    X(STG_I) X(STG_R)   /* [G a] <- b */ \
+    X(INCF_I) X(INCF_R) /* [F a] <- [F a] + K b, for x <--- x + 1 and friends */ \
+    X(INCG_I) X(INCG_R) /* [G a] <- [G a] + K b */ \
+    X(VCOPY)    /* [a] <- [b], c bytes; a and b are IR address()es, into the frame or the globals */ \
+    X(VADD_I) X(VSUB_I) X(VADD_R) X(VSUB_R) /* [a] <- [a] op [b] over c lanes */ \
+    X(ADDR)     /* dst <- a reference to F a */ \
+    X(LDR_I) X(LDR_R)   /* dst <- [reference a + K b] */ \
+    X(STR_I) X(STR_R)   /* [reference a + K b] <- c */ \
+    X(BLT_I) X(BLE_I) X(BEQ_I) X(BGT_I) X(BGE_I) X(BNE_I) /* to dst if a cmp b, else to c */ \
+    X(BLT_R) X(BLE_R) X(BEQ_R) X(BGT_R) X(BGE_R) X(BNE_R) \
+    X(ARG)      /* dst <- input scalar number a */ \
+    X(READ_I) X(READ_R) \
+    X(WRITE_I) X(WRITE_R) \
+    X(CALL)     /* function a, b/c = list of argument/result registers */ \
+    X(JUMP)     /* to a */ \
+    X(BRANCH)   /* to b if a, else to c */ \
+    X(RET)      /* a = list of the returned registers */
+
+enum class VMOp : uint32_t
+{
+#define VM_ENUM(name) name,
+    VM_OPCODES(VM_ENUM)
+#undef VM_ENUM
+};
+
+// one register, or one word of frame storage; never boxed or tagged
+union Slot
+{
+    int32_t i;
+    float f;
+};
+
+struct VMInstr
+{
+    VMOp op;
+    int dst;
+    int a;
+    int b;
+    int c;
+};
+
+// An activation takes regCount registers followed by frameSlots words of frame storage,
+// laid out exactly as the binder placed the variables, records included.
+struct VMFunction
+{
+    std::string name;
+    int regCount = 0;
+    int frameSlots = 0;
+    std::vector<VMInstr> code;
+    std::vector<int> lists;     // same layout and indices as the IR's lists
+};
+
+struct Bytecode
+{
+    std::vector<VMFunction> functions;
+    int mainIndex = -1;
+    int globalSlots = 0;
+};
+
+// Blocks are laid out in IR order, so jumps to the next block disappear. Single use
+// constants become immediates, and a few common shapes are fused into superinstructions.
+Bytecode assemble(const IRModule&);
+
+void printBytecode(std::ostream&, const Bytecode&);
+
+// Runs _main once. Returns false, after a message on err, if the program fails at run time.
+// With a jitThreshold of 0 or more, a function whose calls and loop iterations reach it is
+// compiled to machine code and runs natively from its next call on; -1 only interprets.
+bool execute(const Bytecode&, std::istream& in, std::ostream& out, std::ostream& err, int jitThreshold = -1);
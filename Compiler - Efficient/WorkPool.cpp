@@ -0,0 +1,77 @@
+#include "WorkPool.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+struct WorkQueue
+{
+    mutex lock;
+    deque<int> tasks;
+};
+
+bool takeTask(vector<WorkQueue>& queues, int self, int& next)
+{
+    {
+        lock_guard<mutex> guard(queues[self].lock);
+
+        if (!queues[self].tasks.empty())
+        {
+            next = queues[self].tasks.front();
+            queues[self].tasks.pop_front();
+            return true;
+        }
+    }
+
+    // no task is ever added once the workers start, so a full sweep finding nothing means we are done
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        WorkQueue& victim = queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+
+        if (!victim.tasks.empty())
+        {
+            next = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void parallelFor(int count, int threads, const function<void(int)>& task)
+{
+    if (threads > count)
+        threads = count;
+
+    if (threads <= 1)
+    {
+        for (int i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    vector<WorkQueue> queues(threads);
+
+    for (int i = 0; i < count; ++i)
+        queues[i % threads].tasks.push_back(i);
+
+    auto worker = [&](int self)
+    {
+        int next;
+        while (takeTask(queues, self, next))
+            task(next);
+    };
+
+    vector<thread> pool;
+
+    for (int i = 1; i < threads; ++i)
+        pool.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& t : pool)
+        t.join();
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <functional>
+
+// Runs task(0) .. task(count - 1) on up to `threads` workers and returns once all are done.
+// Tasks are dealt round-robin onto per-worker deques; a worker takes from the front of its
+// own deque and, once that runs dry, steals from the back of the others.
+// With threads <= 1 the tasks simply run in order on the calling thread.
+void parallelFor(int count, int threads, const std::function<void(int)>& task);
@@ -0,0 +1,680 @@
+#include "X86Assembler.h"
+#include "X86Encoder.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+using namespace std;
+
+struct Operand
+{
+    enum Kind { GPR, XMM, IMM, MEM, LABEL } kind = IMM;
+    int reg = 0;
+    int bytes = 0;          // of a GPR
+    int64_t value = 0;      // an IMM, or what is added to the symbol of a rip relative MEM
+    Mem mem{ RAX };
+    string symbol;          // a rip relative MEM's, or a LABEL
+    bool got = false;       // sym@GOTPCREL(%rip): the address of its GOT entry
+    bool plt = false;       // call sym@PLT
+};
+
+// by width: 1, 2, 4 and 8 bytes; the byte registers only those that need no REX prefix
+const char* const gprNames[4][16] = {
+    { "al", "cl", "dl", "bl", "", "", "", "", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+    { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+    { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+    { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+// by Cond, then the other spellings the backend uses
+const char* const condNames[16] = { "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g" };
+const map<string, int> condAliases = { { "z", CC_E }, { "nz", CC_NE }, { "c", CC_B }, { "nc", CC_AE } };
+
+// scalar and packed SSE: opcode into an xmm register, and out to memory for the moves
+struct SseForm
+{
+    int prefix;
+    uint32_t load;
+    uint32_t store;
+};
+
+const map<string, SseForm> sseForms = {
+    { "movss", { 0xF3, 0x0F10, 0x0F11 } }, { "movups", { 0, 0x0F10, 0x0F11 } },
+    { "addss", { 0xF3, 0x0F58, 0 } }, { "subss", { 0xF3, 0x0F5C, 0 } }, { "mulss", { 0xF3, 0x0F59, 0 } }, { "divss", { 0xF3, 0x0F5E, 0 } },
+    { "addps", { 0, 0x0F58, 0 } }, { "subps", { 0, 0x0F5C, 0 } }, { "paddw", { 0x66, 0x0FFD, 0 } }, { "psubw", { 0x66, 0x0FF9, 0 } },
+    { "ucomiss", { 0, 0x0F2E, 0 } }, { "cvtsi2ssl", { 0xF3, 0x0F2A, 0 } }, { "cvtss2sd", { 0xF3, 0x0F5A, 0 } },
+};
+
+// the ALU operations by their /digit, as in ALU_*
+const map<string, int> aluOps = { { "add", ALU_ADD }, { "or", ALU_OR }, { "and", ALU_AND }, { "sub", ALU_SUB }, { "xor", ALU_XOR }, { "cmp", ALU_CMP } };
+
+// one operand instructions in the F6/F7 and FE/FF groups: (byte form, /digit)
+const map<string, pair<int, int>> unaryOps = { { "inc", { 0xFE, 0 } }, { "dec", { 0xFE, 1 } }, { "neg", { 0xF6, 3 } }, { "div", { 0xF6, 6 } } };
+
+string trim(const string& text)
+{
+    size_t from = text.find_first_not_of(" \t");
+    size_t to = text.find_last_not_of(" \t");
+    return from == string::npos ? "" : text.substr(from, to - from + 1);
+}
+
+// splits on the commas outside parentheses
+vector<string> splitOperands(const string& text)
+{
+    vector<string> parts;
+    int depth = 0;
+    string part;
+
+    for (char c : text)
+    {
+        depth += c == '(' ? 1 : c == ')' ? -1 : 0;
+        if (c == ',' && depth == 0)
+        {
+            parts.push_back(trim(part));
+            part.clear();
+        }
+        else
+            part += c;
+    }
+
+    if (!trim(part).empty())
+        parts.push_back(trim(part));
+    return parts;
+}
+
+bool isNumber(const string& text)
+{
+    size_t start = !text.empty() && (text[0] == '-' || text[0] == '+') ? 1 : 0;
+    return text.size() > start && text.find_first_not_of("0123456789", start) == string::npos;
+}
+
+struct ObjectAssembler
+{
+    ObjectFile& object;
+    ostream& err;
+    X86Encoder text;
+    int section = SECTION_TEXT;
+    int line = 0;
+
+    map<string, int> labels;                        // in .text, by name: the encoder's label
+    map<string, int> backward, forward;             // numeric labels: the last one defined, the next one
+    map<string, pair<int, uint64_t>> dataLabels;    // in .rodata and .bss: (section, offset)
+    map<string, uint64_t> dataSizes;                // of the .lcomm ones
+    vector<pair<string, uint64_t>> functions;       // .text symbols in order, with their offsets
+    set<string> defined;
+    set<string> globals;
+    map<string, int> symbolIndex;
+
+    // rip relative operands and calls out of the object, resolved once every section is
+    // laid out; PC32 ones may turn out to be local
+    struct Reference
+    {
+        uint64_t offset;
+        string symbol;
+        int64_t addend;
+        uint32_t type;
+    };
+    vector<Reference> references;
+
+    int ripAt = -1;                                 // the disp32 of the instruction being encoded
+    const Operand* ripOperand = nullptr;
+
+    ObjectAssembler(ObjectFile& object, ostream& err) : object(object), err(err) {}
+
+    bool fail(const string& message)
+    {
+        err << "Assembler: line " << line << ": " << message << endl;
+        return false;
+    }
+
+    int label(const string& name)
+    {
+        auto found = labels.find(name);
+        if (found != labels.end())
+            return found->second;
+        return labels[name] = text.newLabel();
+    }
+
+    int symbol(const string& name, int inSection, uint64_t offset, uint64_t size, bool function)
+    {
+        auto found = symbolIndex.find(name);
+        if (found != symbolIndex.end())
+            return found->second;
+
+        object.symbols.push_back({ name, inSection, offset, size, globals.count(name) > 0 || inSection == SECTION_UNDEFINED, function });
+        return symbolIndex[name] = (int)object.symbols.size() - 1;
+    }
+
+    bool parseOperand(const string& text, Operand& operand)
+    {
+        if (text[0] == '%')
+        {
+            string name = text.substr(1);
+            if (name.compare(0, 3, "xmm") == 0 && isNumber(name.substr(3)))
+            {
+                operand.kind = Operand::XMM;
+                operand.reg = atoi(name.c_str() + 3);
+                return operand.reg < 16 || fail("no register " + text);
+            }
+
+            for (int size = 0; size < 4; ++size)
+                for (int reg = 0; reg < 16; ++reg)
+                    if (*gprNames[size][reg] && name == gprNames[size][reg])
+                    {
+                        operand.kind = Operand::GPR;
+                        operand.reg = reg;
+                        operand.bytes = 1 << size;
+                        return true;
+                    }
+
+            return fail("unknown register " + text);
+        }
+
+        if (text[0] == '$')
+        {
+            if (!isNumber(text.substr(1)))
+                return fail("immediate " + text + " is not a number");
+
+            operand.kind = Operand::IMM;
+            operand.value = strtoll(text.c_str() + 1, nullptr, 10);
+            return true;
+        }
+
+        size_t open = text.find('(');
+        if (open == string::npos)
+        {
+            operand.kind = Operand::LABEL;
+            operand.symbol = text;
+
+            size_t at = text.find("@PLT");
+            if (at != string::npos)
+            {
+                operand.symbol = text.substr(0, at);
+                operand.plt = true;
+            }
+            return true;
+        }
+
+        // [disp | symbol[+offset][@GOTPCREL]](base[, index[, scale]])
+        operand.kind = Operand::MEM;
+        string disp = text.substr(0, open);
+        vector<string> parts = splitOperands(text.substr(open + 1, text.size() - open - 2));
+        vector<int> regs;
+
+        for (size_t i = 0; i < parts.size() && i < 2; ++i)
+        {
+            if (parts[i] == "%rip" && i == 0)
+            {
+                regs.push_back(RIP);
+                continue;
+            }
+
+            Operand reg;
+            if (!parseOperand(parts[i], reg) || reg.kind != Operand::GPR || reg.bytes != 8)
+                return fail("bad address " + text);
+            regs.push_back(reg.reg);
+        }
+
+        if (regs.empty())
+            return fail("bad address " + text);
+
+        operand.mem = regs.size() > 1 ? Mem(regs[0], regs[1], parts.size() > 2 ? atoi(parts[2].c_str()) : 1, 0) : Mem(regs[0]);
+
+        if (disp.empty() || isNumber(disp))
+        {
+            operand.mem.disp = atoi(disp.c_str());
+            return true;
+        }
+
+        if (regs[0] != RIP)
+            return fail("a symbol is only addressed relative to rip: " + text);
+
+        size_t at = disp.find("@GOTPCREL");
+        if (at != string::npos)
+        {
+            operand.got = true;
+            disp = disp.substr(0, at);
+        }
+
+        size_t plus = disp.find_first_of("+-", 1);
+        operand.symbol = disp.substr(0, plus);
+        operand.value = plus == string::npos ? 0 : atoi(disp.c_str() + plus);
+        return true;
+    }
+
+    void immediate(int64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            text.code.push_back((uint8_t)((uint64_t)value >> (8 * i)));
+    }
+
+    // an instruction with a ModRM byte, rm a register or memory
+    void modrm(int prefix, uint32_t op, int opBytes, int reg, const Operand& rm, bool wide = false)
+    {
+        if (rm.kind != Operand::MEM)
+        {
+            text.rr(prefix, op, opBytes, reg, rm.reg, wide);
+            return;
+        }
+
+        text.rm(prefix, op, opBytes, reg, rm.mem, wide);
+        if (rm.mem.base == RIP)
+        {
+            ripAt = (int)text.code.size() - 4;
+            ripOperand = &rm;
+        }
+    }
+
+    bool isRegOrMem(const Operand& operand, Operand::Kind reg) const
+    {
+        return operand.kind == reg || operand.kind == Operand::MEM;
+    }
+
+    // mov, the ALU operations and test, on operands of the given width
+    bool integer(const string& base, int bytes, const vector<Operand>& ops)
+    {
+        if (ops.size() != 2 || !isRegOrMem(ops[1], Operand::GPR))
+            return fail("bad operands for " + base);
+
+        for (auto& op : ops)
+            if (op.kind == Operand::GPR && op.bytes != bytes)
+                return fail("register width does not match " + base);
+
+        const Operand& src = ops[0];
+        const Operand& dst = ops[1];
+        int prefix = bytes == 2 ? 0x66 : 0;
+        bool wide = bytes == 8;
+        int full = bytes == 1 ? 0 : 1;      // the low opcode bit: byte or full width
+
+        if (src.kind == Operand::MEM && dst.kind == Operand::MEM)
+            return fail("two memory operands");
+
+        if (base == "test")
+        {
+            if (src.kind != Operand::GPR)
+                return fail("test takes registers");
+            modrm(prefix, 0x84 + full, 1, src.reg, dst, wide);
+            return true;
+        }
+
+        bool move = base == "mov";
+        int digit = move ? 0 : aluOps.at(base);
+
+        if (src.kind == Operand::IMM)
+        {
+            bool small = !move && bytes > 1 && src.value >= -128 && src.value <= 127;
+            int immBytes = bytes == 1 || small ? 1 : bytes == 2 ? 2 : 4;
+            modrm(prefix, move ? 0xC6 + full : bytes == 1 ? 0x80 : small ? 0x83 : 0x81, 1, digit, dst, wide);
+            immediate(src.value, immBytes);
+        }
+        else if (src.kind == Operand::GPR)
+            modrm(prefix, (move ? 0x88 : digit * 8) + full, 1, src.reg, dst, wide);
+        else if (src.kind == Operand::MEM && dst.kind == Operand::GPR)
+            modrm(prefix, (move ? 0x8A : digit * 8 + 2) + full, 1, dst.reg, src, wide);
+        else
+            return fail("bad operands for " + base);
+
+        return true;
+    }
+
+    // a register loaded from a register or memory operand: imul, lea, movswl, movzbl
+    bool load(uint32_t op, int opBytes, const vector<Operand>& ops, bool wide)
+    {
+        if (ops.size() != 2 || ops[1].kind != Operand::GPR || !isRegOrMem(ops[0], Operand::GPR))
+            return fail("bad operands");
+
+        modrm(0, op, opBytes, ops[1].reg, ops[0], wide);
+        return true;
+    }
+
+    bool target(const Operand& operand, int& id)
+    {
+        if (operand.kind != Operand::LABEL)
+            return fail("jumps and calls take a label");
+
+        const string& name = operand.symbol;
+        if (name.size() > 1 && isNumber(name.substr(0, name.size() - 1)) && (name.back() == 'b' || name.back() == 'f'))
+        {
+            string number = name.substr(0, name.size() - 1);
+            if (name.back() == 'f')
+            {
+                if (!forward.count(number))
+                    forward[number] = text.newLabel();
+                id = forward[number];
+                return true;
+            }
+
+            if (!backward.count(number))
+                return fail("no label " + number + " before " + name);
+            id = backward[number];
+            return true;
+        }
+
+        id = label(name);
+        return true;
+    }
+
+    int condition(const string& name) const
+    {
+        for (int cc = 0; cc < 16; ++cc)
+            if (name == condNames[cc])
+                return cc;
+
+        auto found = condAliases.find(name);
+        return found == condAliases.end() ? -1 : found->second;
+    }
+
+    bool instruction(const string& mnemonic, const vector<Operand>& ops)
+    {
+        int id = 0;
+
+        if (mnemonic == "ret" || mnemonic == "leave")
+        {
+            text.code.push_back(mnemonic == "ret" ? 0xC3 : 0xC9);
+            return true;
+        }
+
+        if (mnemonic == "jmp" || mnemonic == "call")
+        {
+            if (ops.size() != 1)
+                return fail(mnemonic + " takes one operand");
+
+            if (ops[0].plt && mnemonic == "call")
+            {
+                text.code.push_back(0xE8);
+                references.push_back({ text.code.size(), ops[0].symbol, -4, R_X86_64_PLT32 });
+                immediate(0, 4);
+                return true;
+            }
+
+            if (!target(ops[0], id))
+                return false;
+            if (mnemonic == "jmp")
+                text.jump(id);
+            else
+                text.call(id);
+            return true;
+        }
+
+        auto sse = sseForms.find(mnemonic);
+        if (sse != sseForms.end())
+        {
+            const SseForm& form = sse->second;
+            if (ops.size() != 2)
+                return fail(mnemonic + " takes two operands");
+
+            // only cvtsi2ss reads a general purpose register
+            Operand::Kind source = mnemonic == "cvtsi2ssl" ? Operand::GPR : Operand::XMM;
+
+            if (ops[1].kind == Operand::XMM && isRegOrMem(ops[0], source) && (source == Operand::XMM || ops[0].kind == Operand::MEM || ops[0].bytes == 4))
+                modrm(form.prefix, form.load, 2, ops[1].reg, ops[0]);
+            else if (form.store && ops[1].kind == Operand::MEM && ops[0].kind == Operand::XMM)
+                modrm(form.prefix, form.store, 2, ops[0].reg, ops[1]);
+            else
+                return fail("bad operands for " + mnemonic);
+            return true;
+        }
+
+        if (mnemonic == "movd")
+        {
+            if (ops.size() == 2 && ops[0].kind == Operand::GPR && ops[0].bytes == 4 && ops[1].kind == Operand::XMM)
+                modrm(0x66, 0x0F6E, 2, ops[1].reg, ops[0]);
+            else if (ops.size() == 2 && ops[0].kind == Operand::XMM && ops[1].kind == Operand::GPR && ops[1].bytes == 4)
+                modrm(0x66, 0x0F7E, 2, ops[0].reg, ops[1]);
+            else
+                return fail("bad operands for movd");
+            return true;
+        }
+
+        if (mnemonic == "movswl")
+            return load(0x0FBF, 2, ops, false);
+        if (mnemonic == "movzbl")
+            return load(0x0FB6, 2, ops, false);
+
+        if (mnemonic[0] == 'j' && condition(mnemonic.substr(1)) >= 0)
+        {
+            if (ops.size() != 1 || !target(ops[0], id))
+                return fail("bad operand for " + mnemonic);
+            text.jump((Cond)condition(mnemonic.substr(1)), id);
+            return true;
+        }
+
+        if (mnemonic.compare(0, 3, "set") == 0 && condition(mnemonic.substr(3)) >= 0)
+        {
+            if (ops.size() != 1 || ops[0].kind != Operand::GPR || ops[0].bytes != 1)
+                return fail("bad operand for " + mnemonic);
+            modrm(0, 0x0F90 + condition(mnemonic.substr(3)), 2, 0, ops[0]);
+            return true;
+        }
+
+        // the rest carry their operand width as a suffix
+        string base = mnemonic.substr(0, mnemonic.size() - 1);
+        const char* suffixes = "bwlq";
+        const char* suffix = strchr(suffixes, mnemonic.back());
+        if (mnemonic.size() < 2 || !suffix)
+            return fail("unknown instruction " + mnemonic);
+
+        int bytes = 1 << (suffix - suffixes);
+
+        if (base == "mov" || base == "test" || aluOps.count(base))
+            return integer(base, bytes, ops);
+
+        if (base == "imul" && bytes >= 4)
+            return load(0x0FAF, 2, ops, bytes == 8);
+
+        if (base == "lea" && bytes == 8 && !ops.empty() && ops[0].kind == Operand::MEM)
+            return load(0x8D, 1, ops, true);
+
+        auto unary = unaryOps.find(base);
+        if (unary != unaryOps.end() && ops.size() == 1 && isRegOrMem(ops[0], Operand::GPR))
+        {
+            if (ops[0].kind == Operand::GPR && ops[0].bytes != bytes)
+                return fail("register width does not match " + mnemonic);
+            modrm(bytes == 2 ? 0x66 : 0, unary->second.first + (bytes == 1 ? 0 : 1), 1, unary->second.second, ops[0], bytes == 8);
+            return true;
+        }
+
+        if ((base == "push" || base == "pop") && bytes == 8 && ops.size() == 1)
+        {
+            if (ops[0].kind == Operand::GPR && ops[0].bytes == 8)
+            {
+                if (base == "push")
+                    text.push((Gpr)ops[0].reg);
+                else
+                    text.pop((Gpr)ops[0].reg);
+                return true;
+            }
+
+            if (base == "push" && ops[0].kind == Operand::MEM)
+            {
+                modrm(0, 0xFF, 1, 6, ops[0]);
+                return true;
+            }
+        }
+
+        return fail("cannot encode " + mnemonic);
+    }
+
+    bool defineLabel(const string& name)
+    {
+        if (section != SECTION_TEXT)
+        {
+            dataLabels[name] = { section, section == SECTION_RODATA ? (uint64_t)object.rodata.size() : object.bssSize };
+            return true;
+        }
+
+        if (isNumber(name))
+        {
+            int id = forward.count(name) ? forward[name] : text.newLabel();
+            forward.erase(name);
+            backward[name] = id;
+            text.bind(id);
+            return true;
+        }
+
+        if (!defined.insert(name).second)
+            return fail("label " + name + " defined twice");
+
+        text.bind(label(name));
+        if (name.compare(0, 2, ".L") != 0)
+            functions.push_back({ name, text.code.size() });
+        return true;
+    }
+
+    bool directive(const string& name, const string& args)
+    {
+        if (name == ".text")
+            section = SECTION_TEXT;
+        else if (name == ".section")
+        {
+            string title = trim(args.substr(0, args.find(',')));
+            if (title == ".rodata")
+                section = SECTION_RODATA;
+            else if (title != ".note.GNU-stack")    // always written
+                return fail("unknown section " + title);
+        }
+        else if (name == ".globl")
+            globals.insert(trim(args));
+        else if (name == ".string")
+        {
+            size_t open = args.find('"'), close = args.rfind('"');
+            if (section != SECTION_RODATA || open == string::npos || close == open)
+                return fail(".string outside .rodata or without quotes");
+
+            for (size_t i = open + 1; i < close; ++i)
+            {
+                char c = args[i];
+                if (c == '\\' && i + 1 < close)
+                {
+                    c = args[++i];
+                    c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+                }
+                object.rodata.push_back((uint8_t)c);
+            }
+            object.rodata.push_back(0);
+        }
+        else if (name == ".lcomm")
+        {
+            vector<string> parts = splitOperands(args);
+            if (parts.size() != 2 || !isNumber(parts[1]))
+                return fail(".lcomm takes a name and a size");
+
+            uint64_t size = strtoull(parts[1].c_str(), nullptr, 10);
+            uint64_t align = 1;
+            while (align < 16 && align * 2 <= size)
+                align *= 2;
+
+            object.bssSize = (object.bssSize + align - 1) / align * align;
+            object.bssAlign = max(object.bssAlign, align);
+            dataLabels[parts[0]] = { SECTION_BSS, object.bssSize };
+            dataSizes[parts[0]] = size;
+            object.bssSize += size;
+        }
+        else
+            return fail("unknown directive " + name);
+
+        return true;
+    }
+
+    bool statement(string source)
+    {
+        size_t comment = source.find('#');
+        if (comment != string::npos && source.find('"') > comment)
+            source.resize(comment);
+
+        source = trim(source);
+        if (source.empty())
+            return true;
+
+        if (source.back() == ':' && source.find_first_of(" \t\"") == string::npos)
+            return defineLabel(source.substr(0, source.size() - 1));
+
+        size_t space = source.find_first_of(" \t");
+        string head = source.substr(0, space);
+        string rest = space == string::npos ? "" : trim(source.substr(space));
+
+        if (head[0] == '.')
+            return directive(head, rest);
+
+        if (section != SECTION_TEXT)
+            return fail("instruction outside .text");
+
+        vector<string> texts = splitOperands(rest);
+        vector<Operand> ops(texts.size());
+        for (size_t i = 0; i < texts.size(); ++i)
+            if (!parseOperand(texts[i], ops[i]))
+                return false;
+
+        ripAt = -1;
+        ripOperand = nullptr;
+        if (!instruction(head, ops))
+            return false;
+
+        // the disp is from the end of the instruction, after any immediate
+        if (ripOperand)
+            references.push_back({ (uint64_t)ripAt, ripOperand->symbol, ripOperand->value + ripAt - (int64_t)text.code.size(),
+                ripOperand->got ? (uint32_t)R_X86_64_GOTPCREL : (uint32_t)R_X86_64_PC32 });
+        return true;
+    }
+
+    bool finish()
+    {
+        if (!text.resolved() || !forward.empty())
+            return fail("a jump or call to a label that is never defined");
+
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            uint64_t end = i + 1 < functions.size() ? functions[i + 1].second : text.code.size();
+            symbol(functions[i].first, SECTION_TEXT, functions[i].second, end - functions[i].second, true);
+        }
+
+        for (auto& data : dataLabels)
+            if (data.first.compare(0, 2, ".L") != 0)
+                symbol(data.first, data.second.first, data.second.second, dataSizes[data.first], false);
+
+        // a .L label goes by its section, as as does it
+        for (auto& reference : references)
+        {
+            Relocation relocation = { reference.offset, -1, -1, reference.type, reference.addend };
+            auto data = dataLabels.find(reference.symbol);
+
+            if (reference.type != R_X86_64_PC32 || data == dataLabels.end())
+                relocation.symbol = symbol(reference.symbol, SECTION_UNDEFINED, 0, 0, false);
+            else if (reference.symbol.compare(0, 2, ".L") == 0)
+            {
+                relocation.section = data->second.first;
+                relocation.addend += data->second.second;
+            }
+            else
+                relocation.symbol = symbolIndex.at(reference.symbol);
+
+            object.relocations.push_back(relocation);
+        }
+
+        object.text = move(text.code);
+        return true;
+    }
+};
+
+bool assembleObject(const string& assembly, ObjectFile& object, ostream& err)
+{
+    ObjectAssembler assembler(object, err);
+    size_t start = 0;
+
+    while (start < assembly.size())
+    {
+        size_t end = assembly.find('\n', start);
+        if (end == string::npos)
+            end = assembly.size();
+
+        ++assembler.line;
+        if (!assembler.statement(assembly.substr(start, end - start)))
+            return false;
+
+        start = end + 1;
+    }
+
+    return assembler.finish();
+}
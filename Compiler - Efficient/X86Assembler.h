@@ -0,0 +1,12 @@
+#pragma once
+#include "ELFObject.h"
+#include <ostream>
+#include <string>
+
+// Assembles the GNU syntax generateAssembly writes into a relocatable object, through the
+// same X86Encoder the JIT uses, so a native build never runs as. Only that subset is
+// understood: the instructions and operand forms the backend and its runtime emit,
+// .L and numeric local labels, and the .text, .section, .globl, .string and .lcomm
+// directives. Functions and runtime helpers become function symbols, as in the text.
+// False after a message on err for anything else.
+bool assembleObject(const std::string& assembly, ObjectFile& object, std::ostream& err);
@@ -0,0 +1,897 @@
+#include "X86Backend.h"
+#include "SymbolTable.h"
+#include <algorithm>
+#include <cassert>
+#include <string>
+using namespace std;
+
+const char* const gpr64[] = { "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15" };
+const char* const gpr32[] = { "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d" };
+const char* const gpr16[] = { "%ax", "%cx", "%dx", "%bx", "%sp", "%bp", "%si", "%di", "%r8w", "%r9w", "%r10w", "%r11w", "%r12w", "%r13w", "%r14w", "%r15w" };
+
+const int intArgRegs[] = { RDI, RSI, RDX, RCX, R8, R9 };
+const int intResultRegs[] = { RAX, RDX, RCX, R11 };
+enum { XMM_ARGS = 8, INT_RESULTS = 4, XMM_RESULTS = 2 };
+
+Convention callingConvention(const IRFunction& fn)
+{
+    Convention conv;
+    int buffered = 0, ints = 0, reals = 0;
+
+    for (IRType type : fn.resultTypes)
+    {
+        if (type == IRType::REAL && reals < XMM_RESULTS)
+            conv.results.push_back({ ArgSlot::XMM, reals++ });
+        else if (type != IRType::REAL && ints < INT_RESULTS)
+            conv.results.push_back({ ArgSlot::GPR, intResultRegs[ints++] });
+        else
+            conv.results.push_back({ ArgSlot::STACK, buffered++ });
+    }
+
+    conv.sret = buffered > 0;
+
+    int gprs = conv.sret ? 1 : 0, xmms = 0;
+
+    for (IRType type : fn.argTypes)
+    {
+        if (type == IRType::REAL && xmms < XMM_ARGS)
+            conv.args.push_back({ ArgSlot::XMM, xmms++ });
+        else if (type != IRType::REAL && gprs < 6)
+            conv.args.push_back({ ArgSlot::GPR, intArgRegs[gprs++] });
+        else
+            conv.args.push_back({ ArgSlot::STACK, conv.stackArgs++ });
+    }
+
+    return conv;
+}
+
+string xmm(int reg)
+{
+    return "%xmm" + to_string(reg);
+}
+
+string imm(int value)
+{
+    return "$" + to_string(value);
+}
+
+// integer condition codes for LT .. NE, and their negations
+const char* const conditions[] = { "l", "le", "e", "g", "ge", "ne" };
+const char* const inverted[] = { "ge", "g", "ne", "le", "l", "e" };
+
+struct X86Function
+{
+    ostream& out;
+    const IRModule& module;
+    const IRFunction& fn;
+    int index;
+
+    Allocation alloc;
+    Convention conv;
+    vector<int> uses;
+
+    // frame layout, as offsets from %rbp
+    int argSave = 0;        // every register argument, stored by the prologue
+    int sretSave = 0;       // where the caller wants the results, if they go through memory
+    int spillBase = 0;
+    int resultBuffer = 0;   // results of calls that return through memory
+    int frameBase = 0;      // the variables, at the offsets the binder gave them
+    int frameBytes = 0;
+
+    X86Function(ostream& out, const IRModule& module, int index)
+        : out(out), module(module), fn(module.functions[index]), index(index),
+        alloc(allocateRegisters(fn)), conv(callingConvention(fn)), uses(fn.regs.size())
+    {
+        vector<int> regs;
+
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+                usesOf(fn, in, regs);
+
+        for (int reg : regs)
+            ++uses[reg];
+    }
+
+    void emit(const string& op, const string& a = "", const string& b = "")
+    {
+        out << "\t" << op;
+        if (!a.empty())
+            out << "\t" << a;
+        if (!b.empty())
+            out << ", " << b;
+        out << "\n";
+    }
+
+    string label(int block) const
+    {
+        return ".L" + to_string(index) + "_" + to_string(block);
+    }
+
+    string frame(int offset) const
+    {
+        return to_string(offset) + "(%rbp)";
+    }
+
+    string variable(int area, int offset) const
+    {
+        return area == AREA_GLOBAL ? "program_globals+" + to_string(offset) + "(%rip)" : frame(frameBase + offset);
+    }
+
+    bool isReal(int reg) const
+    {
+        return fn.regs[reg] == IRType::REAL;
+    }
+
+    bool isReference(int reg) const
+    {
+        return fn.regs[reg] == IRType::REF;
+    }
+
+    bool inRegister(int reg) const
+    {
+        return alloc.location[reg] >= 0;
+    }
+
+    // the register or spill slot holding a virtual register
+    string home(int reg) const
+    {
+        if (!inRegister(reg))
+            return frame(spillBase + 8 * alloc.slot[reg]);
+
+        return isReal(reg) ? xmm(alloc.location[reg]) : isReference(reg) ? gpr64[alloc.location[reg]] : gpr32[alloc.location[reg]];
+    }
+
+    // the register a reference is in, loaded into r11 when it was spilled
+    string pointer(int reg)
+    {
+        if (inRegister(reg))
+            return gpr64[alloc.location[reg]];
+
+        emit("movq", home(reg), "%r11");
+        return "%r11";
+    }
+
+    // a register to compute dst in: its own, unless that also holds other, the operand read last
+    int work(int dst, int other, int scratch) const
+    {
+        if (inRegister(dst) && (other < 0 || alloc.location[other] != alloc.location[dst]))
+            return alloc.location[dst];
+        return scratch;
+    }
+
+    void moveInt(const string& from, int dst)
+    {
+        if (!inRegister(dst) && from[0] != '%' && from[0] != '$')
+        {
+            emit("movl", from, "%eax");
+            emit("movl", "%eax", home(dst));
+        }
+        else if (from != home(dst))
+            emit("movl", from, home(dst));
+    }
+
+    void moveReal(const string& from, int dst)
+    {
+        if (!inRegister(dst) && from[0] != '%')
+        {
+            emit("movss", from, xmm(SCRATCH_XMM + 1));
+            emit("movss", xmm(SCRATCH_XMM + 1), home(dst));
+        }
+        else if (from != home(dst))
+            emit("movss", from, home(dst));
+    }
+
+    void moveReference(const string& from, int dst)
+    {
+        if (!inRegister(dst) && from[0] != '%')
+        {
+            emit("movq", from, "%rax");
+            emit("movq", "%rax", home(dst));
+        }
+        else if (from != home(dst))
+            emit("movq", from, home(dst));
+    }
+
+    void move(const string& from, int dst)
+    {
+        if (isReal(dst))
+            moveReal(from, dst);
+        else if (isReference(dst))
+            moveReference(from, dst);
+        else
+            moveInt(from, dst);
+    }
+
+    // pushes one scalar as an eight byte slot
+    void push(int reg)
+    {
+        if (!inRegister(reg))
+            emit("pushq", home(reg));
+        else if (isReal(reg))
+        {
+            emit("movd", home(reg), "%eax");
+            emit("pushq", "%rax");
+        }
+        else
+            emit("pushq", gpr64[alloc.location[reg]]);
+    }
+
+    void prologue()
+    {
+        int cursor = 8 * (int)alloc.calleeSaved.size();
+        auto reserve = [&](int bytes, int align)
+        {
+            cursor = roundUp(cursor + bytes, align);
+            return -cursor;
+        };
+
+        int results = 0;
+        for (auto& block : fn.blocks)
+            for (auto& in : block.code)
+                if (in.op == Opcode::CALL)
+                    results = max(results, fn.listSize(in.c));
+
+        argSave = reserve(8 * (int)conv.args.size(), 8);
+        sretSave = reserve(8, 8);
+        spillBase = reserve(8 * alloc.spillSlots, 8);
+        resultBuffer = reserve(8 * results, 8);
+        frameBase = reserve(fn.frameSize, 16);
+        frameBytes = roundUp(cursor, 16);
+
+        out << "\n\t.globl\tf" << fn.name << "\n";
+        out << "f" << fn.name << ":\n";
+        emit("pushq", "%rbp");
+        emit("movq", "%rsp", "%rbp");
+        emit("subq", imm(frameBytes), "%rsp");
+
+        for (size_t i = 0; i < alloc.calleeSaved.size(); ++i)
+            emit("movq", gpr64[alloc.calleeSaved[i]], frame(-8 * (int)(i + 1)));
+
+        for (size_t k = 0; k < conv.args.size(); ++k)
+        {
+            if (conv.args[k].kind == ArgSlot::GPR)
+                emit("movq", gpr64[conv.args[k].index], frame(argSave + 8 * (int)k));
+            else if (conv.args[k].kind == ArgSlot::XMM)
+                emit("movss", xmm(conv.args[k].index), frame(argSave + 8 * (int)k));
+        }
+
+        if (conv.sret)
+            emit("movq", "%rdi", frame(sretSave));
+
+        // variables start out zero, as on the VM
+        int words = roundUp(fn.frameSize, 8) / 8;
+
+        if (words <= 16)
+        {
+            for (int i = 0; i < words; ++i)
+                emit("movq", "$0", frame(frameBase + 8 * i));
+        }
+        else
+        {
+            emit("leaq", frame(frameBase), "%rax");
+            emit("movl", imm(words), "%r11d");
+            out << "1:\n";
+            emit("movq", "$0", "(%rax)");
+            emit("addq", "$8", "%rax");
+            emit("decl", "%r11d");
+            emit("jnz", "1b");
+        }
+    }
+
+    void epilogue()
+    {
+        for (size_t i = 0; i < alloc.calleeSaved.size(); ++i)
+            emit("movq", frame(-8 * (int)(i + 1)), gpr64[alloc.calleeSaved[i]]);
+
+        emit("leave");
+        emit("ret");
+    }
+
+    void arithmetic(const Instr& in)
+    {
+        static const char* const intOps[] = { "addl", "subl", "imull" };
+        static const char* const realOps[] = { "addss", "subss", "mulss", "divss" };
+        int op = (int)in.op - (int)Opcode::ADD;
+
+        if (in.type == IRType::REAL)
+        {
+            int work = this->work(in.dst, in.b, SCRATCH_XMM + 1);
+            emit("movss", home(in.a), xmm(work));
+            emit(realOps[op], home(in.b), xmm(work));
+            moveReal(xmm(work), in.dst);
+            return;
+        }
+
+        // ints are kept sign extended from 16 bits
+        int work = this->work(in.dst, in.b, RAX);
+        emit("movl", home(in.a), gpr32[work]);
+        emit(intOps[op], home(in.b), gpr32[work]);
+        emit("movswl", gpr16[work], gpr32[work]);
+        moveInt(gpr32[work], in.dst);
+    }
+
+    string lane(int address, int offset) const
+    {
+        return variable(addressArea(address), addressOffset(address) + offset);
+    }
+
+    // [a] <- [b], or [a] <- [a] op [b]: sixteen bytes per packed instruction, then lane by lane
+    void vectorOp(const Instr& in)
+    {
+        static const char* const packed[2][2] = { { "paddw", "psubw" }, { "addps", "subps" } };
+        bool real = in.type == IRType::REAL;
+        bool copy = in.op == Opcode::VCOPY;
+        bool subtract = in.op == Opcode::VSUB;
+        string x = xmm(SCRATCH_XMM), y = xmm(SCRATCH_XMM + 1);
+        int bytes = in.c * width(in.type);
+        int offset = 0;
+
+        for (; offset + 16 <= bytes; offset += 16)
+        {
+            emit("movups", lane(copy ? in.b : in.a, offset), x);
+            if (!copy)
+            {
+                emit("movups", lane(in.b, offset), y);
+                emit(packed[real][subtract], y, x);
+            }
+            emit("movups", x, lane(in.a, offset));
+        }
+
+        for (; offset < bytes; offset += width(in.type))
+        {
+            if (real)
+            {
+                emit("movss", lane(copy ? in.b : in.a, offset), x);
+                if (!copy)
+                    emit(subtract ? "subss" : "addss", lane(in.b, offset), x);
+                emit("movss", x, lane(in.a, offset));
+            }
+            else
+            {
+                emit("movw", lane(in.b, offset), "%cx");
+                emit(copy ? "movw" : subtract ? "subw" : "addw", "%cx", lane(in.a, offset));
+            }
+        }
+    }
+
+    // compares a with b and leaves the condition in al, or for ints only in the flags
+    void compare(const Instr& in, bool flagsOnly = false)
+    {
+        int cond = (int)in.op - (int)Opcode::LT;
+
+        if (in.type != IRType::REAL)
+        {
+            emit("movl", home(in.a), "%eax");
+            emit("cmpl", home(in.b), "%eax");
+            if (!flagsOnly)
+                emit(string("set") + conditions[cond], "%al");
+            return;
+        }
+
+        // ucomiss is unordered on NaN: every comparison is false then, except !=
+        string scratch = xmm(SCRATCH_XMM + 1);
+        bool swap = in.op == Opcode::LT || in.op == Opcode::LE;
+
+        emit("movss", home(swap ? in.b : in.a), scratch);
+        emit("ucomiss", home(swap ? in.a : in.b), scratch);
+
+        switch (in.op)
+        {
+        case Opcode::LT: case Opcode::GT:
+            emit("seta", "%al");
+            break;
+        case Opcode::LE: case Opcode::GE:
+            emit("setae", "%al");
+            break;
+        case Opcode::EQ:
+            emit("sete", "%al");
+            emit("setnp", "%cl");
+            emit("andb", "%cl", "%al");
+            break;
+        default:
+            emit("setne", "%al");
+            emit("setp", "%cl");
+            emit("orb", "%cl", "%al");
+        }
+    }
+
+    // jump to target when the condition holds, else to otherwise; whichever comes next is fallen into
+    void branch(const string& condition, const string& negation, int target, int otherwise, int next)
+    {
+        if (target == next)
+            emit("j" + negation, label(otherwise));
+        else
+        {
+            emit("j" + condition, label(target));
+            if (otherwise != next)
+                emit("jmp", label(otherwise));
+        }
+    }
+
+    void call(const Instr& in)
+    {
+        const IRFunction& callee = module.functions[in.a];
+        Convention callConv = callingConvention(callee);
+        const int* args = fn.listItems(in.b);
+        const int* results = fn.listItems(in.c);
+        int resultCount = fn.listSize(in.c);
+
+        // stack arguments last to first, so the first ends up lowest; keep rsp 16 byte aligned
+        int pad = callConv.stackArgs % 2 ? 8 : 0;
+        if (pad)
+            emit("subq", imm(pad), "%rsp");
+
+        for (int k = (int)callConv.args.size(); k-- > 0; )
+            if (callConv.args[k].kind == ArgSlot::STACK)
+                push(args[k]);
+
+        // register arguments go through the stack too: a source may sit in another argument's register
+        vector<int> inRegisters;
+        for (int k = 0; k < (int)callConv.args.size(); ++k)
+            if (callConv.args[k].kind != ArgSlot::STACK)
+            {
+                push(args[k]);
+                inRegisters.push_back(k);
+            }
+
+        for (size_t i = inRegisters.size(); i-- > 0; )
+        {
+            const ArgSlot& slot = callConv.args[inRegisters[i]];
+
+            if (slot.kind == ArgSlot::GPR)
+                emit("popq", gpr64[slot.index]);
+            else
+            {
+                emit("popq", "%rax");
+                emit("movd", "%eax", xmm(slot.index));
+            }
+        }
+
+        if (callConv.sret)
+            emit("leaq", frame(resultBuffer), "%rdi");
+
+        emit("call", "f" + callee.name);
+
+        if (callConv.stackArgs || pad)
+            emit("addq", imm(8 * callConv.stackArgs + pad), "%rsp");
+
+        // the registers first, moving the buffered ones may go through eax. xmm0 and xmm1 can
+        // be allocated: when the first real result lives in xmm1, both go through scratch
+        vector<int> reals;
+        for (int i = 0; i < resultCount; ++i)
+            if (callConv.results[i].kind == ArgSlot::XMM)
+                reals.push_back(results[i]);
+
+        bool staged = reals.size() == 2 && home(reals[0]) == xmm(1);
+        if (staged)
+        {
+            emit("movss", xmm(0), xmm(SCRATCH_XMM));
+            emit("movss", xmm(1), xmm(SCRATCH_XMM + 1));
+        }
+
+        for (int i = 0; i < resultCount; ++i)
+        {
+            const ArgSlot& slot = callConv.results[i];
+            if (slot.kind == ArgSlot::GPR)
+                move(gpr32[slot.index], results[i]);
+            else if (slot.kind == ArgSlot::XMM)
+                move(xmm(staged ? SCRATCH_XMM + slot.index : slot.index), results[i]);
+        }
+
+        for (int i = 0; i < resultCount; ++i)
+            if (callConv.results[i].kind == ArgSlot::STACK)
+                move(frame(resultBuffer + 8 * callConv.results[i].index), results[i]);
+    }
+
+    void ret(const Instr& in)
+    {
+        const int* results = fn.listItems(in.a);
+        int count = fn.listSize(in.a);
+
+        // the buffer first, through scratch that the registers are loaded into after
+        if (conv.sret)
+        {
+            emit("movq", frame(sretSave), "%r11");
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (conv.results[i].kind != ArgSlot::STACK)
+                    continue;
+
+                string to = to_string(8 * conv.results[i].index) + "(%r11)";
+
+                if (isReal(results[i]))
+                {
+                    emit("movss", home(results[i]), xmm(SCRATCH_XMM + 1));
+                    emit("movss", xmm(SCRATCH_XMM + 1), to);
+                }
+                else
+                {
+                    emit("movl", home(results[i]), "%eax");
+                    emit("movl", "%eax", to);
+                }
+            }
+        }
+
+        // when the second real result lives in xmm0, loading the first would overwrite it
+        vector<int> reals;
+        for (int i = 0; i < count; ++i)
+            if (conv.results[i].kind == ArgSlot::XMM)
+                reals.push_back(results[i]);
+
+        bool staged = reals.size() == 2 && home(reals[1]) == xmm(0);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const ArgSlot& slot = conv.results[i];
+            if (slot.kind == ArgSlot::GPR)
+                emit("movl", home(results[i]), gpr32[slot.index]);
+            else if (slot.kind == ArgSlot::XMM)
+            {
+                string to = xmm(staged ? SCRATCH_XMM + slot.index : slot.index);
+                if (home(results[i]) != to)
+                    emit("movss", home(results[i]), to);
+            }
+        }
+
+        if (staged)
+        {
+            emit("movss", xmm(SCRATCH_XMM), xmm(0));
+            emit("movss", xmm(SCRATCH_XMM + 1), xmm(1));
+        }
+
+        epilogue();
+    }
+
+    void lower(int b)
+    {
+        const vector<Instr>& code = fn.blocks[b].code;
+        int next = b + 1;
+
+        out << label(b) << ":\n";
+
+        for (size_t k = 0; k < code.size(); ++k)
+        {
+            const Instr& in = code[k];
+
+            switch (in.op)
+            {
+            case Opcode::CONST:
+                if (isReal(in.dst) && inRegister(in.dst))
+                {
+                    emit("movl", imm(in.a), "%eax");
+                    emit("movd", "%eax", home(in.dst));
+                }
+                else
+                    emit("movl", imm(in.a), home(in.dst));
+                break;
+
+            case Opcode::COPY:
+                move(home(in.a), in.dst);
+                break;
+
+            case Opcode::ADD: case Opcode::SUB: case Opcode::MUL: case Opcode::DIV:
+                arithmetic(in);
+                break;
+
+            case Opcode::ITOF:
+            {
+                int work = this->work(in.dst, -1, SCRATCH_XMM + 1);
+                emit("cvtsi2ssl", home(in.a), xmm(work));
+                moveReal(xmm(work), in.dst);
+                break;
+            }
+
+            case Opcode::LT: case Opcode::LE: case Opcode::EQ:
+            case Opcode::GT: case Opcode::GE: case Opcode::NE:
+                if (in.type != IRType::REAL && k + 1 < code.size() && code[k + 1].op == Opcode::BRANCH
+                    && code[k + 1].a == in.dst && uses[in.dst] == 1)
+                {
+                    // compare and jump on the flags, the condition never becomes a value
+                    compare(in, true);
+                    ++k;
+                    int cond = (int)in.op - (int)Opcode::LT;
+                    branch(conditions[cond], inverted[cond], code[k].b, code[k].c, next);
+                    break;
+                }
+
+                compare(in);
+                emit("movzbl", "%al", "%eax");
+                moveInt("%eax", in.dst);
+                break;
+
+            case Opcode::AND: case Opcode::OR:
+                emit("movl", home(in.a), "%eax");
+                emit(in.op == Opcode::AND ? "andl" : "orl", home(in.b), "%eax");
+                moveInt("%eax", in.dst);
+                break;
+
+            case Opcode::NOT:
+                emit("movl", home(in.a), "%eax");
+                emit("xorl", "$1", "%eax");
+                moveInt("%eax", in.dst);
+                break;
+
+            case Opcode::LOAD:
+                if (isReal(in.dst))
+                    moveReal(variable(in.a, in.b), in.dst);
+                else
+                {
+                    int work = this->work(in.dst, -1, RAX);
+                    emit("movswl", variable(in.a, in.b), gpr32[work]);
+                    moveInt(gpr32[work], in.dst);
+                }
+                break;
+
+            case Opcode::STORE:
+                if (isReal(in.c))
+                {
+                    int work = inRegister(in.c) ? alloc.location[in.c] : SCRATCH_XMM + 1;
+                    if (!inRegister(in.c))
+                        emit("movss", home(in.c), xmm(work));
+                    emit("movss", xmm(work), variable(in.a, in.b));
+                }
+                else
+                {
+                    int work = inRegister(in.c) ? alloc.location[in.c] : RAX;
+                    if (!inRegister(in.c))
+                        emit("movl", home(in.c), "%eax");
+                    emit("movw", gpr16[work], variable(in.a, in.b));
+                }
+                break;
+
+            case Opcode::VCOPY: case Opcode::VADD: case Opcode::VSUB:
+                vectorOp(in);
+                break;
+
+            case Opcode::ADDR:
+            {
+                string work = inRegister(in.dst) ? home(in.dst) : "%rax";
+                emit("leaq", variable(AREA_FRAME, in.a), work);
+                moveReference(work, in.dst);
+                break;
+            }
+
+            case Opcode::LOADREF:
+            {
+                string at = to_string(in.b) + "(" + pointer(in.a) + ")";
+                if (isReal(in.dst))
+                    moveReal(at, in.dst);
+                else
+                {
+                    int work = this->work(in.dst, -1, RAX);
+                    emit("movswl", at, gpr32[work]);
+                    moveInt(gpr32[work], in.dst);
+                }
+                break;
+            }
+
+            case Opcode::STOREREF:
+            {
+                string at = to_string(in.b) + "(" + pointer(in.a) + ")";
+                if (isReal(in.c))
+                {
+                    int work = inRegister(in.c) ? alloc.location[in.c] : SCRATCH_XMM + 1;
+                    if (!inRegister(in.c))
+                        emit("movss", home(in.c), xmm(work));
+                    emit("movss", xmm(work), at);
+                }
+                else
+                {
+                    int work = inRegister(in.c) ? alloc.location[in.c] : RAX;
+                    if (!inRegister(in.c))
+                        emit("movl", home(in.c), "%eax");
+                    emit("movw", gpr16[work], at);
+                }
+                break;
+            }
+
+            case Opcode::ARG:
+            {
+                const ArgSlot& slot = conv.args[in.a];
+                move(slot.kind == ArgSlot::STACK ? frame(16 + 8 * slot.index) : frame(argSave + 8 * in.a), in.dst);
+                break;
+            }
+
+            case Opcode::READ:
+                emit("call", isReal(in.dst) ? "rt_read_real" : "rt_read_int");
+                move(isReal(in.dst) ? "%xmm0" : "%eax", in.dst);
+                break;
+
+            case Opcode::WRITE:
+                if (isReal(in.a))
+                {
+                    emit("movss", home(in.a), "%xmm0");
+                    emit("call", "rt_write_real");
+                }
+                else
+                {
+                    emit("movl", home(in.a), "%edi");
+                    emit("call", "rt_write_int");
+                }
+                break;
+
+            case Opcode::CALL:
+                call(in);
+                break;
+
+            case Opcode::JUMP:
+                if (in.a != next)
+                    emit("jmp", label(in.a));
+                break;
+
+            case Opcode::BRANCH:
+                emit("cmpl", "$0", home(in.a));
+                branch("ne", "e", in.b, in.c, next);
+                break;
+
+            case Opcode::RET:
+                ret(in);
+                break;
+
+            case Opcode::PHI:
+                assert(false && "phis are removed by leaveSSA");
+                break;
+            }
+        }
+    }
+
+    void run()
+    {
+        prologue();
+
+        for (int b = 0; b < (int)fn.blocks.size(); ++b)
+            lower(b);
+    }
+};
+
+// read and write, each entered with rsp 8 past a 16 byte boundary. Reads go through scanf on
+// a stdin buffered 64K at a time. Writes are formatted straight into a 64K buffer of their
+// own, the C library only formatting reals, and it goes out a write() at a time when full
+// and once main returns.
+const char* const runtime = R"(
+rt_read_int:
+	subq	$24, %rsp
+	movq	$0, 8(%rsp)
+	leaq	8(%rsp), %rsi
+	leaq	.Lread_int(%rip), %rdi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	movq	8(%rsp), %rax
+	movswl	%ax, %eax
+	addq	$24, %rsp
+	ret
+
+rt_read_real:
+	subq	$24, %rsp
+	movl	$0, 8(%rsp)
+	leaq	8(%rsp), %rsi
+	leaq	.Lread_real(%rip), %rdi
+	xorl	%eax, %eax
+	call	scanf@PLT
+	movss	8(%rsp), %xmm0
+	addq	$24, %rsp
+	ret
+
+rt_write_int:
+	cmpl	$65520, rt_used(%rip)		# room for the longest int
+	jb	1f
+	pushq	%rdi
+	call	rt_flush
+	popq	%rdi
+1:
+	# digits backwards in the red zone, then copied out up to the newline
+	movl	%edi, %eax
+	testl	%eax, %eax
+	jns	2f
+	negl	%eax
+2:
+	leaq	-8(%rsp), %rsi
+	movb	$10, (%rsi)
+	movl	$10, %ecx
+3:
+	xorl	%edx, %edx
+	divl	%ecx
+	addl	$48, %edx
+	decq	%rsi
+	movb	%dl, (%rsi)
+	testl	%eax, %eax
+	jnz	3b
+	testl	%edi, %edi
+	jns	4f
+	decq	%rsi
+	movb	$45, (%rsi)
+4:
+	movl	rt_used(%rip), %eax
+	leaq	rt_output(%rip), %rdx
+5:
+	movb	(%rsi), %cl
+	movb	%cl, (%rdx,%rax)
+	incq	%rsi
+	incl	%eax
+	cmpb	$10, %cl
+	jne	5b
+	movl	%eax, rt_used(%rip)
+	ret
+
+rt_write_real:
+	subq	$8, %rsp
+	cmpl	$65472, rt_used(%rip)		# and for any real
+	jb	1f
+	movss	%xmm0, (%rsp)
+	call	rt_flush
+	movss	(%rsp), %xmm0
+1:
+	cvtss2sd	%xmm0, %xmm0
+	movl	rt_used(%rip), %edi
+	leaq	rt_output(%rip), %rax
+	addq	%rax, %rdi
+	movl	$64, %esi
+	leaq	.Lwrite_real(%rip), %rdx
+	movl	$1, %eax
+	call	snprintf@PLT
+	addl	%eax, rt_used(%rip)
+	addq	$8, %rsp
+	ret
+
+rt_flush:
+	pushq	%rbx
+	xorl	%ebx, %ebx
+1:
+	movl	rt_used(%rip), %edx
+	subl	%ebx, %edx
+	jle	2f
+	leaq	rt_output(%rip), %rsi
+	addq	%rbx, %rsi
+	movl	$1, %edi
+	call	write@PLT
+	testq	%rax, %rax
+	jle	2f
+	addl	%eax, %ebx
+	jmp	1b
+2:
+	movl	$0, rt_used(%rip)
+	popq	%rbx
+	ret
+
+	.globl	main
+main:
+	subq	$8, %rsp
+	movq	stdin@GOTPCREL(%rip), %rax
+	movq	(%rax), %rdi
+	xorl	%esi, %esi
+	xorl	%edx, %edx
+	movl	$65536, %ecx
+	call	setvbuf@PLT
+	call	f_main
+	call	rt_flush
+	xorl	%eax, %eax
+	addq	$8, %rsp
+	ret
+
+	.section	.rodata
+.Lread_int:
+	.string	"%ld"
+.Lread_real:
+	.string	"%f"
+.Lwrite_real:
+	.string	"%.2f\n"
+
+	.lcomm	rt_output, 65536
+	.lcomm	rt_used, 4
+)";
+
+void generateAssembly(ostream& out, const IRModule& module)
+{
+    out << "\t.text\n";
+
+    for (int i = 0; i < (int)module.functions.size(); ++i)
+        X86Function(out, module, i).run();
+
+    out << runtime;
+
+    if (module.globalSize)
+        out << "\n\t.lcomm\tprogram_globals, " << module.globalSize << "\n";
+
+    out << "\n\t.section\t.note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "IR.h"
+#include "RegAlloc.h"
+#include <ostream>
+
+// Where one scalar of an argument list travels: a Gpr, an xmm register, or the n-th
+// eight byte slot of the stack arguments
+struct ArgSlot
+{
+    enum Kind { GPR, XMM, STACK } kind;
+    int index;
+};
+
+// System V for the argument lists: ints and references in rdi, rsi, rdx, rcx, r8, r9,
+// reals in xmm0..xmm7, the rest on the stack in eight byte slots. Results come back as
+// System V returns them, ints in rax, rdx and reals in xmm0, xmm1, so a C caller reads a
+// single result where it expects it. Two more ints use rcx and r11; results left over are
+// written to a buffer the caller passes in rdi, the way System V returns a large struct,
+// one eight byte slot each, STACK slots numbering them. Every function is exported as
+// f<name>, so C code linked with the program can call it.
+struct Convention
+{
+    bool sret = false;
+    int stackArgs = 0;
+    std::vector<ArgSlot> args;
+    std::vector<ArgSlot> results;
+};
+
+Convention callingConvention(const IRFunction&);
+
+// Writes the module as GNU assembler text (AT&T syntax) for x86-64 Linux. main calls the
+// program's _main; read and write go through small helpers on top of the C library, so
+// the output links with: cc program.s -o program. assembleObject (X86Assembler.h) turns
+// the same text into an object without as.
+void generateAssembly(std::ostream&, const IRModule&);
@@ -0,0 +1,178 @@
+#include "X86Encoder.h"
+#include <algorithm>
+using namespace std;
+
+void X86Encoder::rex(bool wide, int reg, int index, int base, bool force)
+{
+    uint8_t value = 0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (index >= 8 ? 2 : 0) | (base >= 8 ? 1 : 0);
+
+    if (value != 0x40 || force)
+        code.push_back(value);
+}
+
+void X86Encoder::opcode(uint32_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+        code.push_back((uint8_t)(value >> (8 * i)));
+}
+
+void X86Encoder::imm32(int32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        code.push_back((uint8_t)((uint32_t)value >> (8 * i)));
+}
+
+void X86Encoder::rm(int prefix, uint32_t op, int opcodeBytes, int reg, const Mem& mem, bool wide)
+{
+    if (prefix)
+        code.push_back((uint8_t)prefix);
+
+    if (mem.base == RIP)
+    {
+        rex(wide, reg, -1, 0);
+        opcode(op, opcodeBytes);
+        code.push_back((uint8_t)((reg & 7) << 3 | RBP));
+        imm32(mem.disp);
+        return;
+    }
+
+    rex(wide, reg, mem.index, mem.base);
+    opcode(op, opcodeBytes);
+
+    // rsp and r12 as a base need a SIB byte, rbp and r13 always a displacement
+    bool sib = mem.index >= 0 || (mem.base & 7) == RSP;
+    int mod = mem.disp == 0 && (mem.base & 7) != RBP ? 0 : mem.disp >= -128 && mem.disp <= 127 ? 1 : 2;
+
+    code.push_back((uint8_t)(mod << 6 | (reg & 7) << 3 | (sib ? 4 : mem.base & 7)));
+
+    if (sib)
+    {
+        int scale = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+        int index = mem.index >= 0 ? mem.index & 7 : 4;
+        code.push_back((uint8_t)(scale << 6 | index << 3 | (mem.base & 7)));
+    }
+
+    if (mod == 1)
+        code.push_back((uint8_t)mem.disp);
+    else if (mod == 2)
+        imm32(mem.disp);
+}
+
+void X86Encoder::rr(int prefix, uint32_t op, int opcodeBytes, int reg, int rmReg, bool wide)
+{
+    if (prefix)
+        code.push_back((uint8_t)prefix);
+
+    rex(wide, reg, -1, rmReg);
+    opcode(op, opcodeBytes);
+    code.push_back((uint8_t)(0xC0 | (reg & 7) << 3 | (rmReg & 7)));
+}
+
+void X86Encoder::moveImm64(Gpr dst, uint64_t value)
+{
+    rex(true, 0, -1, dst);
+    code.push_back((uint8_t)(0xB8 + (dst & 7)));
+
+    for (int i = 0; i < 8; ++i)
+        code.push_back((uint8_t)(value >> (8 * i)));
+}
+
+void X86Encoder::moveImm(Gpr dst, int32_t value)
+{
+    rex(false, 0, -1, dst);
+    code.push_back((uint8_t)(0xB8 + (dst & 7)));
+    imm32(value);
+}
+
+void X86Encoder::storeImm(const Mem& dst, int32_t value)
+{
+    rm(0, 0xC7, 1, 0, dst);
+    imm32(value);
+}
+
+void X86Encoder::aluImm(int op, Gpr dst, int32_t value, bool wide)
+{
+    bool small = value >= -128 && value <= 127;
+    rr(0, small ? 0x83 : 0x81, 1, op, dst, wide);
+
+    if (small)
+        code.push_back((uint8_t)value);
+    else
+        imm32(value);
+}
+
+void X86Encoder::aluImm(int op, const Mem& dst, int32_t value)
+{
+    bool small = value >= -128 && value <= 127;
+    rm(0, small ? 0x83 : 0x81, 1, op, dst);
+
+    if (small)
+        code.push_back((uint8_t)value);
+    else
+        imm32(value);
+}
+
+void X86Encoder::push(Gpr reg)
+{
+    rex(false, 0, -1, reg);
+    code.push_back((uint8_t)(0x50 + (reg & 7)));
+}
+
+void X86Encoder::pop(Gpr reg)
+{
+    rex(false, 0, -1, reg);
+    code.push_back((uint8_t)(0x58 + (reg & 7)));
+}
+
+int X86Encoder::newLabel()
+{
+    labels.push_back(-1);
+    return (int)labels.size() - 1;
+}
+
+void X86Encoder::bind(int label)
+{
+    int target = (int)code.size();
+    labels[label] = target;
+
+    for (auto& fixup : fixups)
+        if (fixup.second == label)
+        {
+            int32_t disp = target - (fixup.first + 4);
+            for (int i = 0; i < 4; ++i)
+                code[fixup.first + i] = (uint8_t)((uint32_t)disp >> (8 * i));
+        }
+
+    fixups.erase(remove_if(fixups.begin(), fixups.end(), [label](const pair<int, int>& fixup) { return fixup.second == label; }), fixups.end());
+}
+
+void X86Encoder::rel32(int label)
+{
+    if (labels[label] >= 0)
+    {
+        imm32(labels[label] - ((int)code.size() + 4));
+        return;
+    }
+
+    fixups.push_back({ (int)code.size(), label });
+    imm32(0);
+}
+
+void X86Encoder::jump(int label)
+{
+    code.push_back(0xE9);
+    rel32(label);
+}
+
+void X86Encoder::call(int label)
+{
+    code.push_back(0xE8);
+    rel32(label);
+}
+
+void X86Encoder::jump(Cond cond, int label)
+{
+    code.push_back(0x0F);
+    code.push_back((uint8_t)(0x80 + cond));
+    rel32(label);
+}
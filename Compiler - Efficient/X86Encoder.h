@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// x86-64 general purpose registers, numbered as the instruction encoding numbers them. RIP
+// is only ever the base of a Mem, whose disp is then from the end of the instruction.
+enum Gpr
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    RIP
+};
+
+// condition codes, numbered as in Jcc and SETcc
+enum Cond
+{
+    CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+    CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G
+};
+
+// [base + index * scale + disp]
+struct Mem
+{
+    int base;
+    int disp = 0;
+    int index = -1;
+    int scale = 1;
+
+    explicit Mem(int base, int disp = 0) : base(base), disp(disp) {}
+    Mem(int base, int index, int scale, int disp) : base(base), disp(disp), index(index), scale(scale) {}
+};
+
+// Encodes x86-64 instructions into a byte buffer, without an assembler. Covers the forms
+// the code generators use: 32 bit integer and scalar single SSE arithmetic between a
+// register and a register or memory operand, 64 bit moves for pointers, and jumps to
+// labels that are patched once the label is bound.
+class X86Encoder
+{
+public:
+    std::vector<uint8_t> code;
+
+    // an opcode with a register and a register or memory operand; prefix is 0x66, 0xF2 or
+    // 0xF3 when the instruction has one, opcode holds up to three bytes, most significant first
+    void rm(int prefix, uint32_t opcode, int opcodeBytes, int reg, const Mem& mem, bool wide = false);
+    void rr(int prefix, uint32_t opcode, int opcodeBytes, int reg, int rmReg, bool wide = false);
+
+    // the common ones
+    void load(Gpr dst, const Mem& src) { rm(0, 0x8B, 1, dst, src); }                       // mov r32, m32
+    void store(const Mem& dst, Gpr src) { rm(0, 0x89, 1, src, dst); }                      // mov m32, r32
+    void store16(const Mem& dst, Gpr src) { rm(0x66, 0x89, 1, src, dst); }                 // mov m16, r16
+    void loadSigned16(Gpr dst, const Mem& src) { rm(0, 0x0FBF, 2, dst, src); }             // movsx r32, m16
+    void signExtend16(Gpr reg) { rr(0, 0x0FBF, 2, reg, reg); }                            // movsx r32, r16
+    void load64(Gpr dst, const Mem& src) { rm(0, 0x8B, 1, dst, src, true); }               // mov r64, m64
+    void loadSigned32(Gpr dst, const Mem& src) { rm(0, 0x63, 1, dst, src, true); }         // movsxd r64, m32
+    void store64(const Mem& dst, Gpr src) { rm(0, 0x89, 1, src, dst, true); }              // mov m64, r64
+    void move64(Gpr dst, Gpr src) { rr(0, 0x8B, 1, dst, src, true); }                     // mov r64, r64
+    void lea(Gpr dst, const Mem& src) { rm(0, 0x8D, 1, dst, src, true); }                  // lea r64, m
+    void alu64(int op, Gpr dst, const Mem& src) { rm(0, op * 8 + 3, 1, dst, src, true); }  // op r64, m64
+    void moveImm64(Gpr dst, uint64_t value);                                               // mov r64, imm64
+    void storeImm(const Mem& dst, int32_t value);                                          // mov m32, imm32
+    void moveImm(Gpr dst, int32_t value);                                                  // mov r32, imm32
+    void alu(int op, Gpr dst, const Mem& src) { rm(0, op * 8 + 3, 1, dst, src); }          // op r32, m32; op as in ALU_*
+    void alu(int op, Gpr dst, Gpr src) { rr(0, op * 8 + 3, 1, dst, src); }                // op r32, r32
+    void aluImm(int op, Gpr dst, int32_t value, bool wide = false);                        // op r, imm
+    void aluImm(int op, const Mem& dst, int32_t value);                                    // op m32, imm
+    void imul(Gpr dst, const Mem& src) { rm(0, 0x0FAF, 2, dst, src); }                     // imul r32, m32
+    void set(Cond cond, Gpr dst) { rr(0, 0x0F90 + cond, 2, 0, dst); }                     // setcc r8, al..bl only
+    void zeroExtend8(Gpr dst, Gpr src) { rr(0, 0x0FB6, 2, dst, src); }                    // movzx r32, r8
+    void test8(Gpr a, Gpr b) { rr(0, 0x84, 1, b, a); }                                    // test r8, r8
+
+    void movss(int xmm, const Mem& src) { rm(0xF3, 0x0F10, 2, xmm, src); }
+    void movss(const Mem& dst, int xmm) { rm(0xF3, 0x0F11, 2, xmm, dst); }
+    void sse(uint8_t op, int xmm, const Mem& src) { rm(0xF3, 0x0F00 | op, 2, xmm, src); }  // SSE_* xmm, m32
+    void sse(uint8_t op, int xmm, int src) { rr(0xF3, 0x0F00 | op, 2, xmm, src); }         // SSE_* xmm, xmm
+    void ucomiss(int xmm, const Mem& src) { rm(0, 0x0F2E, 2, xmm, src); }
+    void movd(int xmm, Gpr src) { rr(0x66, 0x0F6E, 2, xmm, src); }                         // movd xmm, r32
+    void cvtsi2ss(int xmm, const Mem& src) { rm(0xF3, 0x0F2A, 2, xmm, src); }
+
+    // 16 bytes at once: unaligned moves, four float or eight 16 bit lanes of arithmetic
+    void movups(int xmm, const Mem& src) { rm(0, 0x0F10, 2, xmm, src); }
+    void movups(const Mem& dst, int xmm) { rm(0, 0x0F11, 2, xmm, dst); }
+    void addps(int xmm, int src) { rr(0, 0x0F58, 2, xmm, src); }
+    void subps(int xmm, int src) { rr(0, 0x0F5C, 2, xmm, src); }
+    void paddw(int xmm, int src) { rr(0x66, 0x0FFD, 2, xmm, src); }
+    void psubw(int xmm, int src) { rr(0x66, 0x0FF9, 2, xmm, src); }
+
+    void push(Gpr reg);
+    void pop(Gpr reg);
+    void call(Gpr target) { rr(0, 0xFF, 1, 2, target); }                                  // call r64
+    void call(int label);                                                                  // call rel32
+    void ret() { code.push_back(0xC3); }
+
+    // labels: jumps to one not bound yet are patched when it is
+    int newLabel();
+    void bind(int label);
+    void jump(int label);
+    void jump(Cond cond, int label);
+
+    // every jump must have reached a bound label
+    bool resolved() const { return fixups.empty(); }
+
+private:
+    std::vector<int> labels;                    // code offset, -1 until bound
+    std::vector<std::pair<int, int>> fixups;    // (offset of a rel32, label)
+
+    void rex(bool wide, int reg, int index, int base, bool force = false);
+    void opcode(uint32_t value, int bytes);
+    void imm32(int32_t value);
+    void rel32(int label);
+};
+
+// ALU operations, the /digit of their 0x81 imm form; the r, r/m form of each is op * 8 + 3
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+// scalar single SSE operations, the last opcode byte after F3 0F
+enum { SSE_ADD = 0x58, SSE_MUL = 0x59, SSE_SUB = 0x5C, SSE_DIV = 0x5E };
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Runs every NAME.txt here on NAME.in, if there is one, and compares what it prints with
+# NAME.expected: on the VM, with -O, with the JIT compiling every function on its first call,
+# and as native executables built with and without -O. Native runs need cc.
+#
+#   tests/run.sh COMPILER
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 COMPILER" >&2
+    exit 2
+fi
+
+compiler=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+tests=$(cd "$(dirname "$0")" && pwd)
+
+# the compiler reads DFA.txt and grammar.txt and writes outfile.txt in its working directory
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp "$tests/../DFA.txt" "$tests/../grammar.txt" "$work"
+cd "$work" || exit 2
+
+modes=("--run" "-O --run" "--jit 0 --run" "--native program" "-O --native program")
+failed=0
+
+for source in "$tests"/*.txt; do
+    name=$(basename "$source" .txt)
+    input="$tests/$name.in"
+    [ -f "$input" ] || input=/dev/null
+
+    for mode in "${modes[@]}"; do
+        rm -f program program.o actual
+
+        if [[ $mode == *--native* ]]; then
+            "$compiler" "$source" $mode < /dev/null > actual && ./program < "$input" > actual
+        else
+            "$compiler" "$source" $mode < "$input" > actual
+        fi
+
+        if [ $? -ne 0 ] || ! cmp -s actual "$tests/$name.expected"; then
+            echo "FAIL $name ($mode)"
+            diff "$tests/$name.expected" actual | head -10
+            failed=$((failed + 1))
+        fi
+    done
+done
+
+[ $failed -eq 0 ] && echo "all tests passed"
+[ $failed -eq 0 ]